@@ -0,0 +1,346 @@
+#!/usr/bin/bash
+
+# Copyright (C) 2021, 2022  Stefan Vargyas
+#
+# This file is part of Word-Count.
+#
+# Word-Count is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# Word-Count is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with Word-Count.  If not, see <http://www.gnu.org/licenses/>.
+
+program="$0"
+
+usage="\
+usage: $program [ACTION|OPTION]... TEXT
+where the actions are:
+  -P|--pipe-input        time 'cat TEXT|word-count DICT' for each of the
+                           given text I/O types (default)
+  -F|--file-input        time 'word-count DICT TEXT' for each of the given
+                           text I/O types
+  -T|--counters          time 'word-count -j NUM -c 16M -i map -t TYPE DICT
+                           TEXT' for each of the given counter types
+and the options are:
+  -b|--io-buf-size=SIZE  pass \`-b SIZE' to each 'word-count' instance;
+                           the default is 1M
+  -c|--cold-cache        drop the page cache prior to each run of every
+                           command, instead of warming it up once; this
+                           requires write access to the file
+                           '/proc/sys/vm/drop_caches'
+  -d|--dict=FILE         the dictionary file passed to 'word-count'; the
+                           default is a dictionary made of the first NUM
+                           distinct words of TEXT (see \`-k|--dict-size')
+  -g|--all-words         have the action \`-T|--counters' time 'word-count
+                           -g -j NUM -c 16M -i map -t TYPE TEXT', counting
+                           all words of TEXT, with no dictionary; then, the
+                           default list of counter types is 'shard,atomic'
+  -i|--text-io=LIST      a comma separated list of text I/O types to be
+                           passed to 'word-count' as \`-i TYPE'; for the
+                           action \`-P|--pipe-input' the default list is
+                           'buf,ahead,splice', and for the action \`-F|
+                           --file-input' is 'buf,map,direct'
+  -j|--jobs=NUM          the number of worker threads passed to 'word-count'
+                           as \`-j NUM' by the action \`-T|--counters'; the
+                           default is 4
+  -k|--dict-size=NUM     the number of words of the dictionary made of the
+                           first distinct words of TEXT when \`-d|--dict'
+                           is not given; the default is 1000
+  -n|--repeat=NUM        the number of times to run each command; the
+                           minimum and the average of the elapsed times
+                           are printed out; the default is 5
+  -t|--counters=LIST     a comma separated list of counter types to be
+                           passed to 'word-count' as \`-t TYPE' by the
+                           action \`-T|--counters'; the default list is
+                           'shard,atomic,hybrid'
+  -?|--help              display this help info and exit"
+
+error()
+{
+    local m
+    case "$1" in
+        -o) m="invalid command line option '$o'"
+            ;;
+        -a) m="argument for option '$o' not given"
+            ;;
+        -i) m="invalid argument '$a' for option '$o'"
+            ;;
+        *)  m="$@"
+            ;;
+    esac
+    printf >&2 "%s\n" "${program##*/}: error: $m"
+}
+
+set -o pipefail
+shopt -s extglob
+
+action='P'
+io_buf_size='1M'
+cold_cache=''
+all_words=''
+dict=''
+dict_size='1000'
+jobs='4'
+text_io=''
+counters=''
+repeat='5'
+text=''
+
+parse-options()
+{
+    local o
+    local a
+    while [ "$#" -gt 0 ]; do
+        o="$1"
+        case "$o" in
+            -P|--pipe-input)
+                action='P'
+                ;;
+            -F|--file-input)
+                action='F'
+                ;;
+            -T|--counters)
+                action='T'
+                ;;
+            -c|--cold-cache)
+                cold_cache='yes'
+                ;;
+            -g|--all-words)
+                all_words='yes'
+                ;;
+            -[bdijknt]?*)
+                a="${o:2}"
+                o="${o:0:2}"
+                ;;&
+            -[bdijknt])
+                [ "$#" -lt 2 ] && {
+                    error -a
+                    return 1
+                }
+                a="$2"
+                shift
+                ;;&
+            --@(io-buf-size|dict|text-io|jobs|dict-size|repeat|counters)=*)
+                a="${o#*=}"
+                o="${o%%=*}"
+                ;;&
+            --@(io-buf-size|dict|text-io|jobs|dict-size|repeat|counters))
+                error -a
+                return 1
+                ;;
+            -b*|--io-buf-size*)
+                [[ "$a" != +([0-9])?([KM]) ]] && {
+                    error -i
+                    return 1
+                }
+                io_buf_size="$a"
+                ;;
+            -d*|--dict*)
+                dict="$a"
+                ;;
+            -i*|--text-io*)
+                [[ "$a" != +([a-z])*(,+([a-z])) ]] && {
+                    error -i
+                    return 1
+                }
+                text_io="$a"
+                ;;
+            -j*|--jobs*)
+                [[ "$a" != +([0-9]) || "$a" -eq 0 ]] && {
+                    error -i
+                    return 1
+                }
+                jobs="$a"
+                ;;
+            -k*|--dict-size*)
+                [[ "$a" != +([0-9]) || "$a" -eq 0 ]] && {
+                    error -i
+                    return 1
+                }
+                dict_size="$a"
+                ;;
+            -n*|--repeat*)
+                [[ "$a" != +([0-9]) || "$a" -eq 0 ]] && {
+                    error -i
+                    return 1
+                }
+                repeat="$a"
+                ;;
+            -t*|--counters*)
+                [[ "$a" != +([a-z])*(,+([a-z])) ]] && {
+                    error -i
+                    return 1
+                }
+                counters="$a"
+                ;;
+            -\?|--help)
+                action='?'
+                ;;
+            -*) error -o
+                return 1
+                ;;
+            *)  [ -n "$text" ] && {
+                    error "too many arguments: '$o'"
+                    return 1
+                }
+                text="$o"
+                ;;
+        esac
+        shift
+    done
+    return 0
+}
+
+parse-options "$@" ||
+exit 1
+
+[ "$action" == '?' ] && {
+    echo "$usage"
+    exit 0
+}
+
+[ -z "$text" ] && {
+    error "input text file not given"
+    exit 1
+}
+[ -f "$text" ] || {
+    error "input text file '$text' not found"
+    exit 1
+}
+[ -x ./word-count ] || {
+    error "'word-count' binary not found: issue 'make' first"
+    exit 1
+}
+[ -n "$cold_cache" -a ! -w /proc/sys/vm/drop_caches ] && {
+    error "cannot drop the page cache: '/proc/sys/vm/drop_caches' not writable"
+    exit 1
+}
+
+[ -z "$dict" -a -z "$all_words" ] && {
+    dict="$(mktemp /tmp/word-count-dict.XXX)" || {
+        error "failed creating dict temp file"
+        exit 1
+    }
+    trap 'rm -f "$dict"' EXIT
+
+    tr -s ' \t\f\r\v' '\n' < "$text" |
+    awk -v k="$dict_size" \
+        'NF && !($0 in s) { s[$0]; print; if (++ n == k) exit }' \
+    > "$dict"
+}
+
+# stev: print the elapsed time, in seconds,
+# of running the command given as argument
+elapsed()
+{
+    local TIMEFORMAT='%R'
+    { time eval "$1" > /dev/null 2>&1; } 2>&1
+}
+
+# stev: evict all the clean pages of
+# the page cache
+drop-caches()
+{
+    sync && echo 3 > /proc/sys/vm/drop_caches
+}
+
+# stev: run the command $1 for $repeat times;
+# print out the minimum and the average times
+bench()
+{
+    local c="$1"
+    local n="$2"
+    local k
+    local t
+    local s=''
+
+    # stev: warm up the page cache; with
+    # $cold_cache, only check the command
+    eval "$c" > /dev/null 2>&1 || {
+        error "command failed: $c"
+        return 1
+    }
+
+    for ((k=0;k<repeat;k++)); do
+        [ -n "$cold_cache" ] && {
+            drop-caches || {
+                error "failed dropping the page cache"
+                return 1
+            }
+        }
+        t="$(elapsed "$c")"
+        s+="${s:+ }$t"
+    done
+
+    awk -v n="$n" '{
+        m = $1; a = 0
+        for (i = 1; i <= NF; i ++) {
+            if ($i < m) m = $i
+            a += $i
+        }
+        printf("%-8s %8.3fs %8.3fs\n", n, m, a / NF)
+    }' <<< "$s"
+}
+
+pipe-input()
+{
+    local t
+    local c
+
+    printf "%-8s %9s %9s\n" 'type' 'min' 'avg'
+    for t in ${text_io//,/ }; do
+        c="cat $(printf '%q' "$text")|./word-count -i $t -b $io_buf_size $(printf '%q' "$dict")"
+        bench "$c" "$t" ||
+        return 1
+    done
+}
+
+file-input()
+{
+    local t
+    local c
+
+    printf "%-8s %9s %9s\n" 'type' 'min' 'avg'
+    for t in ${text_io//,/ }; do
+        c="./word-count -i $t -b $io_buf_size $(printf '%q' "$dict") $(printf '%q' "$text")"
+        bench "$c" "$t" ||
+        return 1
+    done
+}
+
+counter-types()
+{
+    local t
+    local c
+
+    printf "%-8s %9s %9s\n" 'type' 'min' 'avg'
+    for t in ${counters//,/ }; do
+        if [ -n "$all_words" ]; then
+            c="./word-count -g -j $jobs -c 16M -i map -t $t $(printf '%q' "$text")"
+        else
+            c="./word-count -j $jobs -c 16M -i map -t $t $(printf '%q' "$dict") $(printf '%q' "$text")"
+        fi
+        bench "$c" "$t" ||
+        return 1
+    done
+}
+
+case "$action" in
+    P)  [ -z "$text_io" ] && text_io='buf,ahead,splice'
+        pipe-input
+        ;;
+    F)  [ -z "$text_io" ] && text_io='buf,map,direct'
+        file-input
+        ;;
+    T)  [ -z "$counters" -a -n "$all_words" ] && counters='shard,atomic'
+        [ -z "$counters" ] && counters='shard,atomic,hybrid'
+        counter-types
+        ;;
+esac
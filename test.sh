@@ -25,8 +25,13 @@ where the actions are:
   -A|--all-build-run     build 'word-count' and run all tests on it
                            for each valid combination of the script's
                            command line options \`-g|--valgrind' and
-                           \`-m|--use-mmap-io={-,+,dict,text}', along
-                           with the following 'Makefile' parameters:
+                           \`-m|--use-mmap-io={-,+,dict,text}' (along
+                           with \`-i|--text-io=TYPE' for \`-m-', where
+                           TYPE is 'uring', 'ahead', 'splice', 'decomp'
+                           or 'auto', and \`-i|--text-io=TYPE' for \`-m
+                           text', where TYPE is 'window' or 'direct'),
+                           and with the following 'Makefile'
+                           parameters:
                              * no 'CONFIG', 'CONFIG+=USE_48BIT_PTR',
                                'CONFIG+=USE_OVERFLOW_BUILTINS',
                                'CONFIG+=USE_IO_BUF_LINEAR_GROWTH'
@@ -52,11 +57,20 @@ and the options are:
                            environment variable \$WORD_COUNT_IO_BUF_SIZE
                            set to SIZE; it can be of form [0-9]+[KM]?;
                            the default is 1
+  -i|--text-io=TYPE      execute each 'word-count' instance with an
+                           environment variable \$WORD_COUNT_TEXT_IO
+                           set to TYPE; it can be either 'buf', 'map',
+                           'uring', 'ahead', 'window', 'splice', 'decomp',
+                           'direct' or 'auto'
   -m|--use-mmap-io=SPEC  execute each 'word-count' instance with an
                            environment variable \$WORD_COUNT_USE_MMAP_IO
                            set to SPEC; it can be either 'dict', 'text',
                            'none' or 'all'; '-' is a shortcut for 'none'
                            and '+' for 'all'
+  -w|--map-window=SIZE   execute each 'word-count' instance with an
+                           environment variable \$WORD_COUNT_MAP_WINDOW
+                           set to SIZE; it can be of form [0-9]+[KM]?;
+                           the default is 1
   -v|--verbose           be verbose
   -?|--help              display this help info and exit"
 
@@ -126,6 +140,8 @@ no_color=''
 valgrind=''
 use_mmap_io=''
 io_buf_size='1'
+map_window='1'
+text_io=''
 dry_run=''
 verbose=''
 args=''
@@ -211,6 +227,31 @@ help"
                 }
                 io_buf_size="$a"
                 ;;
+            -w*|--map-window*)
+                if [ "${o:0:2}" == '-w' ]; then
+                    if [ "${#o}" -gt 2 ]; then
+                        a="${o:2}"
+                    else
+                        a="$2"
+                        shift
+                    fi
+                else
+                    if [ "${#o}" -eq 12 ]; then
+                        error -a
+                        return 1
+                    elif [ "${o:12:1}" != '=' ]; then
+                        error -o
+                        return 1
+                    else
+                        a="${o:13}"
+                    fi
+                fi
+                [[ "$a" != +([0-9])?([KM]) ]] && {
+                    error -i
+                    return 1
+                }
+                map_window="$a"
+                ;;
             -m*|--use-mmap-io*)
                 if [ "${o:0:2}" == '-m' ]; then
                     if [ "${#o}" -gt 2 ]; then
@@ -236,6 +277,31 @@ help"
                 }
                 use_mmap_io="$a"
                 ;;
+            -i*|--text-io*)
+                if [ "${o:0:2}" == '-i' ]; then
+                    if [ "${#o}" -gt 2 ]; then
+                        a="${o:2}"
+                    else
+                        a="$2"
+                        shift
+                    fi
+                else
+                    if [ "${#o}" -eq 9 ]; then
+                        error -a
+                        return 1
+                    elif [ "${o:9:1}" != '=' ]; then
+                        error -o
+                        return 1
+                    else
+                        a="${o:10}"
+                    fi
+                fi
+                [[ "$a" != @(buf|map|uring|ahead|window|splice|decomp|direct|auto) ]] && {
+                    error -i
+                    return 1
+                }
+                text_io="$a"
+                ;;
             -v|--verbose)
                 verbose='v'
                 ;;
@@ -386,6 +452,12 @@ GCC=$gcc -B$a"
 
             for m in - + ' dict' ' text'; do
                 c+=" \
+$program -R${verbose:+ -v}${no_color:+ -c} -e${g:+ -g} -m$m;"
+            done
+            for m in '- -i uring' '- -i ahead' ' text -i window' \
+                '- -i splice' '- -i decomp' ' text -i direct' \
+                '- -i auto'; do
+                c+=" \
 $program -R${verbose:+ -v}${no_color:+ -c} -e${g:+ -g} -m$m;"
             done
         done
@@ -493,6 +565,10 @@ rm -f   \"\$text_temp_file\"" \
     export WORD_COUNT_IO_BUF_SIZE="$io_buf_size"
     [ -n "$use_mmap_io" ] &&
     export WORD_COUNT_USE_MMAP_IO="$use_mmap_io"
+    [ -n "$text_io" ] &&
+    export WORD_COUNT_TEXT_IO="$text_io"
+    [ -n "$map_window" ] &&
+    export WORD_COUNT_MAP_WINDOW="$map_window"
 
     [[ "$WORD_COUNT_USE_MMAP_IO" == @(+|dict|all) ]] && {
         if [ "$action" == 'C' ]; then
@@ -32,6 +32,23 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+
+#ifdef CONFIG_USE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef CONFIG_USE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #ifdef CONFIG_COLLECT_STATISTICS
 #include <alloca.h>
 #include <time.h>
@@ -63,6 +80,7 @@
 // <<< WORD_COUNT_COMMON
 
 const char stdin_name[] = "<stdin>";
+const char stdout_name[] = "<stdout>";
 
 const char program[] = STRINGIFY(PROGRAM);
 const char verdate[] = "0.4 -- 2021-12-24 23:40"; // $ date +'%F %R'
@@ -82,19 +100,147 @@ const char help[] =
 "usage: %s [OPTION]... DICT [TEXT]...\n"
 "where the options are:\n"
 #endif // CONFIG_COLLECT_STATISTICS
+"  -a|--auto-map-min=SIZE   the size below which regular input files are\n"
+"                             read in using buffered I/O instead of being\n"
+"                             mapped in memory when '-i auto' is in effect;\n"
+"                             SIZE is of form [0-9]+[KM]?, the default being\n"
+"                             64K; attached env var: $WORD_COUNT_AUTO_MAP_MIN\n"
 "  -b|--io-buf-size=SIZE    the initial size of the memory buffers allocated\n"
 "                             for buffered I/O; SIZE is of form [0-9]+[KM]?,\n"
-"                             the default being 4K; the attached env var is\n"
-"                             $WORD_COUNT_IO_BUF_SIZE\n"
+"                             the default being 4K; SIZE can also be 'auto',\n"
+"                             in which case the text I/O type 'buf' adapts\n"
+"                             the size of its reads to each input text, the\n"
+"                             other I/O types using the default size; the\n"
+"                             attached env var is $WORD_COUNT_IO_BUF_SIZE\n"
+"  -c|--chunk-size=SIZE     when counting on several threads (see '-j'), do\n"
+"                             split the input files larger than SIZE, that\n"
+"                             are to be mapped in memory as a whole (I/O type\n"
+"                             'map'; the ones read by 'window' are not split),\n"
+"                             in chunks of about SIZE bytes, counted in\n"
+"                             parallel; the chunks are cut at whitespaces --\n"
+"                             or, with '-f', at newlines --; SIZE is of form\n"
+"                             [0-9]+[KM]?; by default, no file is split;\n"
+"                             attached env var: $WORD_COUNT_CHUNK_SIZE\n"
+"  -d|--delimiter=CHAR      the char that delimits the fields of the input\n"
+"                             text lines; the default is TAB\n"
+"  -e|--pipeline=TOK,CNT    count the words by a pipeline of threads: the main\n"
+"                             thread reads in input texts in blocks of 1M,\n"
+"                             cut at whitespaces -- or, with '-f', at new-\n"
+"                             lines --; TOK tokenizer threads split blocks\n"
+"                             in words, passing them on, hashed, to the CNT\n"
+"                             counter threads, each owning a range of the\n"
+"                             hash table; TOK and CNT are between 1 and 1024;\n"
+"                             this applies to the standard input too, while\n"
+"                             the options '-c', '-i', '-j', '-p', '-r' and\n"
+"                             '-t' do not apply; attached env var:\n"
+"                             $WORD_COUNT_PIPELINE\n"
+"  -f|--fields=LIST         count only the words within the fields of input\n"
+"                             text lines selected by LIST; LIST is a comma\n"
+"                             separated list of items of form N, N-M, N- or\n"
+"                             -M, selecting the N'th field, the N'th to M'th\n"
+"                             fields, the N'th field to end of line or the\n"
+"                             first to M'th fields; fields are numbered from\n"
+"                             1; the default is to select all fields\n"
+"  -g|--all-words           count all the words of the input texts, not only\n"
+"                             those of a dictionary: DICT is not given, all\n"
+"                             arguments being input texts; with '-j', the\n"
+"                             workers count the words into private hash\n"
+"                             tables, merged at the end ('-t shard'), or\n"
+"                             into one hash table shared with no locking,\n"
+"                             by atomic operations ('-t atomic' and '-t\n"
+"                             hybrid'); the options '-e' and '-n' do not\n"
+"                             apply\n"
 "  -h|--hash-tbl-size=SIZE  the initial number of hash table entries used;\n"
 "                             the default size is 1024; attached env var:\n"
 "                             $WORD_COUNT_HASH_TBL_SIZE\n"
+"  -i|--text-io=TYPE        use the specified type of I/O for reading input\n"
+"                             texts: either one of 'buf', 'map', 'uring',\n"
+"                             'ahead', 'window', 'splice', 'decomp',\n"
+"                             'direct' or 'auto'; the default is 'buf';\n"
+"                             'direct' reads regular files bypassing the\n"
+"                             page cache, with reads of the size given by\n"
+"                             '-b' rounded up to the file's block size;\n"
+"                             'auto' chooses for each input file one of\n"
+"                             'buf', 'map', 'window', 'ahead' or 'decomp',\n"
+"                             based on the file's type, size and contents\n"
+"                             (see '-a' and '-w'); attached env var:\n"
+"                             $WORD_COUNT_TEXT_IO; of the options '-i' and\n"
+"                             '-m', the last one given prevails\n"
+"  -j|--jobs=NUM            count the words of the input files on NUM worker\n"
+"                             threads, each file being counted by a single\n"
+"                             thread; when no input file is given, the main\n"
+"                             thread reads the standard input in blocks of\n"
+"                             1M, cut at whitespaces -- or, with '-f', at\n"
+"                             newlines --, counted in parallel by the NUM\n"
+"                             workers, while '-i' does not apply; the words\n"
+"                             are sorted (see '-s') and printed out on NUM\n"
+"                             threads as well; when sorted, and when the\n"
+"                             dictionary is mapped in memory (see '-m'), the\n"
+"                             dictionary gets loaded on NUM threads too; the\n"
+"                             output is the same, byte for byte, as of\n"
+"                             counting on one thread -- but, given '-g' and\n"
+"                             not '-s', only up to the order of the words --;\n"
+"                             NUM is of form [0-9]+[KM]? and is between 1\n"
+"                             and 1024, the default being 1; '-p' applies\n"
+"                             only when NUM is 1; attached env var:\n"
+"                             $WORD_COUNT_JOBS\n"
+"  -k|--cpus=LIST           pin the worker threads (see '-e' and '-j') to the\n"
+"                             CPUs of LIST, round-robin; LIST is a comma\n"
+"                             separated list of items of form N or N-M; by\n"
+"                             default, the worker threads are not pinned;\n"
+"                             attached env var: $WORD_COUNT_CPUS\n"
+"  -l|--max-buf-size=SIZE   stream input texts read by buffered I/O through\n"
+"                             a buffer of given maximum size, splitting the\n"
+"                             lines longer than the buffer between words;\n"
+"                             SIZE is of form [0-9]+[KM]?; by default, the\n"
+"                             buffer grows as needed to hold whole lines;\n"
+"                             attached env var: $WORD_COUNT_MAX_BUF_SIZE\n"
 "  -m|--use-mmap-io=SPEC    use memory-mapped I/O instead of buffered I/O\n"
 "                             as specified: either one of 'dict', 'text',\n"
 "                             'none' or 'all'; the default is 'none'; '-'\n"
 "                             is a shortcut for 'none' and '+' for 'all';\n"
 "                             attached env var: $WORD_COUNT_USE_MMAP_IO\n"
+"  -n|--numa=NODES          replicate the hash table and the dictionary words\n"
+"                             on each NUMA node running worker threads (see\n"
+"                             '-e' and '-j'); the workers are placed on the\n"
+"                             nodes round-robin, unless pinned by '-k'; the\n"
+"                             NODES are either 'auto', for the nodes of the\n"
+"                             system, or a colon separated list of CPU lists\n"
+"                             (see '-k'), one for each node; with only one\n"
+"                             node, nothing gets replicated; attached env\n"
+"                             var: $WORD_COUNT_NUMA\n"
+"  -p|--prefetch-size=SIZE  while counting the words of an input file, have\n"
+"                             the kernel read in ahead the next input files,\n"
+"                             up to 16 files and up to SIZE bytes in total;\n"
+"                             SIZE is of form [0-9]+[KM]?; by default, no\n"
+"                             prefetching is done; attached env var:\n"
+"                             $WORD_COUNT_PREFETCH_SIZE\n"
+"  -r|--drop-behind         have the kernel evict from the page cache the\n"
+"                             parts of the input texts already consumed;\n"
+"                             the dictionary remains cached; this applies\n"
+"                             to the text I/O types 'buf', 'map', 'ahead',\n"
+"                             'window' and 'decomp'\n"
 "  -s|--sort-words          sort dictionary words prior to print them out\n"
+"  -t|--counters=TYPE       when counting on several threads (see '-j'), the\n"
+"                             workers count words: into private arrays of\n"
+"                             counters, added up at the end ('shard'); by\n"
+"                             atomic increments of shared counters ('atomic');\n"
+"                             into private caches of the recently counted\n"
+"                             words, flushed into the shared counters upon\n"
+"                             eviction ('hybrid'); the default is 'shard';\n"
+"                             attached env var: $WORD_COUNT_COUNTERS\n"
+"  -u|--utf8-text           consider input texts UTF-8 encoded: beside the\n"
+"                             ASCII whitespace characters, the Unicode ones\n"
+"                             and the Unicode punctuation characters do too\n"
+"                             separate input words\n"
+"  -w|--map-window=SIZE     the size of the windows of input texts mapped in\n"
+"                             memory at a time when '-i window' is in effect;\n"
+"                             when '-i auto' is in effect, the regular input\n"
+"                             files larger than SIZE are mapped in windows;\n"
+"                             SIZE is of form [0-9]+[KM]?, the default being\n"
+"                             256M; attached env var: $WORD_COUNT_MAP_WINDOW\n"
+"  -x|--skip-lines=PREFIX   ignore entirely the input text lines that begin\n"
+"                             with PREFIX\n"
 "     --[print-]config      print all config and debug parameters and exit\n"
 #ifdef CONFIG_COLLECT_STATISTICS
 "     --[print-]stat-names  print the names of the statistics parameters\n"
@@ -613,6 +759,8 @@ enum io_error_type_t {
     io_error_type_stat,
     io_error_type_fadvise,
     io_error_type_mmap,
+    io_error_type_fcntl,
+    io_error_type_write,
 };
 
 void io_error_fmt(
@@ -638,6 +786,8 @@ void io_error_fmt(
         CASE(stat),
         CASE(fadvise),
         CASE(mmap),
+        CASE(fcntl),
+        CASE(write),
     };
 
     va_list arg;
@@ -672,8 +822,6 @@ void io_error_sys(
 #define IO_ERROR_SYS(e, c, f) \
     io_error_sys(io_error_type_ ## e, c, f, errno)
 
-#ifdef CONFIG_COLLECT_STATISTICS
-
 #define TIME_NSECS SZ(1000000000)
 
 #define TIME_INIT(s)                  \
@@ -722,9 +870,17 @@ uint64_t time_elapsed(uint64_t since)
     return TIME_SUB(now, since);
 }
 
+#ifdef CONFIG_COLLECT_STATISTICS
+
+// stev: the parameters of type 'min' and 'max'
+// are of type 'size_t' too, but are combined by
+// taking the minimum, respectively the maximum
+// of their values; 0 means 'no value' for 'min'
 enum stat_param_type_t {
     stat_param_type_size,
-    stat_param_type_time
+    stat_param_type_time,
+    stat_param_type_min,
+    stat_param_type_max
 };
 
 struct stat_param_t
@@ -747,6 +903,10 @@ struct stat_params_t
         STAT_PARAM_TYPE_(s, n, size_t)
 #define STAT_PARAM_TYPE_time_(s, n) \
         STAT_PARAM_TYPE_(s, n, uint64_t)
+#define STAT_PARAM_TYPE_min_(s, n) \
+        STAT_PARAM_TYPE_(s, n, size_t)
+#define STAT_PARAM_TYPE_max_(s, n) \
+        STAT_PARAM_TYPE_(s, n, size_t)
 #define STAT_PARAM_TYPE(s, n, t) \
         STAT_PARAM_TYPE_ ## t ## _(s, n)
 
@@ -808,6 +968,22 @@ void stat_params_add(
             break;
         }
 
+        case stat_param_type_min: {
+            size_t* d = STAT_PARAM_REF_SIZE(p, dest);
+            size_t v = STAT_PARAM_VAL_SIZE(p, src);
+            if (v > 0 && (*d == 0 || v < *d))
+                *d = v;
+            break;
+        }
+
+        case stat_param_type_max: {
+            size_t* d = STAT_PARAM_REF_SIZE(p, dest);
+            size_t v = STAT_PARAM_VAL_SIZE(p, src);
+            if (v > *d)
+                *d = v;
+            break;
+        }
+
         default:
             UNEXPECT_VAR("%d", p->type);
         }
@@ -844,7 +1020,7 @@ void stat_params_print(
          e = p + stat->n_params;
          p < e;
          p ++) {
-        size_t w = 23;
+        size_t w = 27;
 
         size_t l0 = ctxt != NULL
             ? strlen(ctxt) : 0;
@@ -876,6 +1052,8 @@ void stat_params_print(
         switch (p->type) {
 
         case stat_param_type_size:
+        case stat_param_type_min:
+        case stat_param_type_max:
             fprintf(file, "%zu\n",
                 STAT_PARAM_VAL_SIZE(p, obj));
             break;
@@ -1131,6 +1309,192 @@ struct mem_map_t*
     mem_mgr_as_map(const struct mem_mgr_t* mem)
 { return MEM_MGR_AS_(map); }
 
+// stev: class 'out_buf_t' writes out the output
+// of the program through a large buffer of its
+// own, flushed by 'write' system calls -- or, for
+// data larger than the buffer, by one 'writev' of
+// both the buffer and the data --; the integers
+// are formatted two decimal digits at a time, by
+// table lookups, instead of by 'fprintf'
+
+#define OUT_BUF_SIZE MB(1)
+
+struct out_buf_t
+{
+    char* ptr;
+    size_t len;
+    size_t size;
+    const char* name;
+    int fd;
+};
+
+void out_buf_init(
+    struct out_buf_t* buf,
+    int fd, const char* name)
+{
+    memset(buf, 0, sizeof *buf);
+
+    buf->fd = fd;
+    buf->name = name;
+    buf->size = OUT_BUF_SIZE;
+    buf->ptr = malloc(buf->size);
+    VERIFY(buf->ptr != NULL);
+}
+
+void out_buf_writev(
+    struct out_buf_t* buf,
+    struct iovec* vec,
+    size_t n)
+{
+    while (n > 0) {
+        ssize_t r = writev(buf->fd, vec,
+            n < IOV_MAX ? UINT_AS_INT(n) : IOV_MAX);
+        size_t k;
+
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0)
+            IO_ERROR_SYS(write, "output", buf->name);
+
+        // stev: skip over what got written;
+        // the writes to pipes may be partial
+        for (k = INT_AS_SIZE(r);
+             n > 0 && k >= vec->iov_len;
+             vec ++, n --)
+            k -= vec->iov_len;
+        if (n > 0) {
+            vec->iov_base = (char*) vec->iov_base + k;
+            vec->iov_len -= k;
+        }
+    }
+}
+
+void out_buf_flush(
+    struct out_buf_t* buf)
+{
+    struct iovec v = {
+        .iov_base = buf->ptr,
+        .iov_len  = buf->len
+    };
+
+    if (buf->len == 0)
+        return;
+
+    out_buf_writev(buf, &v, 1);
+    buf->len = 0;
+}
+
+void out_buf_done(
+    struct out_buf_t* buf)
+{
+    out_buf_flush(buf);
+    free(buf->ptr);
+}
+
+void out_buf_mem(
+    struct out_buf_t* buf,
+    const char* ptr, size_t len)
+{
+    if (len > buf->size - buf->len &&
+        len >= buf->size) {
+        struct iovec v[2] = {
+            { .iov_base = buf->ptr,
+              .iov_len  = buf->len },
+            { .iov_base = (char*) ptr,
+              .iov_len  = len }
+        };
+
+        out_buf_writev(buf, v, 2);
+        buf->len = 0;
+        return;
+    }
+
+    if (len > buf->size - buf->len)
+        out_buf_flush(buf);
+
+    memcpy(buf->ptr + buf->len, ptr, len);
+    buf->len += len;
+}
+
+// stev: the max length of the decimal
+// representation of a 'uint64_t'
+#define OUT_BUF_UINT_MAX 20
+
+// stev: put in 'ptr' the decimal representation
+// of 'val'; return its length
+size_t out_buf_format_uint(
+    char* ptr, uint64_t val)
+{
+    static const char digits[] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+    uint64_t p = 10;
+    size_t n = 1, i;
+
+    STATIC(OUT_BUF_UINT_MAX == 20);
+    while (n < OUT_BUF_UINT_MAX && val >= p) {
+        n ++;
+        // stev: 10^19 * 10 overflows
+        if (n < OUT_BUF_UINT_MAX)
+            p *= 10;
+    }
+
+    for (i = n; val >= 100; val /= 100) {
+        size_t k = val % 100 * 2;
+        ptr[-- i] = digits[k + 1];
+        ptr[-- i] = digits[k];
+    }
+    if (val >= 10) {
+        size_t k = val * 2;
+        ptr[-- i] = digits[k + 1];
+        ptr[-- i] = digits[k];
+    }
+    else
+        ptr[-- i] = '0' + val;
+    ASSERT(i == 0);
+
+    return n;
+}
+
+// stev: write out a line of form "%u\t%.*s\n"
+void out_buf_line(
+    struct out_buf_t* buf,
+    uint64_t val,
+    const char* ptr, size_t len)
+{
+    char* p;
+
+    if (OUT_BUF_UINT_MAX + 2 > buf->size - buf->len ||
+        len > buf->size - buf->len -
+            (OUT_BUF_UINT_MAX + 2)) {
+        char b[OUT_BUF_UINT_MAX + 1];
+        size_t n = out_buf_format_uint(b, val);
+
+        b[n ++] = '\t';
+        out_buf_mem(buf, b, n);
+        out_buf_mem(buf, ptr, len);
+        out_buf_mem(buf, "\n", 1);
+        return;
+    }
+
+    p = buf->ptr + buf->len;
+    p += out_buf_format_uint(p, val);
+    *p ++ = '\t';
+    memcpy(p, ptr, len);
+    p += len;
+    *p ++ = '\n';
+
+    buf->len = PTR_DIFF(p, buf->ptr);
+}
+
 // http://www.isthe.com/chongo/tech/comp/fnv/index.html
 // FNV Hash, by Landon Curt Noll
 
@@ -1476,6 +1840,58 @@ void lhash_done(struct lhash_t* hash)
 
 #endif // CONFIG_USE_48BIT_PTR
 
+// stev: make 'copy' a replica of 'hash' of
+// its own memory, the keys included -- these
+// are stored in '*keys', to be freed by the
+// caller; the values of the replica are all 0
+void lhash_clone(
+    struct lhash_t* copy,
+    const struct lhash_t* hash,
+    char** keys)
+{
+    struct lhash_node_t *p, *e;
+    size_t n = 0;
+    char* k;
+
+    LHASH_ASSERT_INVARIANTS(hash);
+
+    *copy = *hash;
+
+    copy->table = malloc(UINT_MUL(
+        hash->size, sizeof *hash->table));
+    VERIFY(copy->table != NULL);
+    memcpy(copy->table, hash->table,
+        hash->size * sizeof *hash->table);
+
+    for (p = copy->table,
+         e = p + copy->size;
+         p < e;
+         p ++) {
+        size_t l = LHASH_NODE_LEN(p);
+
+        if (LHASH_NODE_KEY(p) == NULL)
+            continue;
+        n = UINT_ADD(n, l);
+    }
+
+    *keys = k = malloc(n ? n : 1);
+    VERIFY(k != NULL);
+
+    for (p = copy->table;
+         p < e;
+         p ++) {
+        const char* q = LHASH_NODE_KEY(p);
+        size_t l = LHASH_NODE_LEN(p);
+
+        if (q == NULL)
+            continue;
+
+        memcpy(k, q, l);
+        LHASH_NODE_INIT(p, k, l);
+        k += l;
+    }
+}
+
 void lhash_rehash(struct lhash_t* hash)
 {
     struct lhash_node_t *t, *p, *e, *q;
@@ -1661,13 +2077,84 @@ new_node:
     return true;
 }
 
-bool lhash_lookup(
+enum lhash_insert_t {
+    lhash_insert_new,
+    lhash_insert_found,
+    lhash_insert_out
+};
+
+// stev: as 'lhash_insert', given the hash 'h'
+// of 'key', but probing only the range [lo, hi)
+// of the table, which is to contain the home
+// position of 'key'; neither does it rehash,
+// nor does it update 'hash->used': thus, the
+// concurrent callers inserting into disjoint
+// ranges do not interfere with each other;
+// when probing would get out of the range, the
+// key is not inserted, for the caller to do
+// it by 'lhash_insert' later
+enum lhash_insert_t lhash_insert_range(
+    struct lhash_t* hash,
+    const char* key, size_t len,
+    uint32_t h, size_t lo, size_t hi,
+    struct lhash_node_t** result)
+{
+    struct lhash_node_t *p, *b, *e;
+
+    ASSERT(key != NULL);
+    ASSERT(lo < hi);
+    ASSERT(hi <= hash->size);
+
+    b = hash->table + lo;
+    e = hash->table + hi;
+    p = hash->table + h % hash->size;
+
+    ASSERT(p >= b && p < e);
+
+    while (LHASH_NODE_KEY(p) != NULL) {
+        if (LHASH_NODE_KEY_EQ(p, key, len, h)) {
+            *result = p;
+            return lhash_insert_found;
+        }
+#ifndef CONFIG_PROBE_HASH_FORWARD
+        if (p == b)
+            return lhash_insert_out;
+        p --;
+#else
+        if (++ p == e)
+            return lhash_insert_out;
+#endif
+    }
+
+#ifdef CONFIG_MEMOIZE_KEY_HASHES
+    p->hash = h;
+#endif
+
+    *result = p;
+    return lhash_insert_new;
+}
+
+// stev: enlarge the table such that 'n' more
+// keys get to be inserted without rehashing
+void lhash_reserve(
+    struct lhash_t* hash,
+    size_t n)
+{
+    LHASH_ASSERT_INVARIANTS(hash);
+
+    n = UINT_ADD(n, hash->used);
+    while (hash->max_load < n)
+        lhash_rehash(hash);
+}
+
+// stev: look up 'key' of which hash is 'h'
+bool lhash_lookup_hash(
     const struct lhash_t* hash,
     const char* key, size_t len,
+    uint32_t h,
     struct lhash_node_t** result)
 {
     struct lhash_node_t* p;
-    uint32_t h;
 
 #ifdef CONFIG_COLLECT_STATISTICS
     struct lhash_t* this = CONST_CAST(
@@ -1684,7 +2171,6 @@ bool lhash_lookup(
         hash->size;
 #endif
 
-    h = lhash_hash_key(key, len);
     p = hash->table + h % hash->size;
 
     while (LHASH_NODE_KEY(p) != NULL) {
@@ -1719,8 +2205,20 @@ bool lhash_lookup(
     return false;
 }
 
+bool lhash_lookup(
+    const struct lhash_t* hash,
+    const char* key, size_t len,
+    struct lhash_node_t** result)
+{
+    ASSERT(key != NULL);
+
+    return lhash_lookup_hash(hash, key, len,
+        lhash_hash_key(key, len), result);
+}
+
 void lhash_print(
-    const struct lhash_t* hash, FILE* file)
+    const struct lhash_t* hash,
+    struct out_buf_t* out)
 {
     struct lhash_node_t *p, *e;
     const char* k;
@@ -1733,8 +2231,7 @@ void lhash_print(
         k = LHASH_NODE_KEY(p);
         l = LHASH_NODE_LEN(p);
         if (k != NULL && p->val > 0)
-            fprintf(file, "%u\t%.*s\n",
-                p->val, UINT_AS_INT(l), k);
+            out_buf_line(out, p->val, k, l);
     }
 }
 
@@ -1774,1126 +2271,8926 @@ void lhash_sort(
         lhash_cmp_key);
 }
 
-#ifdef CONFIG_COLLECT_STATISTICS
+// stev: class 'key_pool_t' holds the copies of
+// the words counted when there's no dictionary
+// to hold them; the copies are freed all at
+// once, along with the pool
 
-const struct stat_params_t*
-    lhash_stat_params(void)
+#define KEY_POOL_BLOCK_SIZE MB(1)
+
+struct key_pool_block_t
 {
-#undef  CASE
-#define CASE(n, t) \
-    STAT_PARAM_DEF(lhash_stats_t, n, t)
-    static const struct stat_param_t params[] = {
-        CASE(rehash_time,  time),
-        CASE(rehash_count, size),
-        CASE(rehash_hit,   size),
-        CASE(insert_hit,   size),
-        CASE(lookup_time,  time),
-        CASE(lookup_eq,    size),
-        CASE(lookup_ne,    size),
-    };
-    static const struct stat_params_t stat = {
-        .n_params = ARRAY_SIZE(params),
-        .params = params,
-        .name = "hash"
-    };
-    return &stat;
-}
+    struct key_pool_block_t* next;
+    char data[];
+};
 
-void lhash_print_stat_names(
-    const char* name, FILE* file)
+struct key_pool_t
 {
-    stat_params_print_names(
-        lhash_stat_params(),
-        name, file);
-}
+    struct key_pool_block_t* blocks;
+    char* ptr;
+    size_t left;
+    size_t last;
+};
 
-void lhash_print_stats(
-    const struct lhash_t* hash,
-    const char* name, FILE* file)
+void key_pool_init(
+    struct key_pool_t* pool)
 {
-    stat_params_print(
-        lhash_stat_params(),
-        &hash->stats,
-        name, file);
+    memset(pool, 0, sizeof *pool);
 }
 
-struct file_buf_stats_t
+void key_pool_done(
+    struct key_pool_t* pool)
 {
-    size_t   read_count;
-    size_t   commit_count;
-    uint64_t realloc_time;
-    size_t   realloc_count;
-    size_t   memcpy_bytes;
-    size_t   memcpy_count;
-    uint64_t getline_time;
-};
+    struct key_pool_block_t *p, *q;
 
-#endif // CONFIG_COLLECT_STATISTICS
+    for (p = pool->blocks; p != NULL; p = q) {
+        q = p->next;
+        free(p);
+    }
+}
 
-struct file_buf_t
+void* key_pool_alloc(
+    struct key_pool_t* pool,
+    size_t size)
 {
-    struct mem_buf_t* mem;
-    const char* name;
-    const char* ctxt;
-    size_t min_size;
-    int fd;
-    char* buf;
-    size_t size;
-    size_t off;
-    size_t len;
-    bits_t committed: 1;
-    bits_t eof: 1;
-#ifdef CONFIG_COLLECT_STATISTICS
-    struct file_buf_stats_t stats;
-#endif
-};
-
-#define FILE_BUF_IO_ERROR(e) \
-    IO_ERROR_SYS(e, file->ctxt, file->name)
+    const size_t a = sizeof(void*);
+    void* r;
 
-void file_buf_init(
-    struct file_buf_t* file,
-    struct mem_buf_t* mem,
-    const char* name,
-    const char* ctxt,
-    size_t min_size)
-{
-    memset(file, 0, sizeof *file);
+    ASSERT(size > 0);
+    size = UINT_ADD(size, a - 1) & ~(a - 1);
 
-    file->mem = mem;
-    file->name = name;
-    file->ctxt = ctxt;
-    file->min_size = min_size
-        ? min_size
-        : KB(4);
+    if (pool->left < size) {
+        size_t n = size > KEY_POOL_BLOCK_SIZE
+            ? size : KEY_POOL_BLOCK_SIZE;
+        struct key_pool_block_t* b;
 
-    file->size = file->min_size;
-    file->buf = malloc(file->size);
-    VERIFY(file->buf != NULL);
+        b = malloc(UINT_ADD(sizeof *b, n));
+        VERIFY(b != NULL);
 
-    if (name != NULL) {
-        file->fd = open(name, O_RDONLY);
-        if (file->fd < 0)
-            FILE_BUF_IO_ERROR(open);
+        b->next = pool->blocks;
+        pool->blocks = b;
+        pool->ptr = b->data;
+        pool->left = n;
     }
 
-    struct stat s;
-    if (fstat(file->fd, &s) < 0)
-        FILE_BUF_IO_ERROR(stat);
-
-    if (!S_ISREG(s.st_mode))
-        return;
+    r = pool->ptr;
+    pool->ptr += size;
+    pool->left -= size;
+    pool->last = size;
 
-    if (posix_fadvise(
-            file->fd, 0, s.st_size,
-            POSIX_FADV_SEQUENTIAL))
-        FILE_BUF_IO_ERROR(fadvise);
+    return r;
 }
 
-void file_buf_done(
-    struct file_buf_t* file)
+// stev: give back the memory last allocated
+void key_pool_unalloc(
+    struct key_pool_t* pool,
+    void* ptr)
 {
-    if (!file->committed &&
-         file->buf != NULL) {
-        ASSERT(file->size > 0);
-        free(file->buf);
-    }
-    if (file->fd >= 0)
-        close(file->fd);
+    ASSERT(pool->last > 0);
+    ASSERT((char*) ptr + pool->last ==
+        pool->ptr);
+
+    pool->ptr -= pool->last;
+    pool->left += pool->last;
+    pool->last = 0;
 }
 
-bool file_buf_read(
-    const struct file_buf_t* file,
-    char* buf, size_t len,
-    size_t* result)
-{
-    size_t n = 0;
+// stev: the hash functions 'FNV1' and 'FNV1A'
+// read one byte past the end of the keys: the
+// copies are followed by a NUL byte
+#define KEY_POOL_COPY_SIZE(n) \
+    UINT_ADD(n, SZ(1))
 
-#ifdef CONFIG_COLLECT_STATISTICS
-    struct file_buf_t* this = CONST_CAST(
-        file, struct file_buf_t);
-#endif
+char* key_pool_copy(
+    struct key_pool_t* pool,
+    const char* key, size_t len)
+{
+    char* r = key_pool_alloc(pool,
+        KEY_POOL_COPY_SIZE(len));
 
-    ASSERT(buf != NULL);
-    ASSERT(len > 0);
+    memcpy(r, key, len);
+    r[len] = 0;
+    return r;
+}
 
-    do {
-        ssize_t r = read(
-            file->fd, buf, len);
-#ifdef CONFIG_COLLECT_STATISTICS
-        this->stats.read_count ++;
-#endif
-        if (r < 0)
-            FILE_BUF_IO_ERROR(read);
+// stev: take over the blocks of 'src'
+void key_pool_move(
+    struct key_pool_t* pool,
+    struct key_pool_t* src)
+{
+    struct key_pool_block_t** p;
 
-        if (r == 0) {
-            *result = n;
-            return true;
-        }
+    if (src->blocks == NULL)
+        return;
 
-        size_t l = INT_AS_SIZE(r);
-        ASSERT(l <= len);
+    for (p = &src->blocks; *p != NULL;)
+        p = &(*p)->next;
 
-        buf += l;
-        len -= l;
+    *p = pool->blocks;
+    pool->blocks = src->blocks;
 
-        ASSERT_UINT_ADD_NO_OVERFLOW(
-            n, l);
-        n += l;
-    } while (len);
+    // stev: the current block of 'pool'
+    // is not the first one any longer;
+    // it is not to be allocated from
+    pool->ptr = NULL;
+    pool->left = 0;
+    pool->last = 0;
 
-    *result = n;
-    return false;
+    memset(src, 0, sizeof *src);
 }
 
-#ifdef DEBUG_FILE_BUF_GET_LINE
-const char* repr0(
-    const char* p, size_t n, size_t k)
+// stev: class 'chash_t' is a hash table of open
+// addressing with linear probing into which
+// several threads insert keys and increment
+// their counters concurrently, with no locking:
+// a free slot is claimed by a compare-and-swap
+// of its key pointer -- the key being copied
+// beforehand, along with its hash and length,
+// into the thread's 'key_pool_t' --, and the
+// counters are incremented by atomic additions;
+// once over its maximum load, the table gets
+// to be moved to a table twice as large by all
+// the threads that access it meanwhile: each
+// thread takes over blocks of slots, marking
+// the free slots as moved and freezing the
+// counters of the taken slots -- by setting
+// their most significant bit -- prior to move
+// them; a thread that finds a slot moved or a
+// counter frozen retries in the next table,
+// once the whole table got moved; the tables
+// moved are freed along with the 'chash_t'
+// instance, since some threads may still be
+// reading them
+
+struct chash_key_t
 {
-    static const uchar_t repr[256] = {
-        ['\0'] = '0', ['\a'] = 'a', ['\b'] = 'b',
-        ['\f'] = 'f', ['\n'] = 'n', ['\r'] = 'r',
-        ['\t'] = 't', ['\v'] = 'v', ['"']  = '"'
-    };
+    uint32_t hash;
+    unsigned len;
+    char ptr[];
+};
 
-    enum { N = 1024 };
-    static char buf[2][N];
+// stev: the key of the slots moved
+// while free to the next table
+#define CHASH_MOVED \
+    ((struct chash_key_t*) 1)
+#define CHASH_FROZEN \
+    (UINT64_C(1) << 63)
 
-    STATIC(CHAR_BIT == 8);
+#define CHASH_MOVE_BLOCK 1024
 
-    VERIFY(k < 2);
-    char *q = buf[k], *e = q + (N - 1);
+struct chash_slot_t
+{
+    struct chash_key_t* key;
+    uint64_t val;
+};
 
-    int s = snprintf(
-                q, PTR_DIFF(e, q),
-                "[%p]\"", p);
-    q += INT_AS_SIZE(s);
+struct chash_table_t
+{
+    size_t size;
+    size_t max_load;
+    // stev: accessed atomically
+    size_t used;
+    struct chash_table_t* next;
+    size_t cursor;
+    size_t moved;
+    struct chash_table_t* prev;
+    struct chash_slot_t slots[];
+};
 
-    while (n -- && q < e) {
-        uchar_t c = *p ++;
-        uchar_t r = repr[c];
-        if (!r && !ISPRINT(c)) {
-            s = snprintf(
-                    q, PTR_DIFF(e, q),
-                    "\\%02x", c);
-            q += INT_AS_SIZE(s);
-        }
-        else
-        if (r) {
-            *q ++ = '\\';
-            if (q >= e) break;
-            *q ++ = r;
-        }
-        else
-            *q ++ = c;
-    }
-    if (q < e)
-        *q ++ = '"';
-    *q = 0;
+struct chash_t
+{
+    struct chash_table_t* table;
+};
 
-    return buf[k];
-}
+#define CHASH_LOAD(p) \
+    __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define CHASH_CAS(p, o, n)           \
+    __atomic_compare_exchange_n(     \
+        p, o, n, false,              \
+        __ATOMIC_ACQ_REL,            \
+        __ATOMIC_ACQUIRE)
 
-const char* repr(
-    const char* p, size_t n)
-{ return repr0(p, n, 1); }
+struct chash_table_t* chash_table_new(
+    size_t size)
+{
+    struct chash_table_t* t;
 
-void file_buf_print_debug_head(
-    const struct file_buf_t* file, size_t id)
+    t = calloc(1, UINT_ADD(sizeof *t,
+        UINT_MUL(size, sizeof *t->slots)));
+    VERIFY(t != NULL);
+
+    t->size = size;
+    // stev: the load factor is 0.75,
+    // as for 'lhash_t'
+    t->max_load = size / 4 * 3;
+
+    return t;
+}
+
+void chash_init(
+    struct chash_t* chash,
+    size_t size)
 {
-    fprintf(stderr, "!!! %s: #%zu: min=%zu size=%zu "
-        "committed=%d eof=%d off=%zu len=%zu buf=%s ",
-        file->ctxt, id, file->min_size, file->size,
-        file->committed, file->eof, file->off, file->len,
-        repr0(file->buf, file->off + file->len, 0));
+    chash->table = chash_table_new(
+        size >= 64 ? size : 64);
 }
 
-void file_buf_print_debug(
-    const struct file_buf_t* file,
-    size_t id, const char* msg, ...)
-    PRINTF(3);
+void chash_done(
+    struct chash_t* chash)
+{
+    struct chash_table_t *t, *p;
 
-void file_buf_print_debug(
-    const struct file_buf_t* file,
-    size_t id, const char* msg, ...)
+    ASSERT(chash->table->next == NULL);
+
+    for (t = chash->table; t != NULL; t = p) {
+        p = t->prev;
+        free(t);
+    }
+}
+
+void chash_grow(
+    struct chash_table_t* table)
 {
-    va_list args;
+    struct chash_table_t *t, *n = NULL;
 
-    file_buf_print_debug_head(
-        file, id);
+    if (CHASH_LOAD(&table->next) != NULL)
+        return;
 
-    va_start(args, msg);
-    vfprintf(stderr, msg, args);
-    va_end(args);
+    t = chash_table_new(UINT_MUL(
+        table->size, SZ(2)));
+    t->prev = table;
 
-    fputc('\n', stderr);
+    if (!CHASH_CAS(&table->next, &n, t))
+        free(t);
 }
 
-#define FILE_BUF_PRINT_DEBUG_HEAD(i)          \
-    do {                                      \
-        file_buf_print_debug_head(file, i);   \
-    } while (0)
-#define FILE_BUF_PRINT_DEBUG_TAIL(m, ...)     \
-    do {                                      \
-        fprintf(stderr, m "\n", __VA_ARGS__); \
-    } while (0)
-#define FILE_BUF_PRINT_DEBUG(i, m, ...)       \
-    do {                                      \
-        file_buf_print_debug(file, i, m,      \
-            ## __VA_ARGS__);                  \
-    } while (0)
-#else  // DEBUG_FILE_BUF_GET_LINE
-#define FILE_BUF_PRINT_DEBUG_HEAD(i)          \
-    do {} while (0)
-#define FILE_BUF_PRINT_DEBUG_TAIL(m, ...)     \
-    do {} while (0)
-#define FILE_BUF_PRINT_DEBUG(i, m, ...)       \
-    do {} while (0)
-#endif // DEBUG_FILE_BUF_GET_LINE
+void chash_move_slot(
+    struct chash_table_t* table,
+    struct chash_slot_t* slot)
+{
+    struct chash_key_t* k = NULL;
+    uint64_t v;
+    size_t i;
 
-bool file_buf_get_line(
-    struct file_buf_t* file,
-    char const** ptr,
-    size_t* len)
+    if (CHASH_CAS(&slot->key, &k, CHASH_MOVED))
+        return;
+
+    // stev: each slot is moved by one thread
+    // only: 'k' is a key, not 'CHASH_MOVED'
+    ASSERT(k != CHASH_MOVED);
+
+    v = __atomic_fetch_or(&slot->val,
+        CHASH_FROZEN, __ATOMIC_ACQ_REL);
+    ASSERT(!(v & CHASH_FROZEN));
+
+    // stev: the next table is accessed only
+    // by the threads moving slots; all keys
+    // moved are distinct
+    for (i = k->hash % table->size;;) {
+        struct chash_slot_t* q =
+            table->slots + i;
+        struct chash_key_t* z = NULL;
+
+        if (CHASH_CAS(&q->key, &z, k)) {
+            __atomic_store_n(&q->val, v,
+                __ATOMIC_RELAXED);
+            __atomic_add_fetch(&table->used, 1,
+                __ATOMIC_RELAXED);
+            return;
+        }
+        if (++ i == table->size)
+            i = 0;
+    }
+}
+
+void chash_move(
+    struct chash_t* chash,
+    struct chash_table_t* table)
 {
-#ifdef CONFIG_COLLECT_STATISTICS
-    uint64_t c = time_now();
-#endif
+    struct chash_table_t *n, *o = table;
+    size_t b, e, i;
 
-    while (true) {
-        ASSERT_UINT_ADD_NO_OVERFLOW(
-            file->off, file->len);
-        // stev: main invariants:
-        ASSERT(file->off + file->len <=
-            file->size);
-        ASSERT(file->buf != NULL);
-        ASSERT(file->size > 0);
+    n = CHASH_LOAD(&table->next);
+    ASSERT(n != NULL);
 
-        char* p = file->buf + file->off;
+    while ((b = __atomic_fetch_add(
+                &table->cursor, CHASH_MOVE_BLOCK,
+                __ATOMIC_RELAXED)) < table->size) {
+        e = table->size - b > CHASH_MOVE_BLOCK
+            ? b + CHASH_MOVE_BLOCK
+            : table->size;
 
-        FILE_BUF_PRINT_DEBUG(1, "iterating p=%s",
-            repr(p, file->len));
+        for (i = b; i < e; i ++)
+            chash_move_slot(n, table->slots + i);
 
-        char* q = memchr(p, '\n', file->len);
-        if (q != NULL || file->eof) {
-            if (!file->committed &&
-                file->mem != NULL) {
-                mem_buf_append(
-                    file->mem,
-                    file->buf);
-                file->committed = true;
+        __atomic_add_fetch(&table->moved, e - b,
+            __ATOMIC_RELEASE);
+    }
 
-                FILE_BUF_PRINT_DEBUG(1,
-                    "committed %p",
-                    file->buf);
-#ifdef CONFIG_COLLECT_STATISTICS
-                file->stats.commit_count ++;
-#endif
-            }
+    // stev: the next table is to be used
+    // only once the whole table got moved
+    while (CHASH_LOAD(&table->moved) <
+            table->size)
+        sched_yield();
 
-            size_t d = q != NULL
-                ? PTR_DIFF(q, p)
-                : file->len;
-            *ptr = p;
-            *len = d;
+    CHASH_CAS(&chash->table, &o, n);
+}
 
-            if (q != NULL) {
-                ASSERT_UINT_INC_NO_OVERFLOW(d);
-                d ++;
+// stev: count 'key' into 'table'; return false
+// when the table is being moved, for the caller
+// to retry in the next table; '*copy' is the
+// copy of the key not yet inserted, if any
+bool chash_table_count(
+    struct chash_table_t* table,
+    struct key_pool_t* pool,
+    const char* key, size_t len,
+    uint32_t hash,
+    struct chash_key_t** copy)
+{
+    size_t i = hash % table->size, n;
+
+    for (n = 0; n < table->size; n ++) {
+        struct chash_slot_t* s =
+            table->slots + i;
+        struct chash_key_t* k =
+            CHASH_LOAD(&s->key);
+
+        if (k == NULL) {
+            struct chash_key_t* c = *copy;
+
+            if (c == NULL) {
+                c = key_pool_alloc(pool,
+                    UINT_ADD(sizeof *c,
+                    KEY_POOL_COPY_SIZE(len)));
+                c->hash = hash;
+                c->len = len;
+                memcpy(c->ptr, key, len);
+                c->ptr[len] = 0;
+                *copy = c;
             }
-            file->off += d;
-            file->len -= d;
+            if (CHASH_CAS(&s->key, &k, c)) {
+                k = c;
+                *copy = NULL;
+
+                if (__atomic_add_fetch(
+                        &table->used, 1,
+                        __ATOMIC_RELAXED) >
+                    table->max_load)
+                    chash_grow(table);
+            }
+            // stev: otherwise, 'k' is the key
+            // some other thread put in the slot
+        }
 
-            FILE_BUF_PRINT_DEBUG(2,
-                "returning %d len=%zu ptr=%s",
-                !file->eof || *len, *len,
-                repr(*ptr, *len));
+        if (k == CHASH_MOVED)
+            return false;
 
-#ifdef CONFIG_COLLECT_STATISTICS
-            TIME_ADD(
-                file->stats.getline_time,
-                time_elapsed(c));
-#endif
-            return !file->eof || *len;
-        }
-        // => q == NULL && !file->eof
+        if (k->hash == hash &&
+            k->len == len &&
+            !memcmp(k->ptr, key, len))
+            return !(__atomic_fetch_add(
+                &s->val, 1, __ATOMIC_RELAXED) &
+                CHASH_FROZEN);
 
-        size_t s = file->size;
-#ifdef CONFIG_USE_IO_BUF_LINEAR_GROWTH
-        ASSERT_UINT_ADD_NO_OVERFLOW(
-            s, file->min_size);
-        s += file->min_size;
-#else
-        ASSERT_UINT_MUL_NO_OVERFLOW(
-            s, SZ(2));
-        s *= SZ(2);
-#endif
+        if (++ i == table->size)
+            i = 0;
+    }
 
-        FILE_BUF_PRINT_DEBUG_HEAD(3);
+    // stev: the table is full
+    chash_grow(table);
+    return false;
+}
 
-#ifdef CONFIG_COLLECT_STATISTICS
-        uint64_t c2 = time_now();
-#endif
-        char* b = realloc(
-            !file->committed ? file->buf : NULL, s);
-#ifdef CONFIG_COLLECT_STATISTICS
-        TIME_ADD(
-            file->stats.realloc_time,
-            time_elapsed(c2));
-        file->stats.realloc_count ++;
-#endif
-        VERIFY(b != NULL);
+void chash_count(
+    struct chash_t* chash,
+    struct key_pool_t* pool,
+    const char* key, size_t len,
+    uint32_t hash)
+{
+    struct chash_key_t* c = NULL;
 
-        FILE_BUF_PRINT_DEBUG_TAIL(
-            "realloced (size=%zu) from %p to %p",
-            s, !file->committed ? file->buf : NULL, b);
+    ASSERT(len <= UINT_MAX);
+
+    while (true) {
+        struct chash_table_t* t =
+            CHASH_LOAD(&chash->table);
+
+        if (CHASH_LOAD(&t->next) == NULL &&
+            chash_table_count(t, pool,
+                key, len, hash, &c))
+            break;
+
+        if (CHASH_LOAD(&t->next) != NULL)
+            chash_move(chash, t);
+    }
+
+    if (c != NULL)
+        key_pool_unalloc(pool, c);
+}
 
-        if (file->committed) {
-            memcpy(b, p, file->len);
-            file->off = 0;
 #ifdef CONFIG_COLLECT_STATISTICS
-            ASSERT_UINT_ADD_NO_OVERFLOW(
-                file->stats.memcpy_bytes, file->len);
-            file->stats.memcpy_bytes += file->len;
-            file->stats.memcpy_count ++;
-#endif
-        }
-        file->committed = false;
-        file->size = s;
-        file->buf = b;
-
-        size_t n = 0;
-        ASSERT_UINT_ADD_NO_OVERFLOW(
-            file->off, file->len);
-        size_t w = file->off + file->len;
-        ASSERT_UINT_SUB_NO_OVERFLOW(
-            file->size, w);
-        file->eof = file_buf_read(
-            file, file->buf + w,
-            file->size - w,
-            &n);
-        ASSERT(n <= file->size - w);
-
-        FILE_BUF_PRINT_DEBUG(4, "read n=%zu %s",
-            n, repr(file->buf + w, n));
-
-        // stev: from the assert above:
-        //     n <= size - w
-        // <=> n <= size - (off + len)
-        // <=> off + (len + n) <= size
-
-        // stev: therefore, after updating
-        // 'len += n' below, the invariant
-        // 'off + len <= size' is maintained
-        ASSERT_UINT_ADD_NO_OVERFLOW(
-            file->len, n);
-        file->len += n;
-    }
-}
-
-#ifdef CONFIG_COLLECT_STATISTICS
-
-void file_buf_stats_init(
-    struct file_buf_stats_t* stats,
-    const struct file_buf_t* file)
-{
-    if (file != NULL)
-        memcpy(stats, &file->stats, sizeof *stats);
-    else
-        memset(stats, 0, sizeof *stats);
-}
 
 const struct stat_params_t*
-    file_buf_stat_params(void)
+    lhash_stat_params(void)
 {
 #undef  CASE
 #define CASE(n, t) \
-    STAT_PARAM_DEF(file_buf_stats_t, n, t)
+    STAT_PARAM_DEF(lhash_stats_t, n, t)
     static const struct stat_param_t params[] = {
-        CASE(read_count,    size),
-        CASE(commit_count,  size),
-        CASE(realloc_time,  time),
-        CASE(realloc_count, size),
-        CASE(memcpy_bytes,  size),
-        CASE(memcpy_count,  size),
-        CASE(getline_time,  time),
+        CASE(rehash_time,  time),
+        CASE(rehash_count, size),
+        CASE(rehash_hit,   size),
+        CASE(insert_hit,   size),
+        CASE(lookup_time,  time),
+        CASE(lookup_eq,    size),
+        CASE(lookup_ne,    size),
     };
     static const struct stat_params_t stat = {
         .n_params = ARRAY_SIZE(params),
         .params = params,
-        .name = "buf"
+        .name = "hash"
     };
     return &stat;
 }
 
-void file_buf_stats_add(
-    struct file_buf_stats_t* stats,
-    const struct file_buf_stats_t* stats2)
-{
-    stat_params_add(
-        file_buf_stat_params(),
-        stats, stats2);
-}
-
-void file_buf_stats_print_names(
-    const char* name,
-    FILE* file)
+void lhash_print_stat_names(
+    const char* name, FILE* file)
 {
     stat_params_print_names(
-        file_buf_stat_params(),
+        lhash_stat_params(),
         name, file);
 }
 
-void file_buf_stats_print(
-    const struct file_buf_stats_t* stats,
+void lhash_print_stats(
+    const struct lhash_t* hash,
     const char* name, FILE* file)
 {
     stat_params_print(
-        file_buf_stat_params(),
-        stats, name, file);
+        lhash_stat_params(),
+        &hash->stats,
+        name, file);
 }
 
-struct file_map_stats_t
+struct file_buf_stats_t
 {
+    size_t   read_count;
+    size_t   commit_count;
+    uint64_t realloc_time;
+    size_t   realloc_count;
+    size_t   memcpy_bytes;
+    size_t   memcpy_count;
+    size_t   split_count;
+    size_t   pool_count;
+    size_t   fadvise_count;
+    size_t   adapt_count;
+    size_t   read_size_min;
+    size_t   read_size_max;
     uint64_t getline_time;
 };
 
 #endif // CONFIG_COLLECT_STATISTICS
 
-struct file_map_t
+// stev: class 'file_drop_t' implements the
+// drop-behind of input files read only once:
+// the ranges of the file already consumed are
+// evicted from the page cache by the means of
+// 'posix_fadvise(POSIX_FADV_DONTNEED)'; for the
+// files mapped in memory, that's preceded by
+// 'madvise(MADV_DONTNEED)', since the kernel
+// does not evict the pages that are mapped;
+// the ranges dropped are aligned to multiples
+// of 'FILE_DROP_ALIGN' bytes, because the page
+// cache keeps files in folios of up to that
+// size, and a folio only partially covered by
+// a range is left in the cache
+
+#define FILE_DROP_ALIGN MB(2)
+
+struct file_drop_t
 {
-    struct mem_map_t* mem;
-    struct mem_map_node_t* node;
     const char* name;
     const char* ctxt;
+    // stev: the file's mapping, or NULL
     char* ptr;
+    // stev: dropped are all bytes before 'off'
+    size_t off;
+    // stev: -1 when drop-behind is disabled
+    int fd;
+};
+
+#define FILE_DROP_IO_ERROR(e) \
+    IO_ERROR_SYS(e, drop->ctxt, drop->name)
+
+void file_drop_init(
+    struct file_drop_t* drop,
+    const char* name,
+    const char* ctxt,
+    int fd, char* ptr)
+{
+    memset(drop, 0, sizeof *drop);
+
+    drop->name = name;
+    drop->ctxt = ctxt;
+    drop->ptr = ptr;
+    drop->fd = fd;
+}
+
+void file_drop_disable(
+    struct file_drop_t* drop)
+{
+    memset(drop, 0, sizeof *drop);
+    drop->fd = -1;
+}
+
+// stev: drop the range ['off', 'end') of the
+// file; 'end' being 0 stands for end of file
+void file_drop_range(
+    struct file_drop_t* drop,
+    size_t end, size_t len)
+{
+    if (drop->ptr != NULL &&
+        madvise(drop->ptr + drop->off, len,
+            MADV_DONTNEED) < 0)
+        MEM_MAP_ERROR(madvise);
+
+    if (posix_fadvise(drop->fd,
+            UINT_AS_OFFT(drop->off),
+            UINT_AS_OFFT(end ? len : 0),
+            POSIX_FADV_DONTNEED))
+        FILE_DROP_IO_ERROR(fadvise);
+
+    drop->off = end;
+}
+
+// stev: the bytes of the file up to 'pos' are
+// consumed: drop the ones prior to the last
+// 'FILE_DROP_ALIGN' boundary not after 'pos'
+void file_drop_behind(
+    struct file_drop_t* drop,
+    size_t pos)
+{
+    if (drop->fd < 0)
+        return;
+
+    size_t e = pos - pos % FILE_DROP_ALIGN;
+    if (e <= drop->off)
+        return;
+
+    file_drop_range(
+        drop, e, e - drop->off);
+}
+
+// stev: all the file of size 'size' is consumed
+void file_drop_done(
+    struct file_drop_t* drop,
+    size_t size)
+{
+    if (drop->fd < 0 ||
+        drop->off >= size)
+        return;
+
+    file_drop_range(
+        drop, 0, size - drop->off);
+}
+
+// stev: class 'file_buf_pool_t' keeps state
+// across a series of 'file_buf_t' instances
+// reading input files one after the other:
+// the buffer of each instance is passed on
+// to the next one, instead of being freed
+// and allocated again; the directory of the
+// last file opened is kept open, such that
+// the files of the same directory be opened
+// by 'openat' relative to it, which spares
+// the kernel from looking up the directory
+// path once again for each file
+
+struct file_buf_pool_t
+{
+    char* buf;
     size_t size;
-    size_t line;
+    char* dir;
+    size_t dir_len;
+    size_t dir_size;
+    int dir_fd;
+};
+
+#define FILE_BUF_POOL_ERROR(e) \
+    syslib_error_sys(#e, "file-buf-pool", errno)
+
+void file_buf_pool_init(
+    struct file_buf_pool_t* pool)
+{
+    memset(pool, 0, sizeof *pool);
+    pool->dir_fd = -1;
+}
+
+void file_buf_pool_done(
+    struct file_buf_pool_t* pool)
+{
+    if (pool->dir_fd >= 0 &&
+        close(pool->dir_fd) < 0)
+        FILE_BUF_POOL_ERROR(close);
+    free(pool->dir);
+    free(pool->buf);
+}
+
+// stev: open the file 'name' relative to the
+// directory kept open by the pool, when that
+// is the file's own directory; otherwise make
+// the file's directory the one kept open
+int file_buf_pool_open(
+    struct file_buf_pool_t* pool,
+    const char* name)
+{
+    const char* p = strrchr(name, '/');
+
+    // stev: no directory part, or the root
+    if (p == NULL || p == name)
+        return open(name, O_RDONLY);
+
+    size_t n = PTR_DIFF(p, name);
+    if (pool->dir_fd < 0 ||
+        pool->dir_len != n ||
+        memcmp(pool->dir, name, n)) {
+        if (pool->dir_fd >= 0 &&
+            close(pool->dir_fd) < 0)
+            FILE_BUF_POOL_ERROR(close);
+
+        if (pool->dir_size <= n) {
+            free(pool->dir);
+            pool->dir = malloc(n + 1);
+            VERIFY(pool->dir != NULL);
+            pool->dir_size = n + 1;
+        }
+        memcpy(pool->dir, name, n);
+        pool->dir[n] = 0;
+        pool->dir_len = n;
+
+        pool->dir_fd = open(pool->dir,
+            O_RDONLY | O_DIRECTORY);
+        if (pool->dir_fd < 0)
+            return open(name, O_RDONLY);
+    }
+
+    return openat(pool->dir_fd, p + 1, O_RDONLY);
+}
+
+// stev: class 'file_adapt_t' implements the
+// adaptive sizing of the reads of 'file_buf_t':
+// starting from the block size of the input,
+// the read size gets doubled for as long as
+// that increases by more than one sixteenth
+// the rate of bytes per second of the buffer
+// refills, measured over at least the last
+// 'FILE_ADAPT_ROUNDS' refills and at least
+// 'FILE_ADAPT_BYTES' bytes; when the read
+// calls return on average less than half of
+// the bytes asked for, as pipes do, the read
+// size is shrunk to what they do return; once
+// settled, the read size stays unchanged up
+// to the end of input
+
+#define FILE_ADAPT_MAX    MB(1)
+#define FILE_ADAPT_BYTES  MB(4)
+#define FILE_ADAPT_ROUNDS SZ(4)
+
+struct file_adapt_t
+{
+    // stev: the current read size
+    size_t size;
+    size_t min;
+    size_t max;
+    // stev: the read size of the best rate
+    size_t best;
+    // stev: the best rate: bytes per usec
+    size_t rate;
+    // stev: the measures of the current round
+    uint64_t time;
+    size_t want;
+    size_t bytes;
+    size_t reads;
+    size_t rounds;
+    // stev: the number of size changes
+    size_t count;
+    bool settled;
+};
+
+void file_adapt_init(
+    struct file_adapt_t* adapt,
+    size_t blk_size,
+    size_t max_size)
+{
+    memset(adapt, 0, sizeof *adapt);
+
+    adapt->max = max_size > 0
+        ? max_size / 2
+        : FILE_ADAPT_MAX;
+    if (adapt->max == 0)
+        adapt->max = 1;
+
+    adapt->min = blk_size > 0 &&
+        blk_size < adapt->max
+        ? blk_size : adapt->max;
+    adapt->size = adapt->min;
+}
+
+void file_adapt_disable(
+    struct file_adapt_t* adapt)
+{
+    memset(adapt, 0, sizeof *adapt);
+
+    adapt->size = SIZE_MAX;
+    adapt->settled = true;
+}
+
+#define file_adapt_enabled(a) ((a)->max > 0)
+
+void file_adapt_settle(
+    struct file_adapt_t* adapt,
+    size_t size)
+{
+    if (adapt->size != size)
+        adapt->count ++;
+    adapt->size = size;
+    adapt->settled = true;
+}
+
+void file_adapt_reset(
+    struct file_adapt_t* adapt)
+{
+    adapt->time = 0;
+    adapt->want = 0;
+    adapt->bytes = 0;
+    adapt->reads = 0;
+    adapt->rounds = 0;
+}
+
+// stev: a buffer refill asked for 'want' bytes,
+// got in 'bytes' bytes and took 'time' nsecs;
+// the number of read calls it took is already
+// accumulated in 'reads'
+void file_adapt_update(
+    struct file_adapt_t* adapt,
+    size_t want, size_t bytes,
+    uint64_t time)
+{
+    ASSERT(!adapt->settled);
+
+    TIME_ADD(adapt->time, time);
+    ASSERT_UINT_ADD_NO_OVERFLOW(
+        adapt->want, want);
+    adapt->want += want;
+    ASSERT_UINT_ADD_NO_OVERFLOW(
+        adapt->bytes, bytes);
+    adapt->bytes += bytes;
+
+    if (++ adapt->rounds < FILE_ADAPT_ROUNDS ||
+        adapt->bytes < FILE_ADAPT_BYTES)
+        return;
+
+    size_t w = adapt->want / adapt->rounds;
+    size_t b = adapt->bytes;
+    size_t r = adapt->reads;
+    uint64_t t = adapt->time;
+
+    file_adapt_reset(adapt);
+
+    size_t s = adapt->size;
+    if (r > 0 && b / r < w / 2) {
+        // stev: the input yields less per read
+        // call than asked for: round that up to
+        // a multiple of the minimum read size
+        size_t d = b / r + adapt->min - 1;
+        d -= d % adapt->min;
+        file_adapt_settle(adapt,
+            d > 0 && d < s ? d : s);
+        return;
+    }
+
+    ASSERT_UINT_MUL_NO_OVERFLOW(
+        b, SZ(1000));
+    size_t v = b * SZ(1000) / (t ? t : 1);
+
+    if (v > adapt->rate + adapt->rate / 16) {
+        adapt->rate = v;
+        adapt->best = s;
+
+        if (s < adapt->max) {
+            ASSERT_UINT_MUL_NO_OVERFLOW(
+                s, SZ(2));
+            s *= SZ(2);
+            adapt->size = s < adapt->max
+                ? s : adapt->max;
+            adapt->count ++;
+            return;
+        }
+    }
+
+    file_adapt_settle(adapt,
+        adapt->best ? adapt->best : s);
+}
+
+// stev: when 'max_size' is not 0 and 'mem' is
+// NULL, 'file_buf_t' works in streaming mode:
+// the text not yet consumed is moved to the
+// beginning of the buffer instead of growing
+// it; when the buffer reached 'max_size' and
+// still has no '\n' in it, if 'split' is set,
+// the text up to the last whitespace of the
+// buffer is returned as if it were a line, so
+// that only the trailing partial word has to
+// be carried over; thus the memory used stays
+// bounded by 'max_size' plus the length of the
+// longest word, regardless of the length of
+// the lines of input; when 'adapt' is set, the
+// buffer gets compacted likewise and the reads
+// are sized by a 'file_adapt_t' instance
+
+struct file_buf_t
+{
+    struct mem_buf_t* mem;
+    const char* name;
+    const char* ctxt;
+    size_t min_size;
+    size_t max_size;
+    int fd;
+    char* buf;
+    size_t size;
+    size_t off;
+    size_t len;
+    // stev: the number of bytes of input not
+    // yet read, when 'sized' is set
+    size_t rem;
+    // stev: the number of bytes read in
+    size_t pos;
+    struct file_buf_pool_t* pool;
+    struct file_drop_t drop;
+    struct file_adapt_t adapt;
+    bits_t committed: 1;
+    bits_t split: 1;
+    bits_t sized: 1;
+    bits_t eof: 1;
 #ifdef CONFIG_COLLECT_STATISTICS
     struct file_buf_stats_t stats;
 #endif
 };
 
-#define FILE_MAP_IO_ERROR(e) \
+#define FILE_BUF_IO_ERROR(e) \
     IO_ERROR_SYS(e, file->ctxt, file->name)
-#define FILE_MAP_IO_ERROR_FMT(e, m, ...)    \
-    IO_ERROR_FMT(e, file->ctxt, file->name, \
-        m, ## __VA_ARGS__)
 
-void file_map_init(
-    struct file_map_t* file,
-    struct mem_map_t* mem,
+void file_buf_init(
+    struct file_buf_t* file,
+    struct mem_buf_t* mem,
+    int fd,
     const char* name,
-    const char* ctxt)
+    const char* ctxt,
+    size_t min_size,
+    size_t max_size,
+    bool split,
+    struct file_buf_pool_t* pool,
+    bool adapt,
+    bool drop)
+{
+    memset(file, 0, sizeof *file);
+    file_drop_disable(&file->drop);
+    file_adapt_disable(&file->adapt);
+
+    file->mem = mem;
+    file->name = name;
+    file->ctxt = ctxt;
+    file->min_size = min_size
+        ? min_size
+        : KB(4);
+    file->max_size = mem == NULL
+        ? max_size : 0;
+    file->split = split;
+    // stev: the buffers committed to 'mem'
+    // cannot be passed on to other instances
+    file->pool = mem == NULL
+        ? pool : NULL;
+
+    if (file->pool != NULL &&
+        file->pool->buf != NULL) {
+        file->buf = file->pool->buf;
+        file->size = file->pool->size;
+        file->pool->buf = NULL;
+#ifdef CONFIG_COLLECT_STATISTICS
+        file->stats.pool_count ++;
+#endif
+    }
+    else {
+        file->size = file->min_size;
+        file->buf = malloc(file->size);
+        VERIFY(file->buf != NULL);
+    }
+
+    if (fd >= 0)
+        file->fd = fd;
+    else
+    if (name != NULL) {
+        file->fd = file->pool != NULL
+            ? file_buf_pool_open(file->pool, name)
+            : open(name, O_RDONLY);
+        if (file->fd < 0)
+            FILE_BUF_IO_ERROR(open);
+    }
+
+    struct stat s;
+    if (fstat(file->fd, &s) < 0)
+        FILE_BUF_IO_ERROR(stat);
+
+    // stev: the buffers committed to 'mem' are
+    // sized by the lines of input, not by reads
+    if (adapt && mem == NULL) {
+        file_adapt_init(&file->adapt,
+            INT_AS_SIZE(s.st_blksize),
+            file->max_size);
+#ifdef CONFIG_COLLECT_STATISTICS
+        file->stats.read_size_min =
+        file->stats.read_size_max =
+            file->adapt.size;
+#endif
+    }
+
+    if (!S_ISREG(s.st_mode))
+        return;
+
+    if (drop)
+        file_drop_init(&file->drop,
+            name, ctxt, file->fd, NULL);
+
+    // stev: knowing the size of the file, the
+    // read returning 0 at EOF can be spared;
+    // the files of which size is reported as
+    // 0 (e.g. those of '/proc') are read up
+    // to EOF though; as with 'file_map_t', the
+    // file is read up to the size it had when
+    // opened: the data appended to it later
+    // on (e.g. to a log being written to) is
+    // not read in
+    file->sized = s.st_size > 0;
+    file->rem = INT_AS_SIZE(s.st_size);
+
+    // stev: the files fitting in the buffer
+    // are read in by a single read anyway
+    if (file->rem <= file->size)
+        return;
+
+    if (posix_fadvise(
+            file->fd, 0, s.st_size,
+            POSIX_FADV_SEQUENTIAL))
+        FILE_BUF_IO_ERROR(fadvise);
+#ifdef CONFIG_COLLECT_STATISTICS
+    file->stats.fadvise_count ++;
+#endif
+}
+
+void file_buf_done(
+    struct file_buf_t* file)
+{
+    if (!file->committed &&
+         file->buf != NULL) {
+        ASSERT(file->size > 0);
+        if (file->pool != NULL &&
+            file->pool->buf == NULL) {
+            file->pool->buf = file->buf;
+            file->pool->size = file->size;
+        }
+        else
+            free(file->buf);
+    }
+    file_drop_done(
+        &file->drop, file->pos);
+    if (file->fd >= 0)
+        close(file->fd);
+}
+
+bool file_buf_read(
+    struct file_buf_t* file,
+    char* buf, size_t len,
+    size_t* result)
+{
+    size_t n = 0;
+
+    ASSERT(buf != NULL);
+    ASSERT(len > 0);
+
+    do {
+        ssize_t r = read(
+            file->fd, buf, len);
+        file->adapt.reads ++;
+#ifdef CONFIG_COLLECT_STATISTICS
+        file->stats.read_count ++;
+#endif
+        if (r < 0)
+            FILE_BUF_IO_ERROR(read);
+
+        if (r == 0) {
+            *result = n;
+            return true;
+        }
+
+        size_t l = INT_AS_SIZE(r);
+        ASSERT(l <= len);
+
+        // stev: the bytes read in are in the
+        // buffer: the page cache can let go
+        // of them
+        ASSERT_UINT_ADD_NO_OVERFLOW(
+            file->pos, l);
+        file->pos += l;
+        file_drop_behind(
+            &file->drop, file->pos);
+
+        if (file->sized) {
+            file->rem -= l < file->rem
+                ? l : file->rem;
+            if (file->rem == 0) {
+                ASSERT_UINT_ADD_NO_OVERFLOW(
+                    n, l);
+                *result = n + l;
+                return true;
+            }
+        }
+
+        buf += l;
+        len -= l;
+
+        ASSERT_UINT_ADD_NO_OVERFLOW(
+            n, l);
+        n += l;
+    } while (len);
+
+    *result = n;
+    return false;
+}
+
+#ifdef DEBUG_FILE_BUF_GET_LINE
+const char* repr0(
+    const char* p, size_t n, size_t k)
+{
+    static const uchar_t repr[256] = {
+        ['\0'] = '0', ['\a'] = 'a', ['\b'] = 'b',
+        ['\f'] = 'f', ['\n'] = 'n', ['\r'] = 'r',
+        ['\t'] = 't', ['\v'] = 'v', ['"']  = '"'
+    };
+
+    enum { N = 1024 };
+    static char buf[2][N];
+
+    STATIC(CHAR_BIT == 8);
+
+    VERIFY(k < 2);
+    char *q = buf[k], *e = q + (N - 1);
+
+    int s = snprintf(
+                q, PTR_DIFF(e, q),
+                "[%p]\"", p);
+    q += INT_AS_SIZE(s);
+
+    while (n -- && q < e) {
+        uchar_t c = *p ++;
+        uchar_t r = repr[c];
+        if (!r && !ISPRINT(c)) {
+            s = snprintf(
+                    q, PTR_DIFF(e, q),
+                    "\\%02x", c);
+            q += INT_AS_SIZE(s);
+        }
+        else
+        if (r) {
+            *q ++ = '\\';
+            if (q >= e) break;
+            *q ++ = r;
+        }
+        else
+            *q ++ = c;
+    }
+    if (q < e)
+        *q ++ = '"';
+    *q = 0;
+
+    return buf[k];
+}
+
+const char* repr(
+    const char* p, size_t n)
+{ return repr0(p, n, 1); }
+
+void file_buf_print_debug_head(
+    const struct file_buf_t* file, size_t id)
+{
+    fprintf(stderr, "!!! %s: #%zu: min=%zu size=%zu "
+        "committed=%d eof=%d off=%zu len=%zu buf=%s ",
+        file->ctxt, id, file->min_size, file->size,
+        file->committed, file->eof, file->off, file->len,
+        repr0(file->buf, file->off + file->len, 0));
+}
+
+void file_buf_print_debug(
+    const struct file_buf_t* file,
+    size_t id, const char* msg, ...)
+    PRINTF(3);
+
+void file_buf_print_debug(
+    const struct file_buf_t* file,
+    size_t id, const char* msg, ...)
+{
+    va_list args;
+
+    file_buf_print_debug_head(
+        file, id);
+
+    va_start(args, msg);
+    vfprintf(stderr, msg, args);
+    va_end(args);
+
+    fputc('\n', stderr);
+}
+
+#define FILE_BUF_PRINT_DEBUG_HEAD(i)          \
+    do {                                      \
+        file_buf_print_debug_head(file, i);   \
+    } while (0)
+#define FILE_BUF_PRINT_DEBUG_TAIL(m, ...)     \
+    do {                                      \
+        fprintf(stderr, m "\n", __VA_ARGS__); \
+    } while (0)
+#define FILE_BUF_PRINT_DEBUG(i, m, ...)       \
+    do {                                      \
+        file_buf_print_debug(file, i, m,      \
+            ## __VA_ARGS__);                  \
+    } while (0)
+#else  // DEBUG_FILE_BUF_GET_LINE
+#define FILE_BUF_PRINT_DEBUG_HEAD(i)          \
+    do {} while (0)
+#define FILE_BUF_PRINT_DEBUG_TAIL(m, ...)     \
+    do {} while (0)
+#define FILE_BUF_PRINT_DEBUG(i, m, ...)       \
+    do {} while (0)
+#endif // DEBUG_FILE_BUF_GET_LINE
+
+// stev: return the last whitespace of the text
+// [p, p + n) that has no '\n' in it, or NULL if
+// there's no such whitespace
+const char* file_buf_last_space(
+    const char* p, size_t n)
+{
+    const char* q = p + n;
+
+    while (q > p) {
+        switch (*-- q) {
+        case ' ': case '\t': case '\f':
+        case '\r': case '\v': case '\0':
+            return q;
+        }
+    }
+    return NULL;
+}
+
+bool file_buf_get_line(
+    struct file_buf_t* file,
+    char const** ptr,
+    size_t* len)
+{
+#ifdef CONFIG_COLLECT_STATISTICS
+    uint64_t c = time_now();
+#endif
+
+    while (true) {
+        ASSERT_UINT_ADD_NO_OVERFLOW(
+            file->off, file->len);
+        // stev: main invariants:
+        ASSERT(file->off + file->len <=
+            file->size);
+        ASSERT(file->buf != NULL);
+        ASSERT(file->size > 0);
+
+        char* p = file->buf + file->off;
+
+        FILE_BUF_PRINT_DEBUG(1, "iterating p=%s",
+            repr(p, file->len));
+
+        char* q = memchr(p, '\n', file->len);
+        if (q != NULL || file->eof) {
+            if (!file->committed &&
+                file->mem != NULL) {
+                mem_buf_append(
+                    file->mem,
+                    file->buf);
+                file->committed = true;
+
+                FILE_BUF_PRINT_DEBUG(1,
+                    "committed %p",
+                    file->buf);
+#ifdef CONFIG_COLLECT_STATISTICS
+                file->stats.commit_count ++;
+#endif
+            }
+
+            size_t d = q != NULL
+                ? PTR_DIFF(q, p)
+                : file->len;
+            *ptr = p;
+            *len = d;
+
+            if (q != NULL) {
+                ASSERT_UINT_INC_NO_OVERFLOW(d);
+                d ++;
+            }
+            file->off += d;
+            file->len -= d;
+
+            // stev: an empty line is a line too,
+            // even when EOF was already reached:
+            // only when there's no '\n' left, the
+            // remaining text has to be non-empty
+            FILE_BUF_PRINT_DEBUG(2,
+                "returning %d len=%zu ptr=%s",
+                q != NULL || *len, *len,
+                repr(*ptr, *len));
+
+#ifdef CONFIG_COLLECT_STATISTICS
+            TIME_ADD(
+                file->stats.getline_time,
+                time_elapsed(c));
+#endif
+            return q != NULL || *len;
+        }
+        // => q == NULL && !file->eof
+
+        // stev: fill in the buffer prior to
+        // growing it: a buffer passed on by
+        // a 'file_buf_pool_t' is empty, but
+        // may be larger than 'min_size'
+        if (!file->committed &&
+            file->off + file->len < file->size)
+            goto read;
+
+        if ((file->max_size > 0 ||
+             file_adapt_enabled(&file->adapt)) &&
+            file->off > 0) {
+            ASSERT(!file->committed);
+
+            // stev: streaming mode: make room
+            // for more text by moving the text
+            // not yet consumed to the beginning
+            // of the buffer
+            memmove(file->buf, p, file->len);
+            file->off = 0;
+#ifdef CONFIG_COLLECT_STATISTICS
+            ASSERT_UINT_ADD_NO_OVERFLOW(
+                file->stats.memcpy_bytes, file->len);
+            file->stats.memcpy_bytes += file->len;
+            file->stats.memcpy_count ++;
+#endif
+            FILE_BUF_PRINT_DEBUG(5, "moved p=%s",
+                repr(file->buf, file->len));
+
+            // stev: adaptive mode: the buffer
+            // has room for two reads, such that
+            // a read of full size is possible
+            // even after moving the text above
+            size_t s = file->adapt.size;
+            if (file_adapt_enabled(&file->adapt) &&
+                file->size / 2 < s) {
+                ASSERT_UINT_MUL_NO_OVERFLOW(
+                    s, SZ(2));
+                s *= SZ(2);
+#ifdef CONFIG_COLLECT_STATISTICS
+                uint64_t c2 = time_now();
+#endif
+                char* b = realloc(file->buf, s);
+#ifdef CONFIG_COLLECT_STATISTICS
+                TIME_ADD(
+                    file->stats.realloc_time,
+                    time_elapsed(c2));
+                file->stats.realloc_count ++;
+#endif
+                VERIFY(b != NULL);
+
+                file->size = s;
+                file->buf = b;
+            }
+
+            goto read;
+        }
+
+        const char* r;
+        if (file->max_size > 0 &&
+            file->size >= file->max_size &&
+            file->split &&
+            (r = file_buf_last_space(
+                    p, file->len)) != NULL) {
+            // stev: streaming mode: the buffer
+            // is full; return the text up to its
+            // last whitespace as if it were a line
+            size_t d = PTR_DIFF(r, p);
+            *ptr = p;
+            *len = d;
+
+            d ++;
+            file->off += d;
+            file->len -= d;
+
+            FILE_BUF_PRINT_DEBUG(6,
+                "returning split len=%zu ptr=%s",
+                *len, repr(*ptr, *len));
+
+#ifdef CONFIG_COLLECT_STATISTICS
+            file->stats.split_count ++;
+            TIME_ADD(
+                file->stats.getline_time,
+                time_elapsed(c));
+#endif
+            return true;
+        }
+
+        size_t s = file->size;
+#ifdef CONFIG_USE_IO_BUF_LINEAR_GROWTH
+        ASSERT_UINT_ADD_NO_OVERFLOW(
+            s, file->min_size);
+        s += file->min_size;
+#else
+        ASSERT_UINT_MUL_NO_OVERFLOW(
+            s, SZ(2));
+        s *= SZ(2);
+#endif
+        // stev: in streaming mode, the buffer
+        // grows beyond 'max_size' only when it
+        // is filled up by one single word
+        if (file->size < file->max_size &&
+            s > file->max_size)
+            s = file->max_size;
+
+        FILE_BUF_PRINT_DEBUG_HEAD(3);
+
+#ifdef CONFIG_COLLECT_STATISTICS
+        uint64_t c2 = time_now();
+#endif
+        char* b = realloc(
+            !file->committed ? file->buf : NULL, s);
+#ifdef CONFIG_COLLECT_STATISTICS
+        TIME_ADD(
+            file->stats.realloc_time,
+            time_elapsed(c2));
+        file->stats.realloc_count ++;
+#endif
+        VERIFY(b != NULL);
+
+        FILE_BUF_PRINT_DEBUG_TAIL(
+            "realloced (size=%zu) from %p to %p",
+            s, !file->committed ? file->buf : NULL, b);
+
+        if (file->committed) {
+            memcpy(b, p, file->len);
+            file->off = 0;
+#ifdef CONFIG_COLLECT_STATISTICS
+            ASSERT_UINT_ADD_NO_OVERFLOW(
+                file->stats.memcpy_bytes, file->len);
+            file->stats.memcpy_bytes += file->len;
+            file->stats.memcpy_count ++;
+#endif
+        }
+        file->committed = false;
+        file->size = s;
+        file->buf = b;
+
+    read:;
+        size_t n = 0;
+        ASSERT_UINT_ADD_NO_OVERFLOW(
+            file->off, file->len);
+        size_t w = file->off + file->len;
+        ASSERT_UINT_SUB_NO_OVERFLOW(
+            file->size, w);
+        size_t m = file->size - w;
+        if (m > file->adapt.size)
+            m = file->adapt.size;
+
+        uint64_t c3 = !file->adapt.settled
+            ? time_now() : 0;
+        file->eof = file_buf_read(
+            file, file->buf + w, m, &n);
+        ASSERT(n <= m);
+
+        if (!file->adapt.settled) {
+            file_adapt_update(&file->adapt,
+                m, n, time_elapsed(c3));
+#ifdef CONFIG_COLLECT_STATISTICS
+            file->stats.read_size_min =
+            file->stats.read_size_max =
+                file->adapt.size;
+            file->stats.adapt_count =
+                file->adapt.count;
+#endif
+        }
+
+        FILE_BUF_PRINT_DEBUG(4, "read n=%zu %s",
+            n, repr(file->buf + w, n));
+
+        // stev: from the assert above:
+        //     n <= m <= size - w
+        // <=> n <= size - (off + len)
+        // <=> off + (len + n) <= size
+
+        // stev: therefore, after updating
+        // 'len += n' below, the invariant
+        // 'off + len <= size' is maintained
+        ASSERT_UINT_ADD_NO_OVERFLOW(
+            file->len, n);
+        file->len += n;
+    }
+}
+
+#ifdef CONFIG_COLLECT_STATISTICS
+
+void file_buf_stats_init(
+    struct file_buf_stats_t* stats,
+    const struct file_buf_t* file)
+{
+    if (file != NULL)
+        memcpy(stats, &file->stats, sizeof *stats);
+    else
+        memset(stats, 0, sizeof *stats);
+}
+
+const struct stat_params_t*
+    file_buf_stat_params(void)
+{
+#undef  CASE
+#define CASE(n, t) \
+    STAT_PARAM_DEF(file_buf_stats_t, n, t)
+    static const struct stat_param_t params[] = {
+        CASE(read_count,    size),
+        CASE(commit_count,  size),
+        CASE(realloc_time,  time),
+        CASE(realloc_count, size),
+        CASE(memcpy_bytes,  size),
+        CASE(memcpy_count,  size),
+        CASE(split_count,   size),
+        CASE(pool_count,    size),
+        CASE(fadvise_count, size),
+        CASE(adapt_count,   size),
+        CASE(read_size_min, min),
+        CASE(read_size_max, max),
+        CASE(getline_time,  time),
+    };
+    static const struct stat_params_t stat = {
+        .n_params = ARRAY_SIZE(params),
+        .params = params,
+        .name = "buf"
+    };
+    return &stat;
+}
+
+void file_buf_stats_add(
+    struct file_buf_stats_t* stats,
+    const struct file_buf_stats_t* stats2)
+{
+    stat_params_add(
+        file_buf_stat_params(),
+        stats, stats2);
+}
+
+void file_buf_stats_print_names(
+    const char* name,
+    FILE* file)
+{
+    stat_params_print_names(
+        file_buf_stat_params(),
+        name, file);
+}
+
+void file_buf_stats_print(
+    const struct file_buf_stats_t* stats,
+    const char* name, FILE* file)
+{
+    stat_params_print(
+        file_buf_stat_params(),
+        stats, name, file);
+}
+
+struct file_map_stats_t
+{
+    uint64_t getline_time;
+};
+
+#endif // CONFIG_COLLECT_STATISTICS
+
+struct file_map_t
+{
+    struct mem_map_t* mem;
+    struct mem_map_node_t* node;
+    const char* name;
+    const char* ctxt;
+    char* ptr;
+    size_t size;
+    size_t line;
+    struct file_drop_t drop;
+#ifdef CONFIG_COLLECT_STATISTICS
+    struct file_map_stats_t stats;
+#endif
+};
+
+#define FILE_MAP_IO_ERROR(e) \
+    IO_ERROR_SYS(e, file->ctxt, file->name)
+#define FILE_MAP_IO_ERROR_FMT(e, m, ...)    \
+    IO_ERROR_FMT(e, file->ctxt, file->name, \
+        m, ## __VA_ARGS__)
+
+void file_map_init(
+    struct file_map_t* file,
+    struct mem_map_t* mem,
+    int fd,
+    const char* name,
+    const char* ctxt,
+    bool drop)
+{
+    memset(file, 0, sizeof *file);
+    file_drop_disable(&file->drop);
+
+    file->mem  = mem;
+    file->name = name;
+    file->ctxt = ctxt;
+
+    if (fd < 0 && name == NULL)
+        fd = 0;
+    else
+    if (fd < 0) {
+        fd = open(name, O_RDONLY);
+        if (fd < 0)
+            FILE_MAP_IO_ERROR(open);
+    }
+
+    struct stat fs;
+    if (fstat(fd, &fs) < 0)
+        FILE_MAP_IO_ERROR(stat);
+
+    if (!S_ISREG(fs.st_mode))
+        FILE_MAP_IO_ERROR_FMT(stat,
+            "not a regular file");
+
+    // stev: 'mmap' rejects empty mappings
+    off_t size = fs.st_size;
+    if (size == 0) {
+        if (close(fd) < 0)
+            FILE_MAP_IO_ERROR(close);
+        return;
+    }
+
+    char* ptr = mmap(NULL, size,
+        PROT_READ, MAP_PRIVATE,
+        fd, 0);
+    ASSERT(ptr != NULL);
+
+    if (ptr == MAP_FAILED)
+        FILE_MAP_IO_ERROR(mmap);
+
+    // stev: drop-behind needs the file open
+    if (drop)
+        file_drop_init(&file->drop,
+            name, ctxt, fd, ptr);
+    else
+    if (close(fd) < 0)
+        FILE_MAP_IO_ERROR(close);
+
+    file->ptr  = ptr;
+    file->size = INT_AS_SIZE(size);
+    file->node = mem_map_append(
+        file->mem, file->ptr, file->size);
+    ASSERT(file->node != NULL);
+
+    mem_map_node_set_type(
+        file->node, mem_map_type_sequential);
+}
+
+void file_map_done(
+    struct file_map_t* file)
+{
+    if (file->node == NULL)
+        return;
+
+    if (file->drop.fd >= 0) {
+        file_drop_done(
+            &file->drop, file->size);
+        if (close(file->drop.fd) < 0)
+            FILE_MAP_IO_ERROR(close);
+    }
+
+    mem_map_node_set_type(
+        file->node, mem_map_type_random);
+}
+
+bool file_map_get_line(
+    struct file_map_t* file,
+    char const** ptr,
+    size_t* len)
+{
+#ifdef CONFIG_COLLECT_STATISTICS
+    uint64_t c = time_now();
+#endif
+
+    size_t sz = file->size;
+    size_t ln = file->line;
+
+    // stev: the lines before 'ln' were consumed
+    file_drop_behind(&file->drop, ln);
+
+    // stev: main invariant:
+    ASSERT(ln <= sz);
+    size_t n = sz - ln;
+
+    if (n == 0) {
+#ifdef CONFIG_COLLECT_STATISTICS
+        TIME_ADD(
+            file->stats.getline_time,
+            time_elapsed(c));
+#endif
+        return false;
+    }
+    // => n > 0
+
+    char* b = file->ptr + ln;
+    char* p = memchr(b, '\n', n);
+    // => p == NULL || b <= p < b + n
+
+    size_t d = p != NULL
+        ? PTR_DIFF(p + 1, b)
+        : n;
+    // stev: 0 < d <= n:
+    // (a) p != NULL => b <= p < b + n
+    //              <=> 0 <= p - b < n
+    //              <=> 1 <= d = p + 1 - b < n + 1
+    //              <=> 0 < d <= n
+    // (b) p == NULL => d = n > 0
+    // => in all cases: 0 < d <= n
+    ASSERT(d <= n);
+    ASSERT(d > 0);
+
+    *ptr = b;
+    *len = d - (p != NULL);
+
+    // stev: main invariant is preserved:
+    // d <= n <=> ln + d <= ln + n
+    //                   == ln + sz - ln
+    //                   == sz
+    //        <=> ln + d <= sz
+    file->line += d;
+
+#ifdef CONFIG_COLLECT_STATISTICS
+    TIME_ADD(
+        file->stats.getline_time,
+        time_elapsed(c));
+#endif
+    return true;
+}
+
+#ifdef CONFIG_COLLECT_STATISTICS
+
+void file_map_stats_init(
+    struct file_map_stats_t* stats,
+    const struct file_map_t* map)
+{
+    memcpy(stats, &map->stats, sizeof *stats);
+}
+
+const struct stat_params_t*
+    file_map_stat_params(void)
+{
+#undef  CASE
+#define CASE(n, t) \
+    STAT_PARAM_DEF(file_map_stats_t, n, t)
+    static const struct stat_param_t params[] = {
+        CASE(getline_time, time),
+    };
+    static const struct stat_params_t stat = {
+        .n_params = ARRAY_SIZE(params),
+        .params = params,
+        .name = "map"
+    };
+    return &stat;
+}
+
+void file_map_stats_add(
+    struct file_map_stats_t* stats,
+    const struct file_map_stats_t* stats2)
+{
+    stat_params_add(
+        file_map_stat_params(),
+        stats, stats2);
+}
+
+void file_map_stats_print_names(
+    const char* name,
+    FILE* file)
+{
+    stat_params_print_names(
+        file_map_stat_params(),
+        name, file);
+}
+
+void file_map_stats_print(
+    const struct file_map_stats_t* stats,
+    const char* name, FILE* file)
+{
+    stat_params_print(
+        file_map_stat_params(),
+        stats, name, file);
+}
+
+#endif // CONFIG_COLLECT_STATISTICS
+
+// stev: class 'file_blk_t' assembles lines of text
+// out of a sequence of blocks of text: the lines
+// that are entirely contained in a block of text
+// are returned in place; only the lines crossing
+// block boundaries are copied into the internal
+// carry buffer, which grows as needed; when lines
+// may be split, a block having no '\n' in it is
+// returned up to its last whitespace, such that
+// the carry buffer holds at most a partial word
+// plus one block of text, instead of a whole line
+
+struct file_blk_t
+{
+    char* buf;
+    size_t size;
+    size_t len;
+    const char* ptr;
+    size_t rem;
+    bits_t carried: 1;
+    bits_t split: 1;
+#ifdef CONFIG_COLLECT_STATISTICS
+    size_t memcpy_bytes;
+    size_t memcpy_count;
+#endif
+};
+
+void file_blk_init(
+    struct file_blk_t* blk,
+    bool split)
+{
+    memset(blk, 0, sizeof *blk);
+    blk->split = split;
+}
+
+void file_blk_done(
+    struct file_blk_t* blk)
+{
+    free(blk->buf);
+}
+
+void file_blk_set(
+    struct file_blk_t* blk,
+    const char* ptr, size_t len)
+{
+    ASSERT(blk->rem == 0);
+
+    blk->ptr = ptr;
+    blk->rem = len;
+}
+
+void file_blk_append(
+    struct file_blk_t* blk,
+    const char* ptr, size_t len)
+{
+    size_t n = UINT_ADD(blk->len, len);
+
+    if (n > blk->size) {
+        size_t s = blk->size
+            ? blk->size : KB(4);
+        while (s < n)
+            UINT_MUL_EQ(s, SZ(2));
+
+        char* b = realloc(blk->buf, s);
+        VERIFY(b != NULL);
+
+        blk->buf = b;
+        blk->size = s;
+    }
+
+    memcpy(blk->buf + blk->len, ptr, len);
+    blk->len = n;
+
+#ifdef CONFIG_COLLECT_STATISTICS
+    ASSERT_UINT_ADD_NO_OVERFLOW(
+        blk->memcpy_bytes, len);
+    blk->memcpy_bytes += len;
+    blk->memcpy_count ++;
+#endif
+}
+
+// stev: return the next line (or, in streaming
+// mode, the next run of whole words) from the
+// current block, if there is one; otherwise,
+// move the remaining partial line into the
+// carry buffer and return false: the caller
+// has to provide the next block to function
+// 'file_blk_set' and retry
+bool file_blk_get_line(
+    struct file_blk_t* blk,
+    char const** ptr,
+    size_t* len)
+{
+    if (blk->carried) {
+        blk->carried = false;
+        blk->len = 0;
+    }
+
+    if (blk->rem == 0)
+        return false;
+
+    const char* q = memchr(
+        blk->ptr, '\n', blk->rem);
+    // stev: streaming mode: the block has no
+    // '\n' in it; return the text up to its
+    // last whitespace as if it were a line
+    if (q == NULL && blk->split)
+        q = file_buf_last_space(
+            blk->ptr, blk->rem);
+    if (q == NULL) {
+        file_blk_append(
+            blk, blk->ptr, blk->rem);
+        blk->rem = 0;
+        return false;
+    }
+
+    size_t d = PTR_DIFF(q, blk->ptr);
+    if (blk->len > 0) {
+        file_blk_append(
+            blk, blk->ptr, d);
+        *ptr = blk->buf;
+        *len = blk->len;
+        blk->carried = true;
+    }
+    else {
+        *ptr = blk->ptr;
+        *len = d;
+    }
+
+    ASSERT(d < blk->rem);
+    blk->ptr += d + 1;
+    blk->rem -= d + 1;
+
+    return true;
+}
+
+// stev: at EOF, return the unterminated
+// last line of text, if there is such one
+bool file_blk_get_last(
+    struct file_blk_t* blk,
+    char const** ptr,
+    size_t* len)
+{
+    ASSERT(blk->rem == 0);
+
+    if (blk->carried) {
+        blk->carried = false;
+        blk->len = 0;
+    }
+
+    if (blk->len == 0)
+        return false;
+
+    *ptr = blk->buf;
+    *len = blk->len;
+    blk->carried = true;
+
+    return true;
+}
+
+// stev: class 'uring_t' is a minimal wrapper
+// around the Linux's io_uring interface (the
+// raw system calls are used, therefore there's
+// no dependency on 'liburing'); it's used only
+// by a single thread: no SQ polling is needed
+
+struct uring_t
+{
+    int fd;
+    unsigned entries;
+    unsigned sqe_tail;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void*  sq_ptr;
+    size_t sq_size;
+    void*  cq_ptr;
+    size_t cq_size;
+    size_t sqes_size;
+};
+
+#define URING_ERROR(e) \
+    syslib_error_sys("io-uring", #e, errno)
+
+#define URING_PTR(p, o) \
+    ((void*) ((char*) (p) + (o)))
+
+int uring_sys_setup(
+    unsigned entries,
+    struct io_uring_params* params)
+{
+    return (int) syscall(
+        __NR_io_uring_setup,
+        entries, params);
+}
+
+int uring_sys_enter(
+    int fd, unsigned to_submit,
+    unsigned min_complete,
+    unsigned flags)
+{
+    return (int) syscall(
+        __NR_io_uring_enter,
+        fd, to_submit, min_complete,
+        flags, NULL, 0);
+}
+
+int uring_sys_register(
+    int fd, unsigned op,
+    const void* arg,
+    unsigned n_args)
+{
+    return (int) syscall(
+        __NR_io_uring_register,
+        fd, op, arg, n_args);
+}
+
+void* uring_mmap(
+    int fd, size_t size, off_t off)
+{
+    void* p = mmap(NULL, size,
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE,
+        fd, off);
+    if (p == MAP_FAILED)
+        URING_ERROR(mmap);
+    return p;
+}
+
+// stev: return false, with 'errno' set, when
+// the kernel has no io_uring, or else when its
+// use is disallowed (by seccomp filters, or by
+// the sysctl 'kernel.io_uring_disabled')
+bool uring_init(
+    struct uring_t* ring,
+    unsigned entries)
+{
+    struct io_uring_params p;
+
+    memset(ring, 0, sizeof *ring);
+    memset(&p, 0, sizeof p);
+
+    ring->fd = uring_sys_setup(entries, &p);
+    if (ring->fd < 0)
+        return false;
+
+    ring->sq_size = p.sq_off.array +
+        p.sq_entries * sizeof(unsigned);
+    ring->cq_size = p.cq_off.cqes +
+        p.cq_entries * sizeof(struct io_uring_cqe);
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->sq_size < ring->cq_size)
+            ring->sq_size = ring->cq_size;
+        ring->cq_size = 0;
+    }
+
+    ring->sq_ptr = uring_mmap(ring->fd,
+        ring->sq_size, IORING_OFF_SQ_RING);
+    ring->cq_ptr = ring->cq_size
+        ? uring_mmap(ring->fd,
+            ring->cq_size, IORING_OFF_CQ_RING)
+        : ring->sq_ptr;
+
+    ring->sqes_size = p.sq_entries *
+        sizeof(struct io_uring_sqe);
+    ring->sqes = uring_mmap(ring->fd,
+        ring->sqes_size, IORING_OFF_SQES);
+
+    ring->sq_head  = URING_PTR(ring->sq_ptr, p.sq_off.head);
+    ring->sq_tail  = URING_PTR(ring->sq_ptr, p.sq_off.tail);
+    ring->sq_mask  = URING_PTR(ring->sq_ptr, p.sq_off.ring_mask);
+    ring->sq_array = URING_PTR(ring->sq_ptr, p.sq_off.array);
+    ring->cq_head  = URING_PTR(ring->cq_ptr, p.cq_off.head);
+    ring->cq_tail  = URING_PTR(ring->cq_ptr, p.cq_off.tail);
+    ring->cq_mask  = URING_PTR(ring->cq_ptr, p.cq_off.ring_mask);
+    ring->cqes     = URING_PTR(ring->cq_ptr, p.cq_off.cqes);
+
+    ring->entries  = p.sq_entries;
+    ring->sqe_tail = *ring->sq_tail;
+
+    return true;
+}
+
+void uring_done(
+    struct uring_t* ring)
+{
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_size)
+        munmap(ring->cq_ptr, ring->cq_size);
+    munmap(ring->sq_ptr, ring->sq_size);
+    close(ring->fd);
+}
+
+// stev: return false when the kernel refuses
+// the registration (e.g. due to RLIMIT_MEMLOCK)
+bool uring_register_buffers(
+    struct uring_t* ring,
+    const struct iovec* vecs,
+    unsigned n_vecs)
+{
+    return uring_sys_register(ring->fd,
+        IORING_REGISTER_BUFFERS,
+        vecs, n_vecs) == 0;
+}
+
+struct io_uring_sqe* uring_get_sqe(
+    struct uring_t* ring)
+{
+    unsigned h = __atomic_load_n(
+        ring->sq_head, __ATOMIC_ACQUIRE);
+    unsigned t = ring->sqe_tail;
+
+    VERIFY(t - h < ring->entries);
+
+    unsigned i = t & *ring->sq_mask;
+    struct io_uring_sqe* e =
+        ring->sqes + i;
+
+    memset(e, 0, sizeof *e);
+    ring->sq_array[i] = i;
+    ring->sqe_tail ++;
+
+    return e;
+}
+
+// stev: submit all the prepared SQEs; when 'wait'
+// is true, block until at least one CQE arrives
+void uring_submit(
+    struct uring_t* ring,
+    bool wait)
+{
+    unsigned n =
+        ring->sqe_tail - *ring->sq_tail;
+
+    if (n == 0 && !wait)
+        return;
+
+    __atomic_store_n(
+        ring->sq_tail, ring->sqe_tail,
+        __ATOMIC_RELEASE);
+
+    while (true) {
+        int r = uring_sys_enter(
+            ring->fd, n, wait,
+            wait ? IORING_ENTER_GETEVENTS : 0);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0)
+            URING_ERROR(enter);
+
+        size_t k = INT_AS_SIZE(r);
+        ASSERT(k <= n);
+        n -= k;
+
+        if (n == 0)
+            break;
+    }
+}
+
+struct io_uring_cqe* uring_peek_cqe(
+    struct uring_t* ring)
+{
+    unsigned h = *ring->cq_head;
+    unsigned t = __atomic_load_n(
+        ring->cq_tail, __ATOMIC_ACQUIRE);
+
+    return h != t
+        ? ring->cqes + (h & *ring->cq_mask)
+        : NULL;
+}
+
+void uring_cqe_seen(
+    struct uring_t* ring)
+{
+    __atomic_store_n(
+        ring->cq_head, *ring->cq_head + 1,
+        __ATOMIC_RELEASE);
+}
+
+#ifdef CONFIG_COLLECT_STATISTICS
+struct file_uring_stats_t
+{
+    size_t   read_count;
+    size_t   short_count;
+    size_t   submit_count;
+    size_t   fixed_count;
+    uint64_t wait_time;
+    size_t   memcpy_bytes;
+    size_t   memcpy_count;
+    uint64_t getline_time;
+};
+#endif
+
+// stev: class 'file_uring_t' incarnates the
+// 'file_io_t' interface by keeping several
+// reads in flight, into a ring of buffers of
+// equal sizes, registered (when the kernel
+// allows it) to the io_uring instance; for
+// regular files, all the free buffers are
+// kept in flight; for pipes and the like,
+// only one read is in flight at a time, for
+// data to arrive in order
+
+// stev: when 'direct' is set, regular files
+// are read with O_DIRECT, bypassing the page
+// cache: the buffers, the sizes of the reads
+// and their offsets are all aligned to the
+// block size of the file; the tail of a file
+// of which size is not aligned is read by an
+// aligned read returning short; the file
+// systems rejecting O_DIRECT -- at 'fcntl'
+// time or at the time of the first read --
+// make the file be read through the page
+// cache from there on; when io_uring is not to
+// be had, the O_DIRECT reads are done by 'pread'
+// instead, one block at a time
+
+#define FILE_URING_DEPTH 4
+
+struct file_uring_slot_t
+{
+    char*  buf;
+    size_t len;
+    off_t  off;
+    int    res;
+    bits_t done: 1;
+    bits_t direct: 1;
+};
+
+struct file_uring_t
+{
+    const char* name;
+    const char* ctxt;
+    int fd;
+    off_t size;
+    off_t off;
+    size_t blk_size;
+    size_t align;
+    size_t head;
+    size_t count;
+    size_t pending;
+    bits_t regular: 1;
+    bits_t fixed: 1;
+    bits_t held: 1;
+    bits_t eof: 1;
+    bits_t direct: 1;
+    bits_t fallback: 1;
+    bits_t sync: 1;
+    char* mem;
+    struct uring_t ring;
+    struct file_blk_t blk;
+    struct file_uring_slot_t
+        slots[FILE_URING_DEPTH];
+#ifdef CONFIG_COLLECT_STATISTICS
+    struct file_uring_stats_t stats;
+#endif
+};
+
+#define FILE_URING_IO_ERROR(e) \
+    IO_ERROR_SYS(e, file->ctxt, file->name)
+#define FILE_URING_IO_ERROR_RES(e, r) \
+    io_error_sys(io_error_type_ ## e, \
+        file->ctxt, file->name, -(r))
+
+// stev: return false when the file system
+// does not support O_DIRECT for the file
+bool file_uring_set_direct(
+    struct file_uring_t* file,
+    bool direct)
+{
+    int f = fcntl(file->fd, F_GETFL);
+    if (f < 0)
+        FILE_URING_IO_ERROR(fcntl);
+
+    f = direct
+        ? f | O_DIRECT
+        : f & ~O_DIRECT;
+    if (fcntl(file->fd, F_SETFL, f) < 0) {
+        if (direct && errno == EINVAL)
+            return false;
+        FILE_URING_IO_ERROR(fcntl);
+    }
+
+    file->direct = direct;
+    return true;
+}
+
+void file_uring_fallback(
+    struct file_uring_t* file)
+{
+    if (file->direct)
+        file_uring_set_direct(file, false);
+    file->fallback = true;
+}
+
+void file_uring_open(
+    struct file_uring_t* file,
+    int fd,
+    const char* name,
+    const char* ctxt,
+    size_t blk_size,
+    bool split,
+    bool direct)
+{
+    struct iovec v[FILE_URING_DEPTH];
+    size_t i;
+
+    STATIC(FILE_URING_DEPTH >= 2);
+
+    memset(file, 0, sizeof *file);
+
+    file->name = name;
+    file->ctxt = ctxt;
+    file->blk_size = blk_size
+        ? blk_size
+        : KB(4);
+
+    if (fd >= 0)
+        file->fd = fd;
+    else
+    if (name != NULL) {
+        file->fd = open(name, O_RDONLY);
+        if (file->fd < 0)
+            FILE_URING_IO_ERROR(open);
+    }
+
+    struct stat s;
+    if (fstat(file->fd, &s) < 0)
+        FILE_URING_IO_ERROR(stat);
+
+    file->regular = S_ISREG(s.st_mode);
+    file->size = s.st_size;
+
+    // stev: O_DIRECT applies to regular files
+    // only; the alignment required by it is
+    // the file's block size, or else a page
+    if (direct && file->regular) {
+        size_t a = INT_AS_SIZE(s.st_blksize);
+        size_t p = INT_AS_SIZE(
+            sysconf(_SC_PAGESIZE));
+        if (a < p || a % p)
+            a = p;
+
+        if (file_uring_set_direct(file, true)) {
+            file->align = a;
+            file->blk_size = UINT_ADD(
+                file->blk_size, a - 1);
+            file->blk_size -= file->blk_size % a;
+        }
+        else
+            file->fallback = true;
+    }
+
+    if (file->regular && !file->direct &&
+        posix_fadvise(
+            file->fd, 0, s.st_size,
+            POSIX_FADV_SEQUENTIAL))
+        FILE_URING_IO_ERROR(fadvise);
+
+    size_t n = UINT_MUL(
+        file->blk_size, ARRAY_SIZE(file->slots));
+    if (file->direct) {
+        int r = posix_memalign(
+            (void**) &file->mem,
+            file->align, n);
+        VERIFY(r == 0);
+    }
+    else
+        file->mem = malloc(n);
+    VERIFY(file->mem != NULL);
+
+    for (i = 0; i < FILE_URING_DEPTH; i ++) {
+        file->slots[i].buf = file->mem +
+            i * file->blk_size;
+        v[i].iov_base = file->slots[i].buf;
+        v[i].iov_len = file->blk_size;
+    }
+
+    if (uring_init(&file->ring, FILE_URING_DEPTH))
+        file->fixed = uring_register_buffers(
+            &file->ring, v, FILE_URING_DEPTH);
+    else
+    if (direct)
+        file->sync = true;
+    else
+        URING_ERROR(setup);
+
+    file_blk_init(&file->blk, split);
+}
+
+void file_uring_init(
+    struct file_uring_t* file,
+    int fd,
+    const char* name,
+    const char* ctxt,
+    size_t blk_size,
+    bool split)
+{
+    file_uring_open(
+        file, fd, name, ctxt,
+        blk_size, split, false);
+}
+
+void file_uring_reap(
+    struct file_uring_t* file)
+{
+    struct io_uring_cqe* e;
+
+    if (file->sync)
+        return;
+
+    while ((e = uring_peek_cqe(&file->ring))) {
+        VERIFY(e->user_data < FILE_URING_DEPTH);
+
+        struct file_uring_slot_t* s =
+            file->slots + e->user_data;
+        s->res = e->res;
+        s->done = true;
+
+        uring_cqe_seen(&file->ring);
+
+        ASSERT_UINT_DEC_NO_OVERFLOW(
+            file->pending);
+        file->pending --;
+    }
+}
+
+void file_uring_done(
+    struct file_uring_t* file)
+{
+    // stev: the kernel must not write into
+    // the buffers after they were released
+    while (file->pending > 0) {
+        uring_submit(&file->ring, true);
+        file_uring_reap(file);
+    }
+
+    if (!file->sync)
+        uring_done(&file->ring);
+    file_blk_done(&file->blk);
+    free(file->mem);
+
+    if (file->fd >= 0)
+        close(file->fd);
+}
+
+// stev: without io_uring, read in the block of
+// 'slot' right away; return the result as the
+// one of a completion: a negated 'errno' when
+// the read failed
+int file_uring_read_sync(
+    struct file_uring_t* file,
+    struct file_uring_slot_t* slot,
+    size_t len)
+{
+    ssize_t r;
+
+    do {
+        r = file->regular
+            ? pread(file->fd, slot->buf,
+                len, slot->off)
+            : read(file->fd, slot->buf,
+                len);
+    } while (r < 0 && errno == EINTR);
+
+    return r < 0 ? -errno
+        : UINT_AS_INT(INT_AS_SIZE(r));
+}
+
+void file_uring_submit(
+    struct file_uring_t* file)
+{
+    // stev: the synchronous reads are done
+    // one at a time, as they are needed
+    while (!file->eof &&
+        file->count + file->held < FILE_URING_DEPTH &&
+        ((file->regular && !file->sync) ||
+         file->count == 0)) {
+        size_t n = file->blk_size;
+        size_t m = n;
+
+        if (file->regular) {
+            ASSERT(file->off <= file->size);
+            size_t r = INT_AS_SIZE(
+                file->size - file->off);
+            if (r == 0) {
+                file->eof = true;
+                break;
+            }
+            if (n > r)
+                n = m = r;
+
+            // stev: the unaligned tail of the
+            // file is asked for by an aligned
+            // read, which is returning short
+            if (file->direct && m % file->align) {
+                m += file->align - m % file->align;
+                ASSERT(m <= file->blk_size);
+            }
+        }
+
+        size_t i = (file->head + file->count) %
+            FILE_URING_DEPTH;
+        struct file_uring_slot_t* s =
+            file->slots + i;
+
+        if (file->sync) {
+            s->len = n;
+            s->off = file->off;
+            s->direct = file->direct;
+            s->res = file_uring_read_sync(
+                file, s, m);
+            s->done = true;
+
+            if (file->regular)
+                file->off += n;
+
+            file->count ++;
+#ifdef CONFIG_COLLECT_STATISTICS
+            file->stats.read_count ++;
+#endif
+            continue;
+        }
+
+        struct io_uring_sqe* e =
+            uring_get_sqe(&file->ring);
+        e->opcode = file->fixed
+            ? IORING_OP_READ_FIXED
+            : IORING_OP_READ;
+        e->fd = file->fd;
+        e->addr = (uintptr_t) s->buf;
+        e->len = m;
+        e->off = file->regular
+            ? INT_AS_UINT(file->off, uint64_t)
+            : (uint64_t) -1;
+        e->buf_index = file->fixed ? i : 0;
+        e->user_data = i;
+
+        s->len = n;
+        s->off = file->off;
+        s->done = false;
+        s->direct = file->direct;
+
+        if (file->regular)
+            file->off += n;
+
+        file->count ++;
+        file->pending ++;
+#ifdef CONFIG_COLLECT_STATISTICS
+        file->stats.read_count ++;
+        if (file->fixed)
+            file->stats.fixed_count ++;
+#endif
+    }
+
+    if (file->sync)
+        return;
+
+#ifdef CONFIG_COLLECT_STATISTICS
+    if (file->ring.sqe_tail !=
+        *file->ring.sq_tail)
+        file->stats.submit_count ++;
+#endif
+    uring_submit(&file->ring, false);
+}
+
+// stev: complete a short read of a regular file
+// with synchronous 'pread's; the ring of buffers
+// relies on each block being read in entirety
+size_t file_uring_complete(
+    struct file_uring_t* file,
+    struct file_uring_slot_t* slot,
+    size_t n)
+{
+    while (n < slot->len) {
+#ifdef CONFIG_COLLECT_STATISTICS
+        file->stats.short_count ++;
+#endif
+        ssize_t r = pread(file->fd,
+            slot->buf + n, slot->len - n,
+            slot->off + UINT_AS_OFFT(n));
+        if (r < 0)
+            FILE_URING_IO_ERROR(read);
+        if (r == 0)
+            break;
+        n += INT_AS_SIZE(r);
+    }
+    return n;
+}
+
+bool file_uring_read(
+    struct file_uring_t* file,
+    char const** ptr,
+    size_t* len)
+{
+    if (file->held)
+        file->held = false;
+
+    file_uring_submit(file);
+
+    if (file->count == 0)
+        return false;
+
+    struct file_uring_slot_t* s =
+        file->slots + file->head;
+
+#ifdef CONFIG_COLLECT_STATISTICS
+    uint64_t c = time_now();
+#endif
+    while (file_uring_reap(file), !s->done)
+        uring_submit(&file->ring, true);
+#ifdef CONFIG_COLLECT_STATISTICS
+    TIME_ADD(
+        file->stats.wait_time,
+        time_elapsed(c));
+#endif
+
+    // stev: some file systems accept O_DIRECT
+    // at 'fcntl' time, only to reject it later
+    if (s->res == -EINVAL && s->direct) {
+        file_uring_fallback(file);
+        s->res = 0;
+    }
+
+    if (s->res < 0)
+        FILE_URING_IO_ERROR_RES(read, s->res);
+
+    size_t n = INT_AS_SIZE(s->res);
+    // stev: an aligned read of the tail gets
+    // more than asked for if the file grew
+    if (s->direct && n > s->len)
+        n = s->len;
+    ASSERT(n <= s->len);
+
+    // stev: a short read done with O_DIRECT
+    // is completed through the page cache:
+    // 'pread' can't go on from an unaligned
+    // offset when O_DIRECT is set
+    if (file->regular && n < s->len &&
+        file->direct)
+        file_uring_fallback(file);
+
+    if (file->regular && n < s->len)
+        n = file_uring_complete(file, s, n);
+
+    file->head = (file->head + 1) %
+        FILE_URING_DEPTH;
+    file->count --;
+
+    if (n == 0) {
+        // stev: EOF of a pipe, or else
+        // a regular file got truncated
+        file->eof = true;
+        return false;
+    }
+
+    // stev: the buffer is handed out to the
+    // caller; meanwhile, keep the other ones
+    // in flight
+    file->held = true;
+    file_uring_submit(file);
+
+    *ptr = s->buf;
+    *len = n;
+    return true;
+}
+
+bool file_uring_get_line(
+    struct file_uring_t* file,
+    char const** ptr,
+    size_t* len)
+{
+#ifdef CONFIG_COLLECT_STATISTICS
+    uint64_t c = time_now();
+#endif
+    const char* b;
+    size_t n;
+    bool r;
+
+    while (!(r = file_blk_get_line(
+                &file->blk, ptr, len))) {
+        if (!file_uring_read(file, &b, &n)) {
+            r = file_blk_get_last(
+                &file->blk, ptr, len);
+            break;
+        }
+        file_blk_set(&file->blk, b, n);
+    }
+
+#ifdef CONFIG_COLLECT_STATISTICS
+    TIME_ADD(
+        file->stats.getline_time,
+        time_elapsed(c));
+#endif
+    return r;
+}
+
+#ifdef CONFIG_COLLECT_STATISTICS
+
+void file_uring_stats_init(
+    struct file_uring_stats_t* stats,
+    const struct file_uring_t* file)
+{
+    memcpy(stats, &file->stats, sizeof *stats);
+    stats->memcpy_bytes = file->blk.memcpy_bytes;
+    stats->memcpy_count = file->blk.memcpy_count;
+}
+
+const struct stat_params_t*
+    file_uring_stat_params(void)
+{
+#undef  CASE
+#define CASE(n, t) \
+    STAT_PARAM_DEF(file_uring_stats_t, n, t)
+    static const struct stat_param_t params[] = {
+        CASE(read_count,   size),
+        CASE(short_count,  size),
+        CASE(submit_count, size),
+        CASE(fixed_count,  size),
+        CASE(wait_time,    time),
+        CASE(memcpy_bytes, size),
+        CASE(memcpy_count, size),
+        CASE(getline_time, time),
+    };
+    static const struct stat_params_t stat = {
+        .n_params = ARRAY_SIZE(params),
+        .params = params,
+        .name = "uring"
+    };
+    return &stat;
+}
+
+void file_uring_stats_add(
+    struct file_uring_stats_t* stats,
+    const struct file_uring_stats_t* stats2)
+{
+    stat_params_add(
+        file_uring_stat_params(),
+        stats, stats2);
+}
+
+void file_uring_stats_print_names(
+    const char* name,
+    FILE* file)
+{
+    stat_params_print_names(
+        file_uring_stat_params(),
+        name, file);
+}
+
+void file_uring_stats_print(
+    const struct file_uring_stats_t* stats,
+    const char* name, FILE* file)
+{
+    stat_params_print(
+        file_uring_stat_params(),
+        stats, name, file);
+}
+
+#endif // CONFIG_COLLECT_STATISTICS
+
+// stev: class 'file_direct_t' incarnates the
+// 'file_io_t' interface by an instance of the
+// class 'file_uring_t' reading regular files
+// with O_DIRECT; it's meant for large inputs
+// that are read once, when they are not in
+// the page cache: then the copying through
+// the cache and the kernel's read-ahead are
+// only overhead
+
+struct file_direct_t
+{
+    struct file_uring_t uring;
+};
+
+#ifdef CONFIG_COLLECT_STATISTICS
+struct file_direct_stats_t
+{
+    size_t   read_count;
+    size_t   short_count;
+    size_t   submit_count;
+    size_t   fixed_count;
+    uint64_t wait_time;
+    size_t   memcpy_bytes;
+    size_t   memcpy_count;
+    uint64_t getline_time;
+    size_t   direct_count;
+    size_t   fallback_count;
+    size_t   sync_count;
+};
+#endif
+
+void file_direct_init(
+    struct file_direct_t* file,
+    int fd,
+    const char* name,
+    const char* ctxt,
+    size_t blk_size,
+    bool split)
+{
+    file_uring_open(
+        &file->uring, fd, name, ctxt,
+        blk_size, split, true);
+}
+
+void file_direct_done(
+    struct file_direct_t* file)
+{
+    file_uring_done(&file->uring);
+}
+
+bool file_direct_get_line(
+    struct file_direct_t* file,
+    char const** ptr,
+    size_t* len)
+{
+    return file_uring_get_line(
+        &file->uring, ptr, len);
+}
+
+#ifdef CONFIG_COLLECT_STATISTICS
+
+void file_direct_stats_init(
+    struct file_direct_stats_t* stats,
+    const struct file_direct_t* file)
+{
+    struct file_uring_stats_t u;
+
+    file_uring_stats_init(&u, &file->uring);
+
+    stats->read_count     = u.read_count;
+    stats->short_count    = u.short_count;
+    stats->submit_count   = u.submit_count;
+    stats->fixed_count    = u.fixed_count;
+    stats->wait_time      = u.wait_time;
+    stats->memcpy_bytes   = u.memcpy_bytes;
+    stats->memcpy_count   = u.memcpy_count;
+    stats->getline_time   = u.getline_time;
+    stats->direct_count   = file->uring.align > 0;
+    stats->fallback_count = file->uring.fallback;
+    stats->sync_count     = file->uring.sync;
+}
+
+const struct stat_params_t*
+    file_direct_stat_params(void)
+{
+#undef  CASE
+#define CASE(n, t) \
+    STAT_PARAM_DEF(file_direct_stats_t, n, t)
+    static const struct stat_param_t params[] = {
+        CASE(read_count,     size),
+        CASE(short_count,    size),
+        CASE(submit_count,   size),
+        CASE(fixed_count,    size),
+        CASE(wait_time,      time),
+        CASE(memcpy_bytes,   size),
+        CASE(memcpy_count,   size),
+        CASE(getline_time,   time),
+        CASE(direct_count,   size),
+        CASE(fallback_count, size),
+        CASE(sync_count,     size),
+    };
+    static const struct stat_params_t stat = {
+        .n_params = ARRAY_SIZE(params),
+        .params = params,
+        .name = "direct"
+    };
+    return &stat;
+}
+
+void file_direct_stats_add(
+    struct file_direct_stats_t* stats,
+    const struct file_direct_stats_t* stats2)
+{
+    stat_params_add(
+        file_direct_stat_params(),
+        stats, stats2);
+}
+
+void file_direct_stats_print_names(
+    const char* name,
+    FILE* file)
+{
+    stat_params_print_names(
+        file_direct_stat_params(),
+        name, file);
+}
+
+void file_direct_stats_print(
+    const struct file_direct_stats_t* stats,
+    const char* name, FILE* file)
+{
+    stat_params_print(
+        file_direct_stat_params(),
+        stats, name, file);
+}
+
+#endif // CONFIG_COLLECT_STATISTICS
+
+// stev: the 'futex' system call is used for
+// putting to sleep the waiting side of a 'spsc_t'
+// queue only; the fast path of the queue touches
+// no system call at all
+
+void futex_wait(unsigned* addr, unsigned val)
+{
+    if (syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE,
+            val, NULL, NULL, 0) < 0 &&
+        errno != EAGAIN &&
+        errno != EINTR)
+        syslib_error_sys("futex", "wait", errno);
+}
+
+void futex_wake(unsigned* addr)
+{
+    if (syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE,
+            INT_MAX, NULL, NULL, 0) < 0)
+        syslib_error_sys("futex", "wake", errno);
+}
+
+#define CACHE_LINE_SIZE 64
+
+#define CACHE_ALIGNED \
+    __attribute__((aligned(CACHE_LINE_SIZE)))
+
+// stev: class 'spsc_t' is a lock-free single-
+// producer/single-consumer queue of slot indices
+// in the range [0, size): the producer owns the
+// slots in [tail, head + size), the consumer owns
+// the ones in [head, tail); the slots themselves
+// are managed by the user of the queue; either
+// side may close the queue: the producer does so
+// to signal the end of data, the consumer to stop
+// the producer; when waiting is unavoidable, the
+// respective side sleeps on a futex event counter
+
+struct spsc_t
+{
+    // stev: written by the producer
+    unsigned tail CACHE_ALIGNED;
+    unsigned cons_ev;
+    unsigned prod_wait;
+#ifdef CONFIG_COLLECT_STATISTICS
+    size_t prod_wait_count;
+#endif
+
+    // stev: written by the consumer
+    unsigned head CACHE_ALIGNED;
+    unsigned prod_ev;
+    unsigned cons_wait;
+#ifdef CONFIG_COLLECT_STATISTICS
+    size_t cons_wait_count;
+#endif
+
+    unsigned size CACHE_ALIGNED;
+    unsigned closed;
+};
+
+#define SPSC_LOAD(p) \
+    __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define SPSC_STORE(p, v) \
+    __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define SPSC_LOAD_SEQ(p) \
+    __atomic_load_n(p, __ATOMIC_SEQ_CST)
+#define SPSC_STORE_SEQ(p, v) \
+    __atomic_store_n(p, v, __ATOMIC_SEQ_CST)
+
+void spsc_init(struct spsc_t* queue, unsigned size)
+{
+    ASSERT(size > 0);
+
+    memset(queue, 0, sizeof *queue);
+    queue->size = size;
+}
+
+// stev: bump the event counter the other side
+// sleeps on; wake it up only when it does sleep
+void spsc_signal(unsigned* ev, unsigned* wait)
+{
+    __atomic_add_fetch(ev, 1, __ATOMIC_SEQ_CST);
+    if (SPSC_LOAD_SEQ(wait))
+        futex_wake(ev);
+}
+
+// stev: wait on the event counter 'e' until the
+// condition 'c' holds; announce the wait through
+// 'w' prior to re-checking 'c', for the other side
+// not to skip waking this one up; return false if
+// the queue got closed in the meantime
+#define SPSC_WAIT(q, e, w, c)                  \
+    ({                                         \
+        bool __r = true;                       \
+        while (true) {                         \
+            unsigned __e = SPSC_LOAD(e);       \
+            if (c)                             \
+                break;                         \
+            if (SPSC_LOAD(&(q)->closed)) {     \
+                __r = false;                   \
+                break;                         \
+            }                                  \
+            SPSC_STORE_SEQ(w, 1);              \
+            if (!(c) &&                        \
+                !SPSC_LOAD_SEQ(&(q)->closed))  \
+                futex_wait(e, __e);            \
+            SPSC_STORE_SEQ(w, 0);              \
+        }                                      \
+        __r;                                   \
+    })
+
+bool spsc_prod_acquire(
+    struct spsc_t* queue,
+    unsigned* slot)
+{
+    unsigned t = queue->tail;
+    unsigned h = SPSC_LOAD(&queue->head);
+
+    if (t - h >= queue->size) {
+#ifdef CONFIG_COLLECT_STATISTICS
+        queue->prod_wait_count ++;
+#endif
+        if (!SPSC_WAIT(queue,
+                &queue->prod_ev,
+                &queue->prod_wait,
+                t - SPSC_LOAD_SEQ(&queue->head) <
+                    queue->size))
+            return false;
+    }
+    else
+    if (SPSC_LOAD(&queue->closed))
+        return false;
+
+    *slot = t % queue->size;
+    return true;
+}
+
+void spsc_prod_commit(
+    struct spsc_t* queue)
+{
+    SPSC_STORE_SEQ(&queue->tail, queue->tail + 1);
+    spsc_signal(&queue->cons_ev, &queue->cons_wait);
+}
+
+bool spsc_cons_acquire(
+    struct spsc_t* queue,
+    unsigned* slot)
+{
+    unsigned h = queue->head;
+
+    if (SPSC_LOAD(&queue->tail) == h) {
+#ifdef CONFIG_COLLECT_STATISTICS
+        queue->cons_wait_count ++;
+#endif
+        // stev: when closed, the pending
+        // slots are to be consumed still
+        if (!SPSC_WAIT(queue,
+                &queue->cons_ev,
+                &queue->cons_wait,
+                SPSC_LOAD_SEQ(&queue->tail) != h) &&
+            SPSC_LOAD_SEQ(&queue->tail) == h)
+            return false;
+    }
+
+    *slot = h % queue->size;
+    return true;
+}
+
+// stev: as 'spsc_cons_acquire', but return
+// false right away when the queue is empty
+bool spsc_cons_try_acquire(
+    struct spsc_t* queue,
+    unsigned* slot)
+{
+    unsigned h = queue->head;
+
+    if (SPSC_LOAD(&queue->tail) == h)
+        return false;
+
+    *slot = h % queue->size;
+    return true;
+}
+
+void spsc_cons_release(
+    struct spsc_t* queue)
+{
+    SPSC_STORE_SEQ(&queue->head, queue->head + 1);
+    spsc_signal(&queue->prod_ev, &queue->prod_wait);
+}
+
+void spsc_close(
+    struct spsc_t* queue)
+{
+    SPSC_STORE_SEQ(&queue->closed, 1);
+    spsc_signal(&queue->cons_ev, &queue->cons_wait);
+    spsc_signal(&queue->prod_ev, &queue->prod_wait);
+}
+
+#ifdef CONFIG_COLLECT_STATISTICS
+struct file_ahead_stats_t
+{
+    size_t   read_count;
+    size_t   wait_count;
+    uint64_t wait_time;
+    size_t   stall_count;
+    size_t   memcpy_bytes;
+    size_t   memcpy_count;
+    uint64_t getline_time;
+};
+#endif
+
+// stev: class 'file_ahead_t' incarnates the
+// 'file_io_t' interface by the means of a reader
+// thread that fills in a ring of buffers ahead of
+// the consumer thread; the two threads hand over
+// the buffers through a 'spsc_t' queue; unlike
+// 'file_map_t' and 'file_uring_t', it works with
+// any kind of input file and any kernel; the way
+// the reader thread fills in a buffer is given by
+// the function 'fill': plain 'read' by default
+
+#define FILE_AHEAD_DEPTH 4
+
+struct file_ahead_slot_t
+{
+    char*  buf;
+    size_t len;
+    int    err;
+    const char* msg;
+};
+
+struct file_ahead_t;
+
+// stev: fill in the given slot; return false
+// at EOF; on errors, set either 'err' or 'msg'
+// of the slot and return true
+typedef bool (*file_ahead_fill_t)(
+    struct file_ahead_t*,
+    struct file_ahead_slot_t*);
+
+struct file_ahead_t
+{
+    const char* name;
+    const char* ctxt;
+    int fd;
+    size_t blk_size;
+    // stev: the number of bytes read in, as
+    // seen by the reader thread
+    size_t pos;
+    struct file_drop_t drop;
+    file_ahead_fill_t fill;
+    void* fill_arg;
+    bits_t held: 1;
+    bits_t eof: 1;
+    char* mem;
+    pthread_t thread;
+    struct spsc_t queue;
+    struct file_blk_t blk;
+    struct file_ahead_slot_t
+        slots[FILE_AHEAD_DEPTH];
+#ifdef CONFIG_COLLECT_STATISTICS
+    struct file_ahead_stats_t stats;
+#endif
+};
+
+#define FILE_AHEAD_IO_ERROR(e) \
+    IO_ERROR_SYS(e, file->ctxt, file->name)
+
+bool file_ahead_fill_read(
+    struct file_ahead_t* file,
+    struct file_ahead_slot_t* slot)
+{
+    ssize_t r;
+
+    do r = read(file->fd, slot->buf, file->blk_size);
+    while (r < 0 && errno == EINTR);
+
+    if (r == 0)
+        return false;
+
+    slot->err = r < 0 ? errno : 0;
+    slot->len = r < 0 ? 0 : INT_AS_SIZE(r);
+
+    file->pos += slot->len;
+    file_drop_behind(
+        &file->drop, file->pos);
+    return true;
+}
+
+void* file_ahead_reader(void* arg)
+{
+    struct file_ahead_t* file = arg;
+    unsigned i;
+
+    while (spsc_prod_acquire(&file->queue, &i)) {
+        struct file_ahead_slot_t* s =
+            file->slots + i;
+
+        s->err = 0;
+        s->msg = NULL;
+
+        if (!file->fill(file, s))
+            break;
+
+#ifdef CONFIG_COLLECT_STATISTICS
+        file->stats.read_count ++;
+#endif
+        spsc_prod_commit(&file->queue);
+
+        if (s->err || s->msg)
+            break;
+    }
+
+    spsc_close(&file->queue);
+    return NULL;
+}
+
+// stev: the initialization of 'file_ahead_t'
+// is split in two: 'file_ahead_open' and then
+// 'file_ahead_start', for the derived classes
+// be able to look at the input file prior to
+// starting up the reader thread
+
+void file_ahead_open(
+    struct file_ahead_t* file,
+    int fd,
+    const char* name,
+    const char* ctxt,
+    size_t blk_size,
+    bool split,
+    bool drop)
+{
+    size_t i;
+
+    memset(file, 0, sizeof *file);
+    file_drop_disable(&file->drop);
+
+    file->name = name;
+    file->ctxt = ctxt;
+    file->blk_size = blk_size
+        ? blk_size
+        : KB(4);
+
+    if (fd >= 0)
+        file->fd = fd;
+    else
+    if (name != NULL) {
+        file->fd = open(name, O_RDONLY);
+        if (file->fd < 0)
+            FILE_AHEAD_IO_ERROR(open);
+    }
+
+    struct stat s;
+    if (fstat(file->fd, &s) < 0)
+        FILE_AHEAD_IO_ERROR(stat);
+
+    if (S_ISREG(s.st_mode) &&
+        posix_fadvise(
+            file->fd, 0, s.st_size,
+            POSIX_FADV_SEQUENTIAL))
+        FILE_AHEAD_IO_ERROR(fadvise);
+
+    if (S_ISREG(s.st_mode) && drop)
+        file_drop_init(&file->drop,
+            name, ctxt, file->fd, NULL);
+
+    file->mem = malloc(UINT_MUL(
+        file->blk_size, ARRAY_SIZE(file->slots)));
+    VERIFY(file->mem != NULL);
+
+    for (i = 0; i < FILE_AHEAD_DEPTH; i ++)
+        file->slots[i].buf = file->mem +
+            i * file->blk_size;
+
+    spsc_init(&file->queue, FILE_AHEAD_DEPTH);
+    file_blk_init(&file->blk, split);
+}
+
+void file_ahead_start(
+    struct file_ahead_t* file,
+    file_ahead_fill_t fill,
+    void* fill_arg)
+{
+    int r;
+
+    file->fill = fill;
+    file->fill_arg = fill_arg;
+
+    r = pthread_create(&file->thread, NULL,
+            file_ahead_reader, file);
+    if (r != 0)
+        syslib_error_sys("pthread", "create", r);
+}
+
+void file_ahead_init(
+    struct file_ahead_t* file,
+    int fd,
+    const char* name,
+    const char* ctxt,
+    size_t blk_size,
+    bool split,
+    bool drop)
+{
+    file_ahead_open(
+        file, fd, name, ctxt,
+        blk_size, split, drop);
+    file_ahead_start(
+        file, file_ahead_fill_read, NULL);
+}
+
+void file_ahead_done(
+    struct file_ahead_t* file)
+{
+    int r;
+
+    // stev: stop the reader thread, if it
+    // didn't already stop by itself at EOF
+    spsc_close(&file->queue);
+
+    r = pthread_join(file->thread, NULL);
+    if (r != 0)
+        syslib_error_sys("pthread", "join", r);
+
+    file_blk_done(&file->blk);
+    free(file->mem);
+
+    file_drop_done(
+        &file->drop, file->pos);
+    if (file->fd >= 0)
+        close(file->fd);
+}
+
+bool file_ahead_read(
+    struct file_ahead_t* file,
+    char const** ptr,
+    size_t* len)
+{
+    if (file->held) {
+        spsc_cons_release(&file->queue);
+        file->held = false;
+    }
+
+    if (file->eof)
+        return false;
+
+#ifdef CONFIG_COLLECT_STATISTICS
+    size_t w = file->queue.cons_wait_count;
+    uint64_t c = time_now();
+#endif
+    unsigned i;
+    bool r = spsc_cons_acquire(
+        &file->queue, &i);
+#ifdef CONFIG_COLLECT_STATISTICS
+    if (file->queue.cons_wait_count > w) {
+        file->stats.wait_count ++;
+        TIME_ADD(
+            file->stats.wait_time,
+            time_elapsed(c));
+    }
+#endif
+
+    if (!r) {
+        file->eof = true;
+        return false;
+    }
+
+    struct file_ahead_slot_t* s =
+        file->slots + i;
+    if (s->err)
+        io_error_sys(io_error_type_read,
+            file->ctxt, file->name, s->err);
+    if (s->msg)
+        IO_ERROR_FMT(read, file->ctxt,
+            file->name, "%s", s->msg);
+
+    file->held = true;
+
+    *ptr = s->buf;
+    *len = s->len;
+    return true;
+}
+
+bool file_ahead_get_line(
+    struct file_ahead_t* file,
+    char const** ptr,
+    size_t* len)
+{
+#ifdef CONFIG_COLLECT_STATISTICS
+    uint64_t c = time_now();
+#endif
+    const char* b;
+    size_t n;
+    bool r;
+
+    while (!(r = file_blk_get_line(
+                &file->blk, ptr, len))) {
+        if (!file_ahead_read(file, &b, &n)) {
+            r = file_blk_get_last(
+                &file->blk, ptr, len);
+            break;
+        }
+        file_blk_set(&file->blk, b, n);
+    }
+
+#ifdef CONFIG_COLLECT_STATISTICS
+    TIME_ADD(
+        file->stats.getline_time,
+        time_elapsed(c));
+#endif
+    return r;
+}
+
+#ifdef CONFIG_COLLECT_STATISTICS
+
+void file_ahead_stats_init(
+    struct file_ahead_stats_t* stats,
+    const struct file_ahead_t* file)
+{
+    memcpy(stats, &file->stats, sizeof *stats);
+    stats->stall_count = file->queue.prod_wait_count;
+    stats->memcpy_bytes = file->blk.memcpy_bytes;
+    stats->memcpy_count = file->blk.memcpy_count;
+}
+
+const struct stat_params_t*
+    file_ahead_stat_params(void)
+{
+#undef  CASE
+#define CASE(n, t) \
+    STAT_PARAM_DEF(file_ahead_stats_t, n, t)
+    static const struct stat_param_t params[] = {
+        CASE(read_count,   size),
+        CASE(wait_count,   size),
+        CASE(wait_time,    time),
+        CASE(stall_count,  size),
+        CASE(memcpy_bytes, size),
+        CASE(memcpy_count, size),
+        CASE(getline_time, time),
+    };
+    static const struct stat_params_t stat = {
+        .n_params = ARRAY_SIZE(params),
+        .params = params,
+        .name = "ahead"
+    };
+    return &stat;
+}
+
+void file_ahead_stats_add(
+    struct file_ahead_stats_t* stats,
+    const struct file_ahead_stats_t* stats2)
+{
+    stat_params_add(
+        file_ahead_stat_params(),
+        stats, stats2);
+}
+
+void file_ahead_stats_print_names(
+    const char* name,
+    FILE* file)
+{
+    stat_params_print_names(
+        file_ahead_stat_params(),
+        name, file);
+}
+
+void file_ahead_stats_print(
+    const struct file_ahead_stats_t* stats,
+    const char* name, FILE* file)
+{
+    stat_params_print(
+        file_ahead_stat_params(),
+        stats, name, file);
+}
+
+#endif // CONFIG_COLLECT_STATISTICS
+
+#ifdef CONFIG_COLLECT_STATISTICS
+struct file_window_stats_t
+{
+    size_t   map_count;
+    uint64_t map_time;
+    size_t   memcpy_bytes;
+    size_t   memcpy_count;
+    uint64_t getline_time;
+};
+#endif
+
+// stev: class 'file_window_t' incarnates the
+// 'file_io_t' interface by mapping in memory
+// the input file one window of fixed size at a
+// time; the current window gets unmapped prior
+// to mapping the next one, thus the amount of
+// memory and of address space used is bounded
+// by the size of the window; the kernel is told
+// to read in the next window ahead of time
+
+struct file_window_t
+{
+    const char* name;
+    const char* ctxt;
+    int fd;
+    off_t size;
+    off_t off;
+    size_t win_size;
+    char* ptr;
+    size_t len;
+    struct file_drop_t drop;
+    struct file_blk_t blk;
+#ifdef CONFIG_COLLECT_STATISTICS
+    struct file_window_stats_t stats;
+#endif
+};
+
+#define FILE_WINDOW_IO_ERROR(e) \
+    IO_ERROR_SYS(e, file->ctxt, file->name)
+#define FILE_WINDOW_IO_ERROR_FMT(e, m, ...) \
+    IO_ERROR_FMT(e, file->ctxt, file->name, \
+        m, ## __VA_ARGS__)
+
+void file_window_init(
+    struct file_window_t* file,
+    int fd,
+    const char* name,
+    const char* ctxt,
+    size_t win_size,
+    bool split,
+    bool drop)
+{
+    memset(file, 0, sizeof *file);
+    file_drop_disable(&file->drop);
+
+    file->name = name;
+    file->ctxt = ctxt;
+
+    if (fd >= 0)
+        file->fd = fd;
+    else
+    if (name != NULL) {
+        file->fd = open(name, O_RDONLY);
+        if (file->fd < 0)
+            FILE_WINDOW_IO_ERROR(open);
+    }
+
+    struct stat s;
+    if (fstat(file->fd, &s) < 0)
+        FILE_WINDOW_IO_ERROR(stat);
+
+    if (!S_ISREG(s.st_mode))
+        FILE_WINDOW_IO_ERROR_FMT(stat,
+            "not a regular file");
+
+    file->size = s.st_size;
+
+    if (posix_fadvise(
+            file->fd, 0, s.st_size,
+            POSIX_FADV_SEQUENTIAL))
+        FILE_WINDOW_IO_ERROR(fadvise);
+
+    // stev: the windows get unmapped prior to
+    // being dropped: no need for 'madvise'
+    if (drop)
+        file_drop_init(&file->drop,
+            name, ctxt, file->fd, NULL);
+
+    // stev: 'mmap' requires the file offsets
+    // be multiples of the size of the pages
+    long p = sysconf(_SC_PAGESIZE);
+    VERIFY(p > 0);
+
+    size_t z = INT_AS_SIZE(p);
+    size_t w = win_size ? win_size : MB(256);
+    w = UINT_MUL(UINT_ADD(w, z - 1) / z, z);
+
+    file->win_size = w;
+
+    file_blk_init(&file->blk, split);
+}
+
+void file_window_unmap(
+    struct file_window_t* file)
+{
+    if (file->ptr == NULL)
+        return;
+
+    if (munmap(file->ptr, file->len) < 0)
+        MEM_MAP_ERROR(munmap);
+
+    // stev: 'off' is the end of the window
+    file_drop_behind(&file->drop,
+        INT_AS_SIZE(file->off));
+
+    file->ptr = NULL;
+    file->len = 0;
+}
+
+void file_window_done(
+    struct file_window_t* file)
+{
+    file_window_unmap(file);
+    file_blk_done(&file->blk);
+
+    file_drop_done(&file->drop,
+        INT_AS_SIZE(file->size));
+
+    if (file->fd >= 0)
+        close(file->fd);
+}
+
+bool file_window_map(
+    struct file_window_t* file,
+    char const** ptr,
+    size_t* len)
+{
+    // stev: the partial line at the end of
+    // the current window was already copied
+    // away by 'file_blk_get_line'
+    file_window_unmap(file);
+
+    ASSERT(file->off <= file->size);
+    size_t r = INT_AS_SIZE(
+        file->size - file->off);
+    if (r == 0)
+        return false;
+
+#ifdef CONFIG_COLLECT_STATISTICS
+    uint64_t c = time_now();
+#endif
+    size_t n = file->win_size;
+    if (n > r)
+        n = r;
+
+    char* b = mmap(NULL, n,
+        PROT_READ, MAP_PRIVATE,
+        file->fd, file->off);
+    ASSERT(b != NULL);
+
+    if (b == MAP_FAILED)
+        FILE_WINDOW_IO_ERROR(mmap);
+
+    file->ptr = b;
+    file->len = n;
+    file->off += UINT_AS_OFFT(n);
+
+    if (madvise(b, n, MADV_SEQUENTIAL) < 0)
+        MEM_MAP_ERROR(madvise);
+
+    // stev: have the kernel read in the next
+    // window while the current one is scanned
+    if (n < r &&
+        posix_fadvise(
+            file->fd, file->off,
+            UINT_AS_OFFT(r - n < file->win_size
+                ? r - n : file->win_size),
+            POSIX_FADV_WILLNEED))
+        FILE_WINDOW_IO_ERROR(fadvise);
+
+#ifdef CONFIG_COLLECT_STATISTICS
+    file->stats.map_count ++;
+    TIME_ADD(
+        file->stats.map_time,
+        time_elapsed(c));
+#endif
+
+    *ptr = b;
+    *len = n;
+    return true;
+}
+
+bool file_window_get_line(
+    struct file_window_t* file,
+    char const** ptr,
+    size_t* len)
+{
+#ifdef CONFIG_COLLECT_STATISTICS
+    uint64_t c = time_now();
+#endif
+    const char* b;
+    size_t n;
+    bool r;
+
+    while (!(r = file_blk_get_line(
+                &file->blk, ptr, len))) {
+        if (!file_window_map(file, &b, &n)) {
+            r = file_blk_get_last(
+                &file->blk, ptr, len);
+            break;
+        }
+        file_blk_set(&file->blk, b, n);
+    }
+
+#ifdef CONFIG_COLLECT_STATISTICS
+    TIME_ADD(
+        file->stats.getline_time,
+        time_elapsed(c));
+#endif
+    return r;
+}
+
+#ifdef CONFIG_COLLECT_STATISTICS
+
+void file_window_stats_init(
+    struct file_window_stats_t* stats,
+    const struct file_window_t* file)
+{
+    memcpy(stats, &file->stats, sizeof *stats);
+    stats->memcpy_bytes = file->blk.memcpy_bytes;
+    stats->memcpy_count = file->blk.memcpy_count;
+}
+
+const struct stat_params_t*
+    file_window_stat_params(void)
+{
+#undef  CASE
+#define CASE(n, t) \
+    STAT_PARAM_DEF(file_window_stats_t, n, t)
+    static const struct stat_param_t params[] = {
+        CASE(map_count,    size),
+        CASE(map_time,     time),
+        CASE(memcpy_bytes, size),
+        CASE(memcpy_count, size),
+        CASE(getline_time, time),
+    };
+    static const struct stat_params_t stat = {
+        .n_params = ARRAY_SIZE(params),
+        .params = params,
+        .name = "window"
+    };
+    return &stat;
+}
+
+void file_window_stats_add(
+    struct file_window_stats_t* stats,
+    const struct file_window_stats_t* stats2)
+{
+    stat_params_add(
+        file_window_stat_params(),
+        stats, stats2);
+}
+
+void file_window_stats_print_names(
+    const char* name,
+    FILE* file)
+{
+    stat_params_print_names(
+        file_window_stat_params(),
+        name, file);
+}
+
+void file_window_stats_print(
+    const struct file_window_stats_t* stats,
+    const char* name, FILE* file)
+{
+    stat_params_print(
+        file_window_stat_params(),
+        stats, name, file);
+}
+
+#endif // CONFIG_COLLECT_STATISTICS
+
+#ifdef CONFIG_COLLECT_STATISTICS
+struct file_splice_stats_t
+{
+    size_t   splice_count;
+    size_t   splice_bytes;
+    uint64_t splice_time;
+    size_t   memcpy_bytes;
+    size_t   memcpy_count;
+    uint64_t getline_time;
+};
+#endif
+
+// stev: class 'file_splice_t' incarnates the
+// 'file_io_t' interface for input pipes only:
+// the data is moved by 'splice' out of the pipe
+// into the pages of a memory file ('memfd') that
+// is mapped in memory once and for all; thus the
+// lines of text are returned in place, out of the
+// mapped pages; only the lines crossing the block
+// boundaries are copied, into the carry buffer of
+// 'file_blk_t'; the pipe's buffer is enlarged to
+// the size of the memory file, for the writer to
+// be able to get ahead of Word-Count as much as
+// possible
+
+struct file_splice_t
+{
+    const char* name;
+    const char* ctxt;
+    int fd;
+    int mfd;
+    size_t blk_size;
+    char* ptr;
+    struct file_blk_t blk;
+#ifdef CONFIG_COLLECT_STATISTICS
+    struct file_splice_stats_t stats;
+#endif
+};
+
+#define FILE_SPLICE_IO_ERROR(e) \
+    IO_ERROR_SYS(e, file->ctxt, file->name)
+#define FILE_SPLICE_IO_ERROR_FMT(e, m, ...)  \
+    IO_ERROR_FMT(e, file->ctxt, file->name, \
+        m, ## __VA_ARGS__)
+
+#define FILE_SPLICE_ERROR(e) \
+    syslib_error_sys("splice", #e, errno)
+
+void file_splice_init(
+    struct file_splice_t* file,
+    int fd,
+    const char* name,
+    const char* ctxt,
+    size_t blk_size,
+    bool split)
+{
+    memset(file, 0, sizeof *file);
+
+    file->name = name;
+    file->ctxt = ctxt;
+    file->mfd = -1;
+
+    if (fd >= 0)
+        file->fd = fd;
+    else
+    if (name != NULL) {
+        file->fd = open(name, O_RDONLY);
+        if (file->fd < 0)
+            FILE_SPLICE_IO_ERROR(open);
+    }
+
+    struct stat s;
+    if (fstat(file->fd, &s) < 0)
+        FILE_SPLICE_IO_ERROR(stat);
+
+    if (!S_ISFIFO(s.st_mode))
+        FILE_SPLICE_IO_ERROR_FMT(stat,
+            "not a pipe");
+
+    long p = sysconf(_SC_PAGESIZE);
+    VERIFY(p > 0);
+
+    // stev: the block is made of whole pages
+    size_t z = INT_AS_SIZE(p);
+    size_t b = blk_size > z ? blk_size : z;
+    file->blk_size = UINT_MUL(
+        UINT_ADD(b, z - 1) / z, z);
+
+    // stev: failing to enlarge the pipe's
+    // buffer (e.g. due to the limit set by
+    // '/proc/sys/fs/pipe-max-size') is not
+    // an error: the pipe is used as it is
+    (void) fcntl(file->fd, F_SETPIPE_SZ,
+        UINT_AS_INT(file->blk_size));
+
+    file->mfd = memfd_create(
+        "word-count", MFD_CLOEXEC);
+    if (file->mfd < 0)
+        FILE_SPLICE_ERROR(memfd_create);
+
+    if (ftruncate(file->mfd,
+            UINT_AS_OFFT(file->blk_size)) < 0)
+        FILE_SPLICE_ERROR(ftruncate);
+
+    file->ptr = mmap(NULL, file->blk_size,
+        PROT_READ, MAP_SHARED,
+        file->mfd, 0);
+    ASSERT(file->ptr != NULL);
+
+    if (file->ptr == MAP_FAILED)
+        FILE_SPLICE_ERROR(mmap);
+
+    file_blk_init(&file->blk, split);
+}
+
+void file_splice_done(
+    struct file_splice_t* file)
+{
+    if (file->ptr != NULL &&
+        munmap(file->ptr, file->blk_size) < 0)
+        FILE_SPLICE_ERROR(munmap);
+
+    file_blk_done(&file->blk);
+
+    if (file->mfd >= 0)
+        close(file->mfd);
+    if (file->fd >= 0)
+        close(file->fd);
+}
+
+bool file_splice_read(
+    struct file_splice_t* file,
+    char const** ptr,
+    size_t* len)
+{
+#ifdef CONFIG_COLLECT_STATISTICS
+    uint64_t c = time_now();
+#endif
+    size_t n = 0;
+
+    // stev: fill in the whole block, unless
+    // reaching EOF; the block always starts
+    // at the beginning of the memory file,
+    // thus its pages are being reused
+    while (n < file->blk_size) {
+        loff_t o = UINT_AS_OFFT(n);
+        ssize_t r = splice(
+            file->fd, NULL,
+            file->mfd, &o,
+            file->blk_size - n,
+            SPLICE_F_MOVE);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0)
+            FILE_SPLICE_IO_ERROR(read);
+        if (r == 0)
+            break;
+        n += INT_AS_SIZE(r);
+#ifdef CONFIG_COLLECT_STATISTICS
+        file->stats.splice_count ++;
+#endif
+    }
+
+#ifdef CONFIG_COLLECT_STATISTICS
+    ASSERT_UINT_ADD_NO_OVERFLOW(
+        file->stats.splice_bytes, n);
+    file->stats.splice_bytes += n;
+    TIME_ADD(
+        file->stats.splice_time,
+        time_elapsed(c));
+#endif
+
+    if (n == 0)
+        return false;
+
+    *ptr = file->ptr;
+    *len = n;
+    return true;
+}
+
+bool file_splice_get_line(
+    struct file_splice_t* file,
+    char const** ptr,
+    size_t* len)
+{
+#ifdef CONFIG_COLLECT_STATISTICS
+    uint64_t c = time_now();
+#endif
+    const char* b;
+    size_t n;
+    bool r;
+
+    while (!(r = file_blk_get_line(
+                &file->blk, ptr, len))) {
+        if (!file_splice_read(file, &b, &n)) {
+            r = file_blk_get_last(
+                &file->blk, ptr, len);
+            break;
+        }
+        file_blk_set(&file->blk, b, n);
+    }
+
+#ifdef CONFIG_COLLECT_STATISTICS
+    TIME_ADD(
+        file->stats.getline_time,
+        time_elapsed(c));
+#endif
+    return r;
+}
+
+#ifdef CONFIG_COLLECT_STATISTICS
+
+void file_splice_stats_init(
+    struct file_splice_stats_t* stats,
+    const struct file_splice_t* file)
+{
+    memcpy(stats, &file->stats, sizeof *stats);
+    stats->memcpy_bytes = file->blk.memcpy_bytes;
+    stats->memcpy_count = file->blk.memcpy_count;
+}
+
+const struct stat_params_t*
+    file_splice_stat_params(void)
+{
+#undef  CASE
+#define CASE(n, t) \
+    STAT_PARAM_DEF(file_splice_stats_t, n, t)
+    static const struct stat_param_t params[] = {
+        CASE(splice_count, size),
+        CASE(splice_bytes, size),
+        CASE(splice_time,  time),
+        CASE(memcpy_bytes, size),
+        CASE(memcpy_count, size),
+        CASE(getline_time, time),
+    };
+    static const struct stat_params_t stat = {
+        .n_params = ARRAY_SIZE(params),
+        .params = params,
+        .name = "splice"
+    };
+    return &stat;
+}
+
+void file_splice_stats_add(
+    struct file_splice_stats_t* stats,
+    const struct file_splice_stats_t* stats2)
+{
+    stat_params_add(
+        file_splice_stat_params(),
+        stats, stats2);
+}
+
+void file_splice_stats_print_names(
+    const char* name,
+    FILE* file)
+{
+    stat_params_print_names(
+        file_splice_stat_params(),
+        name, file);
+}
+
+void file_splice_stats_print(
+    const struct file_splice_stats_t* stats,
+    const char* name, FILE* file)
+{
+    stat_params_print(
+        file_splice_stat_params(),
+        stats, name, file);
+}
+
+#endif // CONFIG_COLLECT_STATISTICS
+
+#ifdef CONFIG_COLLECT_STATISTICS
+struct file_decomp_stats_t
+{
+    size_t   read_count;
+    size_t   wait_count;
+    uint64_t wait_time;
+    size_t   stall_count;
+    size_t   memcpy_bytes;
+    size_t   memcpy_count;
+    uint64_t getline_time;
+    size_t   in_bytes;
+    size_t   out_bytes;
+    uint64_t decode_time;
+};
+#endif
+
+// stev: class 'file_decomp_t' incarnates the
+// 'file_io_t' interface by decompressing its
+// input file on the reader thread of a class
+// 'file_ahead_t', therefore overlapping the
+// decompression with the counting of words;
+// the format of the input is detected by its
+// magic bytes: gzip (when built with 'CONFIG+=
+// USE_ZLIB') or zstd (when built with 'CONFIG+=
+// USE_ZSTD'); any other input is passed along
+// as is
+
+enum file_decomp_format_t {
+    file_decomp_format_raw,
+    file_decomp_format_gzip,
+    file_decomp_format_zstd
+};
+
+struct file_decomp_t
+{
+    struct file_ahead_t ahead;
+    enum file_decomp_format_t format;
+    char* in;
+    size_t in_size;
+    size_t in_off;
+    size_t in_len;
+    bits_t in_eof: 1;
+    // stev: the input ended at the end of
+    // a gzip member or of a zstd frame
+    bits_t in_end: 1;
+#ifdef CONFIG_USE_ZLIB
+    z_stream zlib;
+    bits_t zlib_init: 1;
+#endif
+#ifdef CONFIG_USE_ZSTD
+    ZSTD_DStream* zstd;
+#endif
+#ifdef CONFIG_COLLECT_STATISTICS
+    size_t in_bytes;
+    size_t out_bytes;
+    uint64_t decode_time;
+#endif
+};
+
+#define FILE_DECOMP_IO_ERROR(e) \
+    IO_ERROR_SYS(e, file->ahead.ctxt, file->ahead.name)
+#define FILE_DECOMP_IO_ERROR_FMT(e, m, ...) \
+    IO_ERROR_FMT(e, file->ahead.ctxt,     \
+        file->ahead.name, m, ## __VA_ARGS__)
+
+#define FILE_DECOMP_MAGIC_SIZE 4
+
+enum file_decomp_format_t
+    file_decomp_format(
+        const char* ptr, size_t len)
+{
+    static const unsigned char gzip[] = {
+        0x1f, 0x8b
+    };
+    static const unsigned char zstd[] = {
+        0x28, 0xb5, 0x2f, 0xfd
+    };
+
+    STATIC(sizeof zstd <= FILE_DECOMP_MAGIC_SIZE);
+
+    if (len >= sizeof gzip &&
+        !memcmp(ptr, gzip, sizeof gzip))
+        return file_decomp_format_gzip;
+    if (len >= sizeof zstd &&
+        !memcmp(ptr, zstd, sizeof zstd))
+        return file_decomp_format_zstd;
+
+    return file_decomp_format_raw;
+}
+
+// stev: make sure there's input data pending;
+// return an 'errno' code, or else 0, setting
+// 'in_eof' when the input file got exhausted
+int file_decomp_input(
+    struct file_decomp_t* file)
+{
+    ssize_t r;
+
+    ASSERT(file->in_off <= file->in_len);
+    if (file->in_off < file->in_len ||
+        file->in_eof)
+        return 0;
+
+    do r = read(file->ahead.fd,
+            file->in, file->in_size);
+    while (r < 0 && errno == EINTR);
+
+    if (r < 0)
+        return errno;
+
+    file->in_off = 0;
+    file->in_len = INT_AS_SIZE(r);
+    file->in_eof = r == 0;
+
+    file->ahead.pos += file->in_len;
+    file_drop_behind(&file->ahead.drop,
+        file->ahead.pos);
+
+#ifdef CONFIG_COLLECT_STATISTICS
+    ASSERT_UINT_ADD_NO_OVERFLOW(
+        file->in_bytes, file->in_len);
+    file->in_bytes += file->in_len;
+#endif
+    return 0;
+}
+
+size_t file_decomp_raw(
+    struct file_decomp_t* file,
+    struct file_ahead_slot_t* slot)
+{
+    size_t n = file->ahead.blk_size;
+    size_t l = 0;
+
+    while (l < n) {
+        if ((slot->err = file_decomp_input(file)))
+            break;
+        if (file->in_eof)
+            break;
+
+        size_t k = file->in_len - file->in_off;
+        if (k > n - l)
+            k = n - l;
+
+        memcpy(slot->buf + l,
+            file->in + file->in_off, k);
+        file->in_off += k;
+        l += k;
+    }
+
+    file->in_end = true;
+    return l;
+}
+
+#ifdef CONFIG_USE_ZLIB
+
+// stev: zlib's buffer lengths are of type 'uInt'
+#define FILE_DECOMP_ZLIB_LEN(x) \
+    ((uInt) ((x) < UINT_MAX ? (x) : UINT_MAX))
+
+size_t file_decomp_gzip(
+    struct file_decomp_t* file,
+    struct file_ahead_slot_t* slot)
+{
+    z_stream* z = &file->zlib;
+    size_t n = file->ahead.blk_size;
+    size_t l = 0;
+
+    while (l < n) {
+        if ((slot->err = file_decomp_input(file)))
+            break;
+        if (file->in_eof)
+            break;
+
+        uInt i = FILE_DECOMP_ZLIB_LEN(
+            file->in_len - file->in_off);
+        uInt o = FILE_DECOMP_ZLIB_LEN(n - l);
+
+        z->next_in = (Bytef*)
+            file->in + file->in_off;
+        z->avail_in = i;
+        z->next_out = (Bytef*)
+            slot->buf + l;
+        z->avail_out = o;
+
+        int r = inflate(z, Z_NO_FLUSH);
+
+        file->in_off += i - z->avail_in;
+        l += o - z->avail_out;
+
+        if (r == Z_STREAM_END) {
+            // stev: a gzip file may be made of
+            // several members concatenated
+            file->in_end = true;
+            if (inflateReset(z) != Z_OK) {
+                slot->msg = "inflateReset failed";
+                break;
+            }
+        }
+        else
+        if (r == Z_OK)
+            file->in_end = false;
+        else {
+            slot->msg = z->msg != NULL
+                ? z->msg : "inflate failed";
+            break;
+        }
+    }
+
+    return l;
+}
+
+#endif // CONFIG_USE_ZLIB
+
+#ifdef CONFIG_USE_ZSTD
+
+size_t file_decomp_zstd(
+    struct file_decomp_t* file,
+    struct file_ahead_slot_t* slot)
+{
+    ZSTD_outBuffer o = {
+        .dst  = slot->buf,
+        .size = file->ahead.blk_size,
+        .pos  = 0
+    };
+
+    while (o.pos < o.size) {
+        if ((slot->err = file_decomp_input(file)))
+            break;
+
+        // stev: at EOF, still let 'zstd' flush
+        // out the data it holds internally
+        ZSTD_inBuffer i = {
+            .src  = file->in + file->in_off,
+            .size = file->in_len - file->in_off,
+            .pos  = 0
+        };
+        size_t p = o.pos;
+
+        size_t r = ZSTD_decompressStream(
+            file->zstd, &o, &i);
+        if (ZSTD_isError(r)) {
+            slot->msg = ZSTD_getErrorName(r);
+            break;
+        }
+
+        file->in_off += i.pos;
+        // stev: 'r' is 0 only when a frame got
+        // completely decoded and flushed out
+        if (i.pos > 0 || o.pos > p)
+            file->in_end = r == 0;
+
+        if (file->in_eof && o.pos == p)
+            break;
+    }
+
+    return o.pos;
+}
+
+#endif // CONFIG_USE_ZSTD
+
+bool file_decomp_fill(
+    struct file_ahead_t* ahead,
+    struct file_ahead_slot_t* slot)
+{
+    struct file_decomp_t* file =
+        ahead->fill_arg;
+
+#ifdef CONFIG_COLLECT_STATISTICS
+    uint64_t c = time_now();
+#endif
+    size_t n;
+
+    switch (file->format) {
+    case file_decomp_format_raw:
+        n = file_decomp_raw(file, slot);
+        break;
+#ifdef CONFIG_USE_ZLIB
+    case file_decomp_format_gzip:
+        n = file_decomp_gzip(file, slot);
+        break;
+#endif
+#ifdef CONFIG_USE_ZSTD
+    case file_decomp_format_zstd:
+        n = file_decomp_zstd(file, slot);
+        break;
+#endif
+    default:
+        UNEXPECT_VAR("%d", file->format);
+    }
+
+    if (n == 0 && !slot->err && !slot->msg &&
+        !file->in_end)
+        slot->msg = "unexpected end of "
+            "compressed data";
+
+    slot->len = n;
+
+#ifdef CONFIG_COLLECT_STATISTICS
+    ASSERT_UINT_ADD_NO_OVERFLOW(
+        file->out_bytes, n);
+    file->out_bytes += n;
+    TIME_ADD(
+        file->decode_time,
+        time_elapsed(c));
+#endif
+
+    return n > 0 || slot->err || slot->msg;
+}
+
+void file_decomp_init(
+    struct file_decomp_t* file,
+    int fd,
+    const char* name,
+    const char* ctxt,
+    size_t blk_size,
+    bool split,
+    bool drop)
+{
+    memset(file, 0, sizeof *file);
+
+    file_ahead_open(
+        &file->ahead, fd, name, ctxt,
+        blk_size, split, drop);
+
+    file->in_size = file->ahead.blk_size;
+    if (file->in_size < KB(64))
+        file->in_size = KB(64);
+
+    file->in = malloc(file->in_size);
+    VERIFY(file->in != NULL);
+
+    // stev: read in the magic bytes, or else
+    // as many bytes as the input file has
+    while (file->in_len < FILE_DECOMP_MAGIC_SIZE) {
+        ssize_t r = read(file->ahead.fd,
+            file->in + file->in_len,
+            FILE_DECOMP_MAGIC_SIZE - file->in_len);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0)
+            FILE_DECOMP_IO_ERROR(read);
+        if (r == 0)
+            break;
+        file->in_len += INT_AS_SIZE(r);
+    }
+    file->ahead.pos = file->in_len;
+#ifdef CONFIG_COLLECT_STATISTICS
+    file->in_bytes = file->in_len;
+#endif
+
+    file->format = file_decomp_format(
+        file->in, file->in_len);
+
+    switch (file->format) {
+
+    case file_decomp_format_raw:
+        break;
+
+    case file_decomp_format_gzip:
+#ifdef CONFIG_USE_ZLIB
+        // stev: +16: expect gzip headers only
+        if (inflateInit2(&file->zlib,
+                MAX_WBITS + 16) != Z_OK)
+            FILE_DECOMP_IO_ERROR_FMT(read,
+                "inflateInit2 failed");
+        file->zlib_init = true;
+        break;
+#else
+        FILE_DECOMP_IO_ERROR_FMT(read,
+            "gzip compressed input: "
+            "not built with CONFIG+=USE_ZLIB");
+#endif
+
+    case file_decomp_format_zstd:
+#ifdef CONFIG_USE_ZSTD
+        file->zstd = ZSTD_createDStream();
+        VERIFY(file->zstd != NULL);
+        break;
+#else
+        FILE_DECOMP_IO_ERROR_FMT(read,
+            "zstd compressed input: "
+            "not built with CONFIG+=USE_ZSTD");
+#endif
+
+    default:
+        UNEXPECT_VAR("%d", file->format);
+    }
+
+    file_ahead_start(
+        &file->ahead, file_decomp_fill, file);
+}
+
+void file_decomp_done(
+    struct file_decomp_t* file)
+{
+    file_ahead_done(&file->ahead);
+
+#ifdef CONFIG_USE_ZLIB
+    if (file->zlib_init)
+        inflateEnd(&file->zlib);
+#endif
+#ifdef CONFIG_USE_ZSTD
+    if (file->zstd != NULL)
+        ZSTD_freeDStream(file->zstd);
+#endif
+    free(file->in);
+}
+
+bool file_decomp_get_line(
+    struct file_decomp_t* file,
+    char const** ptr,
+    size_t* len)
+{
+    return file_ahead_get_line(
+        &file->ahead, ptr, len);
+}
+
+#ifdef CONFIG_COLLECT_STATISTICS
+
+void file_decomp_stats_init(
+    struct file_decomp_stats_t* stats,
+    const struct file_decomp_t* file)
+{
+    struct file_ahead_stats_t a;
+
+    file_ahead_stats_init(&a, &file->ahead);
+
+    stats->read_count   = a.read_count;
+    stats->wait_count   = a.wait_count;
+    stats->wait_time    = a.wait_time;
+    stats->stall_count  = a.stall_count;
+    stats->memcpy_bytes = a.memcpy_bytes;
+    stats->memcpy_count = a.memcpy_count;
+    stats->getline_time = a.getline_time;
+    stats->in_bytes     = file->in_bytes;
+    stats->out_bytes    = file->out_bytes;
+    stats->decode_time  = file->decode_time;
+}
+
+const struct stat_params_t*
+    file_decomp_stat_params(void)
+{
+#undef  CASE
+#define CASE(n, t) \
+    STAT_PARAM_DEF(file_decomp_stats_t, n, t)
+    static const struct stat_param_t params[] = {
+        CASE(read_count,   size),
+        CASE(wait_count,   size),
+        CASE(wait_time,    time),
+        CASE(stall_count,  size),
+        CASE(memcpy_bytes, size),
+        CASE(memcpy_count, size),
+        CASE(getline_time, time),
+        CASE(in_bytes,     size),
+        CASE(out_bytes,    size),
+        CASE(decode_time,  time),
+    };
+    static const struct stat_params_t stat = {
+        .n_params = ARRAY_SIZE(params),
+        .params = params,
+        .name = "decomp"
+    };
+    return &stat;
+}
+
+void file_decomp_stats_add(
+    struct file_decomp_stats_t* stats,
+    const struct file_decomp_stats_t* stats2)
+{
+    stat_params_add(
+        file_decomp_stat_params(),
+        stats, stats2);
+}
+
+void file_decomp_stats_print_names(
+    const char* name,
+    FILE* file)
+{
+    stat_params_print_names(
+        file_decomp_stat_params(),
+        name, file);
+}
+
+void file_decomp_stats_print(
+    const struct file_decomp_stats_t* stats,
+    const char* name, FILE* file)
+{
+    stat_params_print(
+        file_decomp_stat_params(),
+        stats, name, file);
+}
+
+enum file_io_stats_type_t {
+    file_io_stats_type_null,
+    file_io_stats_type_buf,
+    file_io_stats_type_map,
+    file_io_stats_type_uring,
+    file_io_stats_type_ahead,
+    file_io_stats_type_window,
+    file_io_stats_type_splice,
+    file_io_stats_type_decomp,
+    file_io_stats_type_direct
+};
+
+struct file_io_stats_t
+{
+    union {
+        struct {}               null;
+        struct file_buf_stats_t buf;
+        struct file_map_stats_t map;
+        struct file_uring_stats_t uring;
+        struct file_ahead_stats_t ahead;
+        struct file_window_stats_t window;
+        struct file_splice_stats_t splice;
+        struct file_decomp_stats_t decomp;
+        struct file_direct_stats_t direct;
+    };
+    enum file_io_stats_type_t type;
+
+    void (*add)(
+        void*, const void*);
+    void (*print)(
+        const void*,
+        const char*,
+        FILE*);
+};
+
+void file_null_stats_add(
+    struct file_io_stats_t* stats UNUSED,
+    const struct file_io_stats_t* stats2 UNUSED)
+{ /* stev: nop */ }
+
+void file_null_stats_print(
+    const struct file_io_stats_t* stats UNUSED,
+    const char* name UNUSED,
+    FILE* file UNUSED)
+{ /* stev: nop */ }
+
+#endif // CONFIG_COLLECT_STATISTICS
+
+enum file_io_type_t {
+    file_io_type_buf,
+    file_io_type_map,
+    file_io_type_uring,
+    file_io_type_ahead,
+    file_io_type_window,
+    file_io_type_splice,
+    file_io_type_decomp,
+    file_io_type_direct,
+    // stev: 'auto' is not a type of its own:
+    // it asks for choosing one of the types
+    // above for each input file separately
+    file_io_type_auto
+};
+
+struct file_io_t
+{
+    union {
+        struct file_buf_t buf;
+        struct file_map_t map;
+        struct file_uring_t uring;
+        struct file_ahead_t ahead;
+        struct file_window_t window;
+        struct file_splice_t splice;
+        struct file_decomp_t decomp;
+        struct file_direct_t direct;
+    };
+    enum file_io_type_t type;
+
+    void  *impl;
+    void (*done)(void*);
+    bool (*get_line)(void*,
+        char const**, size_t*);
+};
+
+#define FILE_IO_INIT(n, ...)         \
+    do {                             \
+        file->type =                 \
+            file_io_type_ ## n;      \
+        file_ ## n ## _init(         \
+            file->impl = &file->n,   \
+            ## __VA_ARGS__);         \
+        file->done =                 \
+            (void (*)(void*))        \
+            file_ ## n ## _done;     \
+        file->get_line =             \
+            (bool (*)(void*,         \
+                char const**,        \
+                size_t*))            \
+            file_ ## n ## _get_line; \
+    } while (0)
+
+struct file_io_opts_t
+{
+    size_t io_buf_size;
+    size_t max_buf_size;
+    size_t map_window;
+    size_t auto_map_min;
+    size_t prefetch_size;
+    bool adapt_buf_size;
+    bool drop_behind;
+    bool split_lines;
+    // stev: the pool shared by the instances
+    // of 'file_buf_t', or NULL
+    struct file_buf_pool_t* buf_pool;
+};
+
+// stev: the types of I/O among which 'auto'
+// is choosing, based on the type and size of
+// each input file: non-regular files (pipes,
+// terminals) are read ahead by a thread; the
+// regular files smaller than 'auto_map_min'
+// are read in, since for them mmap+munmap is
+// more expensive than read; the ones larger
+// than 'map_window' are mapped in windows;
+// all the other ones are mapped as a whole;
+// when built with a decompression library,
+// the regular files that are compressed are
+// decompressed by a thread
+
+const enum file_io_type_t file_io_auto_types[] = {
+    file_io_type_buf,
+    file_io_type_map,
+    file_io_type_window,
+    file_io_type_ahead,
+    file_io_type_decomp,
+};
+
+#if defined(CONFIG_USE_ZLIB) || \
+    defined(CONFIG_USE_ZSTD)
+
+bool file_io_auto_compressed(
+    int fd,
+    const char* name,
+    const char* ctxt)
+{
+    char b[FILE_DECOMP_MAGIC_SIZE];
+    ssize_t r;
+
+    r = pread(fd, b, sizeof b, 0);
+    if (r < 0)
+        IO_ERROR_SYS(read, ctxt, name);
+
+    return file_decomp_format(
+        b, INT_AS_SIZE(r)) !=
+        file_decomp_format_raw;
+}
+
+#endif
+
+// stev: open the input file 'name' -- or get
+// stdin, when 'name' is NULL -- for the file
+// descriptor be passed on to 'file_io_init',
+// such that the file is opened only once
+int file_io_open(
+    const char* name,
+    const char* ctxt)
+{
+    int fd;
+
+    if (name == NULL)
+        return 0;
+
+    if ((fd = open(name, O_RDONLY)) < 0)
+        IO_ERROR_SYS(open, ctxt, name);
+
+    return fd;
+}
+
+// stev: the size of the input file opened as
+// 'fd' if that is a regular file, or SIZE_MAX
+// otherwise
+size_t file_io_size(
+    int fd,
+    const char* name,
+    const char* ctxt)
+{
+    struct stat s;
+
+    if (fstat(fd, &s) < 0)
+        IO_ERROR_SYS(stat, ctxt, name);
+
+    return S_ISREG(s.st_mode)
+        ? INT_AS_SIZE(s.st_size)
+        : SIZE_MAX;
+}
+
+// stev: the type of I/O of the input file opened
+// as 'fd', of which size, as told by the function
+// 'file_io_size', is 'size'; 'fd' is looked at
+// only when built with a decompression library
+enum file_io_type_t file_io_auto_type(
+    const struct file_io_opts_t* opts,
+    int fd UNUSED,
+    const char* name UNUSED,
+    const char* ctxt UNUSED,
+    size_t size)
+{
+    if (size == SIZE_MAX)
+        return file_io_type_ahead;
+
+#if defined(CONFIG_USE_ZLIB) || \
+    defined(CONFIG_USE_ZSTD)
+    if (file_io_auto_compressed(fd, name, ctxt))
+        return file_io_type_decomp;
+#endif
+
+    if (size < opts->auto_map_min)
+        return file_io_type_buf;
+    if (size > opts->map_window)
+        return file_io_type_window;
+
+    return file_io_type_map;
+}
+
+void file_io_init(
+    struct file_io_t* file,
+    enum file_io_type_t type,
+    struct mem_mgr_t* mem,
+    const struct file_io_opts_t* opts,
+    int fd,
+    const char* name,
+    const char* ctxt)
+{
+    switch (type) {
+
+    case file_io_type_map:
+        VERIFY(mem != NULL &&
+            mem->type == mem_mgr_type_map);
+        FILE_IO_INIT(map,
+            mem_mgr_as_map(mem),
+            fd, name, ctxt,
+            opts->drop_behind);
+        break;
+
+    case file_io_type_buf:
+        VERIFY(mem == NULL ||
+            mem->type == mem_mgr_type_buf);
+        FILE_IO_INIT(buf,
+            mem != NULL
+            ? mem_mgr_as_buf(mem)
+            : NULL,
+            fd, name, ctxt,
+            opts->io_buf_size,
+            opts->max_buf_size,
+            opts->split_lines,
+            opts->buf_pool,
+            opts->adapt_buf_size,
+            opts->drop_behind);
+        break;
+
+    case file_io_type_uring:
+        VERIFY(mem == NULL);
+        FILE_IO_INIT(uring,
+            fd, name, ctxt,
+            opts->io_buf_size,
+            opts->split_lines);
+        break;
+
+    case file_io_type_ahead:
+        VERIFY(mem == NULL);
+        FILE_IO_INIT(ahead,
+            fd, name, ctxt,
+            opts->io_buf_size,
+            opts->split_lines,
+            opts->drop_behind);
+        break;
+
+    case file_io_type_window:
+        VERIFY(mem == NULL);
+        FILE_IO_INIT(window,
+            fd, name, ctxt,
+            opts->map_window,
+            opts->split_lines,
+            opts->drop_behind);
+        break;
+
+    case file_io_type_splice:
+        VERIFY(mem == NULL);
+        FILE_IO_INIT(splice,
+            fd, name, ctxt,
+            opts->io_buf_size,
+            opts->split_lines);
+        break;
+
+    case file_io_type_decomp:
+        VERIFY(mem == NULL);
+        FILE_IO_INIT(decomp,
+            fd, name, ctxt,
+            opts->io_buf_size,
+            opts->split_lines,
+            opts->drop_behind);
+        break;
+
+    case file_io_type_direct:
+        VERIFY(mem == NULL);
+        FILE_IO_INIT(direct,
+            fd, name, ctxt,
+            opts->io_buf_size,
+            opts->split_lines);
+        break;
+
+    default:
+        UNEXPECT_VAR("%d", type);
+    }
+}
+
+void file_io_done(
+    struct file_io_t* file)
+{
+    file->done(file->impl);
+}
+
+bool file_io_get_line(
+    struct file_io_t* file,
+    char const** ptr,
+    size_t* len)
+{
+    return file->get_line(
+        file->impl, ptr, len);
+}
+
+#ifdef CONFIG_COLLECT_STATISTICS
+
+#define FILE_IO_AS_(t)             \
+    ({                             \
+        VERIFY(                    \
+            file->type ==          \
+            file_io_type_ ## t);   \
+        (struct file_ ## t ## _t*) \
+            file->impl;            \
+    })
+
+struct file_buf_t*
+    file_io_as_buf(const struct file_io_t* file)
+{ return FILE_IO_AS_(buf); }
+
+struct file_map_t*
+    file_io_as_map(const struct file_io_t* file)
+{ return FILE_IO_AS_(map); }
+
+struct file_uring_t*
+    file_io_as_uring(const struct file_io_t* file)
+{ return FILE_IO_AS_(uring); }
+
+struct file_ahead_t*
+    file_io_as_ahead(const struct file_io_t* file)
+{ return FILE_IO_AS_(ahead); }
+
+struct file_window_t*
+    file_io_as_window(const struct file_io_t* file)
+{ return FILE_IO_AS_(window); }
+
+struct file_splice_t*
+    file_io_as_splice(const struct file_io_t* file)
+{ return FILE_IO_AS_(splice); }
+
+struct file_decomp_t*
+    file_io_as_decomp(const struct file_io_t* file)
+{ return FILE_IO_AS_(decomp); }
+
+struct file_direct_t*
+    file_io_as_direct(const struct file_io_t* file)
+{ return FILE_IO_AS_(direct); }
+
+#define FILE_IO_STATS_INIT_(n)          \
+    do {                                \
+        stats->type =                   \
+            file_io_stats_type_ ## n;   \
+        STATIC(offsetof(struct          \
+            file_io_stats_t, n) == 0);  \
+        stats->add =                    \
+            (void (*)(void*,            \
+                const void*))           \
+            file_ ## n ## _stats_add;   \
+        stats->print =                  \
+            (void (*)(const void*,      \
+                const char*,            \
+                FILE*))                 \
+            file_ ## n ## _stats_print; \
+    } while (0)
+#define FILE_IO_STATS_INIT(n, ...)      \
+    do {                                \
+        FILE_IO_STATS_INIT_(n);         \
+        file_ ## n ## _stats_init(      \
+            (void*) stats, ##           \
+            __VA_ARGS__);               \
+    } while (0)
+
+void file_io_stats_init(
+    struct file_io_stats_t* stats)
+{
+    FILE_IO_STATS_INIT_(null);
+}
+
+// stev: initialize 'stats' to all zeros
+// of the statistics of the given type
+void file_io_stats_init_type(
+    struct file_io_stats_t* stats,
+    enum file_io_type_t type)
+{
+    memset(stats, 0, sizeof *stats);
+
+    switch (type) {
+
+#undef  CASE
+#define CASE(n)                        \
+    case file_io_type_ ## n:           \
+        FILE_IO_STATS_INIT_(n);        \
+        break
+    CASE(buf);
+    CASE(map);
+    CASE(uring);
+    CASE(ahead);
+    CASE(window);
+    CASE(splice);
+    CASE(decomp);
+    CASE(direct);
+
+    default:
+        UNEXPECT_VAR("%d", type);
+    }
+}
+
+void file_io_stats_init_from_file(
+    struct file_io_stats_t* stats,
+    const struct file_io_t* file)
+{
+    switch (file->type) {
+
+    case file_io_type_buf:
+        FILE_IO_STATS_INIT(
+            buf, file_io_as_buf(file));
+        break;
+
+    case file_io_type_map:
+        FILE_IO_STATS_INIT(
+            map, file_io_as_map(file));
+        break;
+
+    case file_io_type_uring:
+        FILE_IO_STATS_INIT(
+            uring, file_io_as_uring(file));
+        break;
+
+    case file_io_type_ahead:
+        FILE_IO_STATS_INIT(
+            ahead, file_io_as_ahead(file));
+        break;
+
+    case file_io_type_window:
+        FILE_IO_STATS_INIT(
+            window, file_io_as_window(file));
+        break;
+
+    case file_io_type_splice:
+        FILE_IO_STATS_INIT(
+            splice, file_io_as_splice(file));
+        break;
+
+    case file_io_type_decomp:
+        FILE_IO_STATS_INIT(
+            decomp, file_io_as_decomp(file));
+        break;
+
+    case file_io_type_direct:
+        FILE_IO_STATS_INIT(
+            direct, file_io_as_direct(file));
+        break;
+
+    default:
+        UNEXPECT_VAR("%d", file->type);
+    }
+}
+
+void file_io_stats_add(
+    struct file_io_stats_t* stats,
+    struct file_io_stats_t stats2)
+{
+    if (stats->type == file_io_stats_type_null)
+        memcpy(stats, &stats2, sizeof *stats);
+    else {
+        VERIFY(stats->type == stats2.type);
+        stats->add(stats, &stats2);
+    }
+}
+
+void file_io_stats_print_names(
+    enum file_io_type_t type, bool empty,
+    const char* name,
+    FILE* file)
+{
+    if (empty)
+        return;
+
+    switch (type) {
+
+    case file_io_type_buf:
+        file_buf_stats_print_names(
+            name, file);
+        break;
+
+    case file_io_type_map:
+        file_map_stats_print_names(
+            name, file);
+        break;
+
+    case file_io_type_uring:
+        file_uring_stats_print_names(
+            name, file);
+        break;
+
+    case file_io_type_ahead:
+        file_ahead_stats_print_names(
+            name, file);
+        break;
+
+    case file_io_type_window:
+        file_window_stats_print_names(
+            name, file);
+        break;
+
+    case file_io_type_splice:
+        file_splice_stats_print_names(
+            name, file);
+        break;
+
+    case file_io_type_decomp:
+        file_decomp_stats_print_names(
+            name, file);
+        break;
+
+    case file_io_type_direct:
+        file_direct_stats_print_names(
+            name, file);
+        break;
+
+    default:
+        UNEXPECT_VAR("%d", type);
+    }
+}
+
+void file_io_stats_print(
+    const struct file_io_stats_t* stats,
+    const char* name, FILE* file)
+{
+    stats->print(stats, name, file);
+}
+
+struct file_io_stats_t file_io_get_stats(
+    const struct file_io_t* file)
+{
+    struct file_io_stats_t s;
+    file_io_stats_init_from_file(&s, file);
+    return s;
+}
+
+struct file_io_auto_stats_t
+{
+    size_t buf_count;
+    size_t map_count;
+    size_t window_count;
+    size_t ahead_count;
+    size_t decomp_count;
+};
+
+void file_io_auto_stats_count(
+    struct file_io_auto_stats_t* stats,
+    enum file_io_type_t type)
+{
+    switch (type) {
+
+#undef  CASE
+#define CASE(n)                        \
+    case file_io_type_ ## n:           \
+        stats->n ## _count ++;         \
+        break
+    CASE(buf);
+    CASE(map);
+    CASE(window);
+    CASE(ahead);
+    CASE(decomp);
+
+    default:
+        UNEXPECT_VAR("%d", type);
+    }
+}
+
+const struct stat_params_t*
+    file_io_auto_stat_params(void)
+{
+#undef  CASE
+#define CASE(n, t) \
+    STAT_PARAM_DEF(file_io_auto_stats_t, n, t)
+    static const struct stat_param_t params[] = {
+        CASE(buf_count,    size),
+        CASE(map_count,    size),
+        CASE(window_count, size),
+        CASE(ahead_count,  size),
+        CASE(decomp_count, size),
+    };
+    static const struct stat_params_t stat = {
+        .n_params = ARRAY_SIZE(params),
+        .params = params,
+        .name = "auto"
+    };
+    return &stat;
+}
+
+#endif // CONFIG_COLLECT_STATISTICS
+
+#ifdef CONFIG_COLLECT_STATISTICS
+struct file_prefetch_stats_t
+{
+    size_t file_count;
+    size_t skip_count;
+    size_t byte_count;
+};
+#endif
+
+// stev: class 'file_prefetch_t' warms up the
+// page cache for the input files following
+// the one currently read: it asks the kernel
+// by 'posix_fadvise(POSIX_FADV_WILLNEED)' to
+// start reading in the next files, up to at
+// most 'FILE_PREFETCH_DEPTH' files ahead and
+// at most 'budget' bytes in total ahead of
+// the current file; the files that cannot be
+// opened or that aren't regular files are
+// skipped over silently: the error, if any,
+// gets reported when the file is read itself
+
+#define FILE_PREFETCH_DEPTH 16 // stev: see '--help'
+
+struct file_prefetch_t
+{
+    char const* const* names;
+    size_t* sizes;
+    size_t n_names;
+    size_t next;
+    size_t bytes;
+    size_t budget;
+#ifdef CONFIG_COLLECT_STATISTICS
+    struct file_prefetch_stats_t stats;
+#endif
+};
+
+void file_prefetch_init(
+    struct file_prefetch_t* file,
+    char const* const* names,
+    size_t n_names,
+    size_t budget)
+{
+    memset(file, 0, sizeof *file);
+
+    file->names = names;
+    file->n_names = n_names;
+    file->budget = budget;
+
+    file->sizes = calloc(n_names, sizeof(size_t));
+    VERIFY(n_names == 0 || file->sizes != NULL);
+}
+
+void file_prefetch_done(
+    struct file_prefetch_t* file)
+{
+    free(file->sizes);
+}
+
+size_t file_prefetch_file(
+    const char* name,
+    size_t max_size)
+{
+    struct stat s;
+    size_t n = 0;
+    int fd;
+
+    // stev: opening a FIFO would block until
+    // its writer shows up, and would consume
+    // data meant for the reader of the file;
+    // thus only regular files get opened, and
+    // with O_NONBLOCK, in case 'name' changed
+    // in between 'stat' and 'open'
+    if (stat(name, &s) < 0 ||
+        !S_ISREG(s.st_mode) ||
+        s.st_size == 0)
+        return 0;
+
+    if ((fd = open(name,
+            O_RDONLY | O_NONBLOCK)) < 0)
+        return 0;
+
+    if (fstat(fd, &s) == 0 &&
+        S_ISREG(s.st_mode) &&
+        s.st_size > 0) {
+        n = INT_AS_SIZE(s.st_size);
+        if (n > max_size)
+            n = max_size;
+
+        if (posix_fadvise(
+                fd, 0, UINT_AS_OFFT(n),
+                POSIX_FADV_WILLNEED))
+            n = 0;
+    }
+
+    close(fd);
+    return n;
+}
+
+// stev: the file of index 'index' is about to
+// be read: take it out of the prefetch window
+// and push the window forward as the budget
+// allows for
+void file_prefetch_advance(
+    struct file_prefetch_t* file,
+    size_t index)
+{
+    ASSERT(index < file->n_names);
+
+    if (index < file->next) {
+        ASSERT(file->bytes >=
+            file->sizes[index]);
+        file->bytes -= file->sizes[index];
+    }
+    else
+        file->next = index + 1;
+
+    while (file->next < file->n_names &&
+           file->next - index <= FILE_PREFETCH_DEPTH &&
+           file->bytes < file->budget) {
+        size_t n = file_prefetch_file(
+            file->names[file->next],
+            file->budget - file->bytes);
+
+        file->sizes[file->next ++] = n;
+        file->bytes += n;
+
+#ifdef CONFIG_COLLECT_STATISTICS
+        if (n == 0)
+            file->stats.skip_count ++;
+        else {
+            file->stats.file_count ++;
+            ASSERT_UINT_ADD_NO_OVERFLOW(
+                file->stats.byte_count, n);
+            file->stats.byte_count += n;
+        }
+#endif
+    }
+}
+
+#ifdef CONFIG_COLLECT_STATISTICS
+
+const struct stat_params_t*
+    file_prefetch_stat_params(void)
+{
+#undef  CASE
+#define CASE(n, t) \
+    STAT_PARAM_DEF(file_prefetch_stats_t, n, t)
+    static const struct stat_param_t params[] = {
+        CASE(file_count, size),
+        CASE(skip_count, size),
+        CASE(byte_count, size),
+    };
+    static const struct stat_params_t stat = {
+        .n_params = ARRAY_SIZE(params),
+        .params = params,
+        .name = "prefetch"
+    };
+    return &stat;
+}
+
+struct dict_stats_t
+{
+    struct file_io_stats_t load_io;
+    struct file_io_stats_t count_io;
+    // stev: used only with '-i auto': one
+    // entry for each of 'file_io_auto_types'
+    struct file_io_stats_t auto_io[
+        ARRAY_SIZE(file_io_auto_types)];
+    struct file_io_auto_stats_t auto_stats;
+    bits_t auto_used: 1;
+    struct file_prefetch_stats_t prefetch;
+    size_t chunk_count;
+    size_t steal_count;
+    uint64_t load_time;
+    uint64_t count_time;
+};
+
+#endif // CONFIG_COLLECT_STATISTICS
+
+typedef char ascii_table_t[256];
+
+size_t memspn(
+    const char* p, size_t n,
+    const ascii_table_t t)
+{
+    const char* q = p;
+    while (n --) {
+        if (!t[UCHAR(*q)])
+            break;
+        q ++;
+    }
+    return PTR_DIFF(q, p);
+}
+
+size_t memcspn(
+    const char* p, size_t n,
+    const ascii_table_t t)
+{
+    const char* q = p;
+    while (n --) {
+        if (t[UCHAR(*q)])
+            break;
+        q ++;
+    }
+    return PTR_DIFF(q, p);
+}
+
+// stev: tell whether the memory block [p, p + n)
+// contains only ASCII characters; the bulk of the
+// block is checked by OR-ing together its 16-byte
+// (or, lacking SSE2, 8-byte) words and testing the
+// high bit of each byte of the result only once for
+// each 64 bytes of input
+
+bool memascii(const char* p, size_t n)
+{
+#ifdef __SSE2__
+    while (n >= 64) {
+        const __m128i* v = (const __m128i*) p;
+        __m128i m = _mm_or_si128(
+            _mm_or_si128(
+                _mm_loadu_si128(v + 0),
+                _mm_loadu_si128(v + 1)),
+            _mm_or_si128(
+                _mm_loadu_si128(v + 2),
+                _mm_loadu_si128(v + 3)));
+        if (_mm_movemask_epi8(m))
+            return false;
+        p += 64;
+        n -= 64;
+    }
+    while (n >= 16) {
+        __m128i m = _mm_loadu_si128(
+            (const __m128i*) p);
+        if (_mm_movemask_epi8(m))
+            return false;
+        p += 16;
+        n -= 16;
+    }
+#else  // __SSE2__
+    const uint64_t h = UINT64_C(0x8080808080808080);
+    while (n >= 64) {
+        uint64_t w[8], m;
+        memcpy(w, p, sizeof w);
+        m = w[0] | w[1] | w[2] | w[3] |
+            w[4] | w[5] | w[6] | w[7];
+        if (m & h)
+            return false;
+        p += 64;
+        n -= 64;
+    }
+    while (n >= 8) {
+        uint64_t w;
+        memcpy(&w, p, sizeof w);
+        if (w & h)
+            return false;
+        p += 8;
+        n -= 8;
+    }
+#endif // __SSE2__
+    while (n --) {
+        if (UCHAR(*p ++) & 0x80)
+            return false;
+    }
+    return true;
+}
+
+// stev: return the offset within [p, p + k) of
+// the n-th occurrence of the char 'c', for n > 0,
+// or 'k' if there are fewer than n occurrences of
+// 'c'; when SSE2 is available, count the matching
+// chars 16 bytes at a time, such that the skipped
+// over blocks of text are only compared, but not
+// otherwise looked at
+
+size_t memnchr(
+    const char* p, size_t k,
+    char c, size_t n)
+{
+    const char* b = p;
+
+    ASSERT(n > 0);
+
+#ifdef __SSE2__
+    const __m128i v = _mm_set1_epi8(c);
+    while (k >= 16) {
+        unsigned m = _mm_movemask_epi8(
+            _mm_cmpeq_epi8(v, _mm_loadu_si128(
+                (const __m128i*) p)));
+        size_t d = __builtin_popcount(m);
+        if (d >= n) {
+            // stev: clear the lowest n - 1
+            // bits of 'm' that are set
+            while (-- n)
+                m &= m - 1;
+            return PTR_DIFF(p, b) +
+                __builtin_ctz(m);
+        }
+        n -= d;
+        p += 16;
+        k -= 16;
+    }
+    while (k) {
+        if (*p == c && !-- n)
+            return PTR_DIFF(p, b);
+        p ++;
+        k --;
+    }
+#else  // __SSE2__
+    while (k) {
+        const char* q = memchr(p, c, k);
+        if (q == NULL)
+            break;
+        if (!-- n)
+            return PTR_DIFF(q, b);
+        q ++;
+        k -= PTR_DIFF(q, p);
+        p = q;
+    }
+    p += k;
+#endif // __SSE2__
+    return PTR_DIFF(p, b);
+}
+
+#define UTF8_INVALID UINT32_MAX
+
+// stev: decode the UTF-8 sequence at the beginning
+// of [p, p + n), for n > 0; on success, return the
+// code point and store in '*l' the length of the
+// sequence; otherwise return UTF8_INVALID and let
+// '*l' be 1 -- i.e. consider the offending byte a
+// sequence of its own
+uint32_t utf8_decode(
+    const char* p, size_t n,
+    size_t* l)
+{
+    const uchar_t* q = (const uchar_t*) p;
+    uint32_t c, m;
+    size_t k, i;
+
+    ASSERT(n > 0);
+
+    c = q[0];
+    *l = 1;
+
+    if (c < 0x80)
+        return c;
+    else
+    if (c < 0xc2)
+        return UTF8_INVALID;
+    else
+    if (c < 0xe0) {
+        k = 2;
+        m = 0x80;
+        c &= 0x1f;
+    }
+    else
+    if (c < 0xf0) {
+        k = 3;
+        m = 0x800;
+        c &= 0x0f;
+    }
+    else
+    if (c < 0xf5) {
+        k = 4;
+        m = 0x10000;
+        c &= 0x07;
+    }
+    else
+        return UTF8_INVALID;
+
+    if (k > n)
+        return UTF8_INVALID;
+
+    for (i = 1; i < k; i ++) {
+        if ((q[i] & 0xc0) != 0x80)
+            return UTF8_INVALID;
+        c = (c << 6) | (q[i] & 0x3f);
+    }
+
+    // stev: reject overlong forms, surrogates
+    // and code points beyond U+10FFFF
+    if (c < m ||
+        (c >= 0xd800 && c <= 0xdfff) ||
+        c > 0x10ffff)
+        return UTF8_INVALID;
+
+    *l = k;
+    return c;
+}
+
+// stev: the non-ASCII code points that separate
+// words in UTF-8 encoded texts: all the Unicode
+// whitespace characters (property White_Space),
+// the zero width space and the zero width no-break
+// space (i.e. BOM) along with the characters of the
+// Unicode punctuation general categories P* from
+// the most common blocks
+
+struct utf8_range_t
+{
+    uint32_t lo;
+    uint32_t hi;
+};
+
+bool utf8_is_separator(uint32_t c)
+{
+#undef  CASE
+#define CASE(l, h) { .lo = 0x ## l, .hi = 0x ## h }
+    static const struct utf8_range_t seps[] = {
+        CASE(0085, 0085), CASE(00a0, 00a1), CASE(00a7, 00a7),
+        CASE(00ab, 00ab), CASE(00b6, 00b7), CASE(00bb, 00bb),
+        CASE(00bf, 00bf), CASE(037e, 037e), CASE(0387, 0387),
+        CASE(055a, 055f), CASE(0589, 058a), CASE(05be, 05be),
+        CASE(05c0, 05c0), CASE(05c3, 05c3), CASE(05c6, 05c6),
+        CASE(05f3, 05f4), CASE(0609, 060a), CASE(060c, 060d),
+        CASE(061b, 061b), CASE(061d, 061f), CASE(066a, 066d),
+        CASE(06d4, 06d4), CASE(0964, 0965), CASE(0970, 0970),
+        CASE(0e4f, 0e4f), CASE(0e5a, 0e5b), CASE(10fb, 10fb),
+        CASE(1360, 1368), CASE(166e, 166e), CASE(1680, 1680),
+        CASE(169b, 169c), CASE(16eb, 16ed), CASE(2000, 200b),
+        CASE(2010, 2029), CASE(202f, 2043), CASE(2045, 2051),
+        CASE(2053, 205f), CASE(207d, 207e), CASE(208d, 208e),
+        CASE(2308, 230b), CASE(2329, 232a), CASE(2768, 2775),
+        CASE(27c5, 27c6), CASE(27e6, 27ef), CASE(2983, 2998),
+        CASE(29d8, 29db), CASE(29fc, 29fd), CASE(2cf9, 2cfc),
+        CASE(2cfe, 2cff), CASE(2e00, 2e2e), CASE(2e30, 2e4f),
+        CASE(3000, 3003), CASE(3008, 3011), CASE(3014, 301f),
+        CASE(3030, 3030), CASE(303d, 303d), CASE(30a0, 30a0),
+        CASE(30fb, 30fb), CASE(fd3e, fd3f), CASE(fe10, fe19),
+        CASE(fe30, fe52), CASE(fe54, fe61), CASE(fe63, fe63),
+        CASE(fe68, fe68), CASE(fe6a, fe6b), CASE(feff, feff),
+        CASE(ff01, ff03), CASE(ff05, ff0a), CASE(ff0c, ff0f),
+        CASE(ff1a, ff1b), CASE(ff1f, ff20), CASE(ff3b, ff3d),
+        CASE(ff3f, ff3f), CASE(ff5b, ff5b), CASE(ff5d, ff5d),
+        CASE(ff5f, ff65),
+    };
+    size_t l = 0, h = ARRAY_SIZE(seps);
+
+    if (c < seps[0].lo ||
+        c > seps[h - 1].hi)
+        return false;
+
+    // stev: binary search for the first
+    // range 'r' such that: c <= r->hi
+    while (l < h) {
+        size_t m = l + (h - l) / 2;
+        if (seps[m].hi < c)
+            l = m + 1;
+        else
+            h = m;
+    }
+    return
+        l < ARRAY_SIZE(seps) &&
+        seps[l].lo <= c;
+}
+
+// stev: the field at 0-based index 'i' of a text
+// line is selected iff there is a range 'r' in the
+// array 'ranges' such that: r.lo <= i <= r.hi; the
+// ranges are sorted and pairwise disjoint; 'hi' is
+// SIZE_MAX when a range extends to the line's end
+
+struct field_range_t
+{
+    size_t lo;
+    size_t hi;
+};
+
+struct fields_t
+{
+    struct field_range_t* ranges;
+    size_t n_ranges;
+    const char* skip;
+    size_t skip_len;
+    char delim;
+};
+
+// stev: the ways the workers of 'dict_jobs_t'
+// count words: 'shard' -- into private arrays
+// of counters, added up at the end; 'atomic'
+// -- by relaxed atomic increments of the hash
+// table's counters; 'hybrid' -- into private
+// caches of the recently counted words, which
+// are flushed into the hash table's counters
+// by relaxed atomic additions upon eviction
+enum dict_counters_t
+{
+    dict_counters_shard,
+    dict_counters_atomic,
+    dict_counters_hybrid,
+};
+
+// stev: the 'hybrid' cache of a worker is
+// direct-mapped, indexed by the position of
+// the node in the hash table
+#define DICT_CACHE_SIZE 1024
+
+struct dict_cache_entry_t
+{
+    struct lhash_node_t* node;
+    unsigned count;
+};
+
+struct dict_cache_t
+{
+    struct dict_cache_entry_t entries[
+        DICT_CACHE_SIZE];
+};
+
+struct dict_t
+{
+    struct file_io_opts_t io;
+    bits_t mapped_dict: 1;
+    bits_t utf8_text: 1;
+    // stev: whether the order of the nodes of
+    // the hash table cannot be told from the
+    // output: the words are printed sorted,
+    // or are not printed at all
+    bits_t any_order: 1;
+    enum file_io_type_t text_io;
+    const struct fields_t* fields;
+    ascii_table_t wsp;
+    struct mem_mgr_t mem;
+    struct file_buf_pool_t pool;
+    struct lhash_t hash;
+    size_t n_words;
+    size_t n_jobs;
+    size_t chunk_size;
+    enum dict_counters_t counters;
+    // stev: the counters of a worker of
+    // 'dict_jobs_t' under 'shard', indexed
+    // as the hash table's nodes, or NULL
+    unsigned* vals;
+    // stev: the cache of a worker under
+    // 'hybrid', or NULL
+    struct dict_cache_t* cache;
+    // stev: whether a worker increments
+    // the hash table's counters atomically
+    bits_t atomic_vals: 1;
+    size_t n_tokenizers;
+    size_t n_counters;
+    // stev: the tokenizer of 'dict_pipe_t'
+    // the words are passed on to, or NULL
+    struct dict_tokenizer_t* tokenizer;
+    // stev: the CPUs the worker threads are
+    // to be pinned to, or NULL
+    const cpu_set_t* cpus;
+    // stev: the NUMA nodes the hash table is
+    // to be replicated on, or NULL
+    const char* numa_nodes;
+    // stev: with '-g', the copies of the
+    // words counted, and the hash table
+    // shared by the workers under 'atomic'
+    // and 'hybrid', or NULL
+    bits_t all_words: 1;
+    struct key_pool_t keys;
+    struct chash_t* words;
+#ifdef CONFIG_COLLECT_STATISTICS
+    struct dict_stats_t stats;
+#endif
+};
+
+void dict_init(
+    struct dict_t* dict,
+    const struct file_io_opts_t* io,
+    size_t hash_tbl_size,
+    bool mapped_dict,
+    enum file_io_type_t text_io,
+    bool utf8_text,
+    const struct fields_t* fields,
+    size_t n_jobs,
+    size_t chunk_size,
+    enum dict_counters_t counters,
+    size_t n_tokenizers,
+    size_t n_counters,
+    const cpu_set_t* cpus,
+    const char* numa_nodes,
+    bool all_words,
+    bool any_order)
+{
+    static const ascii_table_t wsp = {
+        [' ']  = 1, ['\t'] = 1, ['\f'] = 1,
+        ['\n'] = 1, ['\r'] = 1, ['\v'] = 1,
+        ['\0'] = 1
+    };
+
+    memset(dict, 0, sizeof *dict);
+
+    dict->io = *io;
+    dict->n_jobs = n_jobs;
+    dict->chunk_size = chunk_size;
+    dict->counters = counters;
+    dict->n_tokenizers = n_tokenizers;
+    dict->n_counters = n_counters;
+    dict->cpus = cpus;
+    dict->numa_nodes = numa_nodes;
+    dict->all_words = all_words;
+    dict->any_order = any_order;
+    dict->mapped_dict = mapped_dict;
+    dict->text_io = text_io;
+    dict->utf8_text = utf8_text;
+    dict->fields = fields != NULL && (
+        fields->n_ranges > 0 ||
+        fields->skip_len > 0)
+        ? fields : NULL;
+
+    // stev: the fields of a line cannot be
+    // told apart unless the line is whole
+    dict->io.split_lines =
+        dict->fields == NULL;
+
+    // stev: within the selected fields, the
+    // field delimiter separates words too
+    memcpy(dict->wsp, wsp, sizeof wsp);
+    if (dict->fields != NULL &&
+        dict->fields->n_ranges > 0)
+        dict->wsp[UCHAR(fields->delim)] = 1;
+
+    mem_mgr_init(&dict->mem, mapped_dict);
+    lhash_init(&dict->hash, hash_tbl_size);
+    key_pool_init(&dict->keys);
+
+    // stev: the input files read by buffered
+    // I/O share one buffer and directory fd
+    file_buf_pool_init(&dict->pool);
+    dict->io.buf_pool = &dict->pool;
+
+#ifdef CONFIG_COLLECT_STATISTICS
+    file_io_stats_init(
+        &dict->stats.load_io);
+    file_io_stats_init(
+        &dict->stats.count_io);
+#endif
+}
+
+void dict_done(struct dict_t* dict)
+{
+    ASSERT(dict->words == NULL);
+
+    file_buf_pool_done(&dict->pool);
+    key_pool_done(&dict->keys);
+    lhash_done(&dict->hash);
+    mem_mgr_done(&dict->mem);
+}
+
+// stev: class 'dict_loader_t' loads a mapped
+// dictionary on several threads, in three
+// phases: first, the mapped file is cut in
+// chunks at newlines and the lines and the
+// words of each chunk are counted, such that
+// the line numbers of each chunk are known
+// and the hash table gets enlarged up front
+// to hold all words; second, each thread
+// hashes the words of its chunk, putting them
+// in the buffer of the partition of the hash
+// table their home position is in; third, each
+// thread inserts the words of its partition
+// -- taken from all chunks, in order --, with
+// no locking, since all probing is confined to
+// the partition; the few words that would
+// have their probing get out of the partition
+// are inserted at the end, on a single thread;
+// the warnings are collected along, sorted by
+// line numbers and printed out at the end
+
+struct dict_entry_t
+{
+    const char* ptr;
+    size_t len;
+    size_t line;
+    uint32_t hash;
+};
+
+struct dict_entries_t
+{
+    struct dict_entry_t* ptr;
+    size_t size;
+    size_t max;
+};
+
+void dict_entries_push(
+    struct dict_entries_t* entries,
+    const struct dict_entry_t* entry)
+{
+    if (entries->size >= entries->max) {
+        entries->max = entries->max > 0
+            ? UINT_MUL(entries->max, SZ(2))
+            : 64;
+        entries->ptr = realloc(entries->ptr,
+            UINT_MUL(entries->max,
+                sizeof *entries->ptr));
+        VERIFY(entries->ptr != NULL);
+    }
+    entries->ptr[entries->size ++] = *entry;
+}
+
+struct dict_loader_t;
+
+struct dict_load_job_t
+{
+    struct dict_loader_t* loader;
+    const char* ptr;
+    size_t size;
+    // stev: the number of lines that
+    // precede the chunk
+    size_t line;
+    size_t n_lines;
+    size_t n_words;
+    size_t n_inserted;
+    // stev: the words of the chunk, for
+    // each partition of the hash table
+    struct dict_entries_t* parts;
+    // stev: the words of the partition of
+    // which probing got out of it
+    struct dict_entries_t outs;
+    // stev: the words to be warned about:
+    // duplicated -- or, when 'len' exceeds
+    // UINT16_MAX, too long
+    struct dict_entries_t warns;
+    pthread_t thread;
+};
+
+struct dict_loader_t
+{
+    struct dict_t* dict;
+    struct dict_load_job_t* jobs;
+    size_t n_jobs;
+};
+
+#define DICT_LOADER_FOREACH_LINE(j, b, k) \
+    for (const char                       \
+            *__p = (j)->ptr,              \
+            *__e = __p + (j)->size,       \
+            *__q;                         \
+         __p < __e &&                     \
+         (__q = memchr(__p, '\n',         \
+                PTR_DIFF(__e, __p)),      \
+          b = __p,                        \
+          k = __q != NULL                 \
+            ? PTR_DIFF(__q, __p)          \
+            : PTR_DIFF(__e, __p),         \
+          true);                          \
+         __p += k + (__q != NULL))
+
+// stev: whether the line [b, b + k) is to
+// be warned about instead of being loaded
+#ifdef CONFIG_USE_48BIT_PTR
+#define DICT_LOADER_WORD_TOO_LONG(k) \
+    ((k) > UINT16_MAX)
+#else
+#define DICT_LOADER_WORD_TOO_LONG(k) \
+    (false)
+#endif
+
+#define DICT_LOADER_IS_WORD(b, k) \
+    ((k) > 0 && (b)[0] != '#')
+
+void* dict_load_job_count(void* arg)
+{
+    struct dict_load_job_t* job = arg;
+    const char* b;
+    size_t k;
+
+    DICT_LOADER_FOREACH_LINE(job, b, k) {
+        job->n_lines ++;
+
+        if (DICT_LOADER_IS_WORD(b, k) &&
+            !DICT_LOADER_WORD_TOO_LONG(k))
+            job->n_words ++;
+    }
+
+    return NULL;
+}
+
+// stev: the partition of the hash table
+// the home position 'h' is in
+#define DICT_LOADER_PART(h, n, s) \
+    (STATIC(TYPEOF_IS_SIZET(h)),  \
+     (h) * (n) / (s))
+// stev: the first home position of the
+// partition 'i'
+#define DICT_LOADER_PART_LO(i, n, s) \
+    (((i) * (s) + (n) - 1) / (n))
+
+void* dict_load_job_part(void* arg)
+{
+    struct dict_load_job_t* job = arg;
+    struct dict_loader_t* loader = job->loader;
+    const struct lhash_t* hash =
+        &loader->dict->hash;
+    size_t l = job->line;
+    const char* b;
+    size_t k;
+
+    DICT_LOADER_FOREACH_LINE(job, b, k) {
+        struct dict_entry_t e = {
+            .ptr  = b,
+            .len  = k,
+            .line = ++ l
+        };
+        size_t h;
+
+        if (!DICT_LOADER_IS_WORD(b, k))
+            continue;
+
+        if (DICT_LOADER_WORD_TOO_LONG(k)) {
+            dict_entries_push(&job->warns, &e);
+            continue;
+        }
+
+        e.hash = lhash_hash_key(b, k);
+        h = e.hash % hash->size;
+
+        dict_entries_push(job->parts +
+            DICT_LOADER_PART(h, loader->n_jobs,
+                hash->size), &e);
+    }
+
+    return NULL;
+}
+
+void* dict_load_job_insert(void* arg)
+{
+    struct dict_load_job_t* job = arg;
+    struct dict_loader_t* loader = job->loader;
+    struct lhash_t* hash = &loader->dict->hash;
+    size_t i = PTR_DIFF(job, loader->jobs);
+    size_t n = loader->n_jobs;
+    size_t lo = DICT_LOADER_PART_LO(i, n, hash->size);
+    size_t hi = DICT_LOADER_PART_LO(i + 1, n, hash->size);
+    size_t j;
+
+    // stev: an empty partition
+    if (lo >= hi)
+        return NULL;
+
+    for (j = 0; j < n; j ++) {
+        const struct dict_entries_t* s =
+            loader->jobs[j].parts + i;
+        const struct dict_entry_t *p, *e;
+
+        for (p = s->ptr,
+             e = p + s->size;
+             p < e;
+             p ++) {
+            struct lhash_node_t* q = NULL;
+
+            switch (lhash_insert_range(hash,
+                        p->ptr, p->len, p->hash,
+                        lo, hi, &q)) {
+            case lhash_insert_new:
+                ASSERT(q != NULL);
+                LHASH_NODE_INIT(q, p->ptr, p->len);
+                job->n_inserted ++;
+                break;
+            case lhash_insert_found:
+                dict_entries_push(&job->warns, p);
+                break;
+            case lhash_insert_out:
+                dict_entries_push(&job->outs, p);
+                break;
+            default:
+                UNEXPECT_VAR("%d", 0);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+void dict_loader_run(
+    struct dict_loader_t* loader,
+    void* (*run)(void*))
+{
+    size_t i;
+    int r;
+
+    for (i = 0; i < loader->n_jobs; i ++) {
+        struct dict_load_job_t* j =
+            loader->jobs + i;
+
+        r = pthread_create(&j->thread, NULL,
+                run, j);
+        if (r != 0)
+            syslib_error_sys("pthread", "create", r);
+    }
+
+    for (i = 0; i < loader->n_jobs; i ++) {
+        r = pthread_join(
+                loader->jobs[i].thread, NULL);
+        if (r != 0)
+            syslib_error_sys("pthread", "join", r);
+    }
+}
+
+int dict_entry_line_cmp(
+    const struct dict_entry_t* a,
+    const struct dict_entry_t* b)
+{
+    return a->line < b->line ? -1
+        : a->line > b->line;
+}
+
+void dict_loader_load(
+    struct dict_loader_t* loader,
+    struct dict_t* dict,
+    const char* ptr, size_t size)
+{
+    struct dict_entries_t w;
+    const char* p = ptr;
+    size_t i, j, n, l;
+
+    ASSERT(dict->n_jobs > 1);
+
+    memset(loader, 0, sizeof *loader);
+    memset(&w, 0, sizeof w);
+
+    loader->dict = dict;
+    loader->n_jobs = n = dict->n_jobs;
+
+    loader->jobs = calloc(n, sizeof *loader->jobs);
+    VERIFY(loader->jobs != NULL);
+
+    // stev: cut the file in chunks of about
+    // equal size, right after newlines
+    for (i = 0; i < n; i ++) {
+        struct dict_load_job_t* j =
+            loader->jobs + i;
+        const char *e = ptr + size, *q;
+
+        q = i + 1 < n
+            ? ptr + (i + 1) * (size / n)
+            : e;
+        if (q < p)
+            q = p;
+        if (q < e &&
+            (q = memchr(q, '\n', PTR_DIFF(e, q)))
+                != NULL)
+            q ++;
+        else
+            q = e;
+
+        j->loader = loader;
+        j->ptr = p;
+        j->size = PTR_DIFF(q, p);
+        j->parts = calloc(n, sizeof *j->parts);
+        VERIFY(j->parts != NULL);
+
+        p = q;
+    }
+
+    dict_loader_run(loader, dict_load_job_count);
+
+    for (i = 0, l = 0, j = 0; i < n; i ++) {
+        struct dict_load_job_t* b =
+            loader->jobs + i;
+
+        b->line = l;
+        l = UINT_ADD(l, b->n_lines);
+        j = UINT_ADD(j, b->n_words);
+    }
+
+    lhash_reserve(&dict->hash, j);
+
+    dict_loader_run(loader, dict_load_job_part);
+    dict_loader_run(loader, dict_load_job_insert);
+
+    for (i = 0; i < n; i ++) {
+        struct dict_load_job_t* b =
+            loader->jobs + i;
+
+        ASSERT_UINT_ADD_NO_OVERFLOW(
+            dict->hash.used, b->n_inserted);
+        dict->hash.used += b->n_inserted;
+    }
+    LHASH_ASSERT_INVARIANTS(&dict->hash);
+
+    // stev: the words of each partition are
+    // in order of their line numbers; so are
+    // the words that got out of partitions
+    for (i = 0; i < n; i ++) {
+        struct dict_load_job_t* b =
+            loader->jobs + i;
+        const struct dict_entry_t *q, *e;
+
+        for (q = b->outs.ptr,
+             e = q + b->outs.size;
+             q < e;
+             q ++) {
+            struct lhash_node_t* t = NULL;
+
+            if (!lhash_insert(&dict->hash,
+                    q->ptr, q->len, &t))
+                dict_entries_push(&w, q);
+            else {
+                ASSERT(t != NULL);
+                LHASH_NODE_INIT(t, q->ptr, q->len);
+            }
+        }
+    }
+
+    for (i = 0; i < n; i ++) {
+        struct dict_load_job_t* b =
+            loader->jobs + i;
+
+        for (j = 0; j < b->warns.size; j ++)
+            dict_entries_push(&w,
+                b->warns.ptr + j);
+    }
+
+    if (w.size > 0)
+        qsort(w.ptr, w.size, sizeof *w.ptr,
+            (int (*)(const void*, const void*))
+            dict_entry_line_cmp);
+
+    for (j = 0; j < w.size; j ++) {
+        const struct dict_entry_t* e = w.ptr + j;
+
+#ifdef CONFIG_USE_48BIT_PTR
+        if (DICT_LOADER_WORD_TOO_LONG(e->len)) {
+            warning("ignoring word on line #%zu: its length "
+                    "%zu exceeds the maximum allowed %" PRIu16,
+                    e->line, e->len, UINT16_MAX);
+            continue;
+        }
+#endif
+        warning("duplicated word in line #%zu: '%.*s'",
+            e->line, UINT_AS_INT(e->len), e->ptr);
+    }
+
+    for (i = 0; i < n; i ++) {
+        struct dict_load_job_t* b =
+            loader->jobs + i;
+
+        for (j = 0; j < n; j ++)
+            free(b->parts[j].ptr);
+        free(b->parts);
+        free(b->outs.ptr);
+        free(b->warns.ptr);
+    }
+    free(loader->jobs);
+    free(w.ptr);
+}
+
+void dict_load(
+    struct dict_t* dict,
+    const char* file_name)
+{
+    struct file_io_opts_t o = dict->io;
+    struct file_io_t f;
+    size_t l = 0, k;
+    const char* b;
+
+    // stev: the dictionary stays resident
+    o.drop_behind = false;
+
+#ifdef CONFIG_COLLECT_STATISTICS
+    uint64_t c = time_now();
+#endif
+    file_io_init(
+        &f, dict->mapped_dict
+            ? file_io_type_map
+            : file_io_type_buf,
+        &dict->mem,
+        &o, -1, file_name, "dictionary");
+
+    // stev: only a mapped dictionary gets
+    // to be loaded on several threads; the
+    // nodes of the hash table are laid out
+    // otherwise than by loading on a single
+    // thread, which would change the order
+    // of the words printed out: thus, the
+    // order has to be of no concern
+    if (dict->mapped_dict &&
+        dict->any_order &&
+        dict->n_jobs > 1) {
+        struct dict_loader_t d;
+
+        ASSERT(f.type == file_io_type_map);
+        dict_loader_load(&d, dict,
+            f.map.ptr, f.map.size);
+    }
+    else
+    while (file_io_get_line(&f, &b, &k)) {
+        l ++;
+
+        if (k == 0 || b[0] == '#')
+            continue;
+
+#ifdef CONFIG_USE_48BIT_PTR
+        if (k > UINT16_MAX) {
+            warning("ignoring word on line #%zu: its length "
+                    "%zu exceeds the maximum allowed %" PRIu16,
+                    l, k, UINT16_MAX);
+            continue;
+        }
+#endif
+
+        struct lhash_node_t* e = NULL;
+        if (!lhash_insert(&dict->hash, b, k, &e))
+            warning("duplicated word in line #%zu: '%.*s'",
+                l, UINT_AS_INT(k), b);
+        else {
+            ASSERT(e != NULL);
+            LHASH_NODE_INIT(e, b, k);
+        }
+    }
+
+#ifdef CONFIG_COLLECT_STATISTICS
+    dict->stats.load_io =
+        file_io_get_stats(&f);
+#endif
+    file_io_done(&f);
+
+#ifdef CONFIG_COLLECT_STATISTICS
+    TIME_ADD(
+        dict->stats.load_time,
+        time_elapsed(c));
+#endif
+}
+
+#define DICT_ATOMIC_ADD(p, v)          \
+    ({                                 \
+        unsigned __v = (v);            \
+        unsigned __r =                 \
+            __atomic_fetch_add(p, __v, \
+                __ATOMIC_RELAXED);     \
+        ASSERT_UINT_ADD_NO_OVERFLOW(   \
+            __r, __v);                 \
+    })
+
+void dict_cache_flush(
+    struct dict_cache_t* cache)
+{
+    struct dict_cache_entry_t *p, *e;
+
+    for (p = cache->entries,
+         e = p + DICT_CACHE_SIZE;
+         p < e;
+         p ++) {
+        if (p->node == NULL)
+            continue;
+        DICT_ATOMIC_ADD(
+            &p->node->val, p->count);
+        p->node = NULL;
+    }
+}
+
+void dict_cache_count(
+    struct dict_t* dict,
+    struct lhash_node_t* node)
+{
+    STATIC((DICT_CACHE_SIZE & (DICT_CACHE_SIZE - 1)) == 0);
+
+    struct dict_cache_entry_t* c =
+        dict->cache->entries + (PTR_DIFF(
+            node, dict->hash.table) &
+            (DICT_CACHE_SIZE - 1));
+
+    if (c->node == node) {
+        ASSERT_UINT_INC_NO_OVERFLOW(
+            c->count);
+        c->count ++;
+        return;
+    }
+
+    if (c->node != NULL)
+        DICT_ATOMIC_ADD(
+            &c->node->val, c->count);
+
+    c->node = node;
+    c->count = 1;
+}
+
+// stev: parse 'str' -- a comma separated list
+// of items of form N or N-M -- into 'set'
+bool cpu_list_parse(
+    const char* str,
+    cpu_set_t* set)
+{
+    const char* p = str;
+
+    CPU_ZERO(set);
+
+    while (true) {
+        unsigned long lo, hi;
+        char* q;
+
+        if (UCHAR(*p) < '0' ||
+            UCHAR(*p) > '9')
+            return false;
+        errno = 0;
+        lo = hi = strtoul(p, &q, 10);
+        if (errno || lo >= CPU_SETSIZE)
+            return false;
+        p = q;
+
+        if (*p == '-') {
+            p ++;
+            if (UCHAR(*p) < '0' ||
+                UCHAR(*p) > '9')
+                return false;
+            hi = strtoul(p, &q, 10);
+            if (errno || hi >= CPU_SETSIZE ||
+                lo > hi)
+                return false;
+            p = q;
+        }
+
+        for (; lo <= hi; lo ++)
+            CPU_SET(lo, set);
+
+        if (*p != ',')
+            break;
+        p ++;
+    }
+
+    // stev: the sysfs files end with a newline
+    return *p == 0 || !strcmp(p, "\n");
+}
+
+// stev: the n'th CPU of 'set', counting
+// from 0, modulo the number of CPUs
+size_t cpu_set_nth(
+    const cpu_set_t* set,
+    size_t n)
+{
+    size_t i, k = CPU_COUNT(set);
+
+    ASSERT(k > 0);
+    n %= k;
+
+    for (i = 0; i < CPU_SETSIZE; i ++) {
+        if (CPU_ISSET(i, set) &&
+            n -- == 0)
+            return i;
+    }
+    UNEXPECT_VAR("%zu", n);
+}
+
+// stev: class 'dict_numa_t' places the worker
+// threads of 'dict_jobs_t' and 'dict_pipe_t':
+// given '--cpus', it pins the workers to the
+// listed CPUs, round-robin; given '--numa', it
+// replicates the hash table -- the dictionary
+// words included -- on each NUMA node that
+// runs workers, such that the workers look
+// up words only in memory local to their node;
+// a replica is built by a thread running on
+// its node, for its pages to be allocated from
+// the node's memory by the kernel's first-touch
+// policy; likewise, the private counters of a
+// worker are allocated by the worker itself,
+// once pinned; the shared counters -- of the
+// 'atomic' and 'hybrid' types and those of the
+// counter threads of 'dict_pipe_t' -- are the
+// ones of the replicas; these get added up
+// into the hash table when the workers are
+// done; on single node machines, nothing is
+// replicated
+
+#define DICT_NUMA_NODES_MAX 64
+
+struct dict_node_t
+{
+    cpu_set_t cpus;
+    struct lhash_t hash;
+    char* keys;
+    bits_t used: 1;
+};
+
+struct dict_numa_t
+{
+    struct dict_t* dict;
+    struct dict_node_t* nodes;
+    size_t n_nodes;
+    pthread_t thread;
+};
+
+void* dict_job_alloc(size_t size)
+{
+    const size_t l = CACHE_LINE_SIZE;
+    size_t n = UINT_ADD(size, l - 1) &
+        ~(l - 1);
+    void* p = NULL;
+
+    VERIFY(!posix_memalign(
+        &p, CACHE_LINE_SIZE, n));
+    memset(p, 0, n);
+
+    return p;
+}
+
+// stev: read the NUMA nodes in from sysfs; for
+// a node to be of use it has to have CPUs
+void dict_numa_read_nodes(
+    struct dict_numa_t* numa)
+{
+    char b[4096];
+    size_t i;
+
+    for (i = 0; i < DICT_NUMA_NODES_MAX; i ++) {
+        struct dict_node_t* n =
+            numa->nodes + numa->n_nodes;
+        ssize_t r;
+        int fd;
+
+        snprintf(b, sizeof b,
+            "/sys/devices/system/node/node%zu/cpulist",
+            i);
+        if ((fd = open(b, O_RDONLY)) < 0)
+            continue;
+
+        r = read(fd, b, sizeof b - 1);
+        close(fd);
+
+        if (r <= 0)
+            continue;
+        b[r] = 0;
+
+        if (cpu_list_parse(b, &n->cpus) &&
+            CPU_COUNT(&n->cpus) > 0)
+            numa->n_nodes ++;
+    }
+}
+
+// stev: parse the nodes given by '--numa':
+// a colon separated list of CPU lists, one
+// for each node
+void dict_numa_parse_nodes(
+    struct dict_numa_t* numa,
+    const char* nodes)
+{
+    const char *p, *q;
+    char b[4096];
+
+    for (p = nodes;; p = q + 1) {
+        struct dict_node_t* n =
+            numa->nodes + numa->n_nodes;
+        size_t l;
+
+        q = strchr(p, ':');
+        l = q != NULL
+            ? PTR_DIFF(q, p)
+            : strlen(p);
+
+        // stev: 'options_parse_numa_optarg'
+        // validated 'nodes' already
+        VERIFY(l < sizeof b);
+        VERIFY(numa->n_nodes <
+            DICT_NUMA_NODES_MAX);
+
+        memcpy(b, p, l);
+        b[l] = 0;
+
+        VERIFY(cpu_list_parse(b, &n->cpus));
+        numa->n_nodes ++;
+
+        if (q == NULL)
+            break;
+    }
+}
+
+// stev: the CPUs worker 'index' is to be
+// pinned to and the node it is placed on,
+// or SIZE_MAX when not replicating
+size_t dict_numa_place(
+    const struct dict_numa_t* numa,
+    size_t index,
+    cpu_set_t* cpus)
+{
+    const cpu_set_t* c = numa->dict->cpus;
+    size_t i, k;
+
+    CPU_ZERO(cpus);
+
+    if (c == NULL &&
+        numa->n_nodes == 0)
+        return SIZE_MAX;
+
+    if (c == NULL) {
+        i = index % numa->n_nodes;
+        *cpus = numa->nodes[i].cpus;
+        return i;
+    }
+
+    k = cpu_set_nth(c, index);
+    CPU_SET(k, cpus);
+
+    for (i = 0; i < numa->n_nodes; i ++) {
+        if (CPU_ISSET(k, &numa->nodes[i].cpus))
+            return i;
+    }
+
+    // stev: a CPU of none of the nodes
+    // looks up into the hash table itself
+    return SIZE_MAX;
+}
+
+void dict_numa_pin(
+    const cpu_set_t* cpus)
+{
+    int r = pthread_setaffinity_np(
+        pthread_self(), sizeof *cpus, cpus);
+    if (r != 0)
+        syslib_error_sys("pthread",
+            "setaffinity_np", r);
+}
+
+void* dict_numa_clone(void* arg)
+{
+    struct dict_numa_t* numa = arg;
+    struct dict_node_t* n = numa->nodes;
+
+    // stev: the replica gets built by a
+    // thread pinned to the replica's node
+    dict_numa_pin(&n->cpus);
+
+    lhash_clone(&n->hash,
+        &numa->dict->hash, &n->keys);
+
+    return NULL;
+}
+
+void dict_numa_init(
+    struct dict_numa_t* numa,
+    struct dict_t* dict,
+    size_t n_workers)
+{
+    const char* s = dict->numa_nodes;
+    struct dict_numa_t c;
+    size_t i;
+    int r;
+
+    memset(numa, 0, sizeof *numa);
+
+    numa->dict = dict;
+
+    // stev: with '-g', the hash table is
+    // filled in while counting: it has no
+    // words to be replicated
+    if (s == NULL || dict->all_words)
+        return;
+
+    numa->nodes = calloc(DICT_NUMA_NODES_MAX,
+        sizeof *numa->nodes);
+    VERIFY(numa->nodes != NULL);
+
+    if (!strcmp(s, "auto"))
+        dict_numa_read_nodes(numa);
+    else
+        dict_numa_parse_nodes(numa, s);
+
+    // stev: one node only has nothing
+    // to be replicated on
+    if (numa->n_nodes < 2) {
+        free(numa->nodes);
+        numa->nodes = NULL;
+        numa->n_nodes = 0;
+        return;
+    }
+
+    for (i = 0; i < n_workers; i ++) {
+        cpu_set_t u;
+        size_t k;
+
+        if ((k = dict_numa_place(numa, i, &u))
+                != SIZE_MAX)
+            numa->nodes[k].used = true;
+    }
+
+    for (i = 0; i < numa->n_nodes; i ++) {
+        if (!numa->nodes[i].used)
+            continue;
+
+        c = *numa;
+        c.nodes += i;
+
+        r = pthread_create(&c.thread, NULL,
+                dict_numa_clone, &c);
+        if (r != 0)
+            syslib_error_sys("pthread", "create", r);
+
+        r = pthread_join(c.thread, NULL);
+        if (r != 0)
+            syslib_error_sys("pthread", "join", r);
+    }
+}
+
+// stev: pin the calling thread -- worker
+// 'index' -- and switch its copy of 'dict_t'
+// to the replica of its node
+void dict_numa_enter(
+    const struct dict_numa_t* numa,
+    size_t index,
+    struct dict_t* copy,
+    struct lhash_t* hash)
+{
+    const struct dict_node_t* n;
+    cpu_set_t c;
+    size_t k;
+
+    if ((k = dict_numa_place(numa, index, &c))
+            == SIZE_MAX &&
+        CPU_COUNT(&c) == 0)
+        return;
+
+    dict_numa_pin(&c);
+
+    if (k == SIZE_MAX)
+        return;
+
+    ASSERT(k < numa->n_nodes);
+    n = numa->nodes + k;
+    ASSERT(n->used);
+
+    if (hash != NULL)
+        hash->table = n->hash.table;
+    if (copy == NULL)
+        return;
+
+    copy->hash.table = n->hash.table;
+
+    // stev: the private counters get to be
+    // allocated anew by the pinned worker
+    if (copy->vals != NULL) {
+        free(copy->vals);
+        copy->vals = dict_job_alloc(UINT_MUL(
+            copy->hash.size, sizeof *copy->vals));
+    }
+    if (copy->cache != NULL) {
+        free(copy->cache);
+        copy->cache = dict_job_alloc(
+            sizeof *copy->cache);
+    }
+}
+
+void dict_numa_done(
+    struct dict_numa_t* numa)
+{
+    struct dict_t* dict = numa->dict;
+    size_t i;
+
+    for (i = 0; i < numa->n_nodes; i ++) {
+        struct dict_node_t* n =
+            numa->nodes + i;
+        struct lhash_node_t *p, *e, *q;
+
+        if (!n->used)
+            continue;
+
+        ASSERT(n->hash.size == dict->hash.size);
+
+        for (p = dict->hash.table,
+             e = p + dict->hash.size,
+             q = n->hash.table;
+             p < e;
+             p ++, q ++) {
+            ASSERT_UINT_ADD_NO_OVERFLOW(
+                p->val, q->val);
+            p->val += q->val;
+        }
+
+        free(n->hash.table);
+        free(n->keys);
+    }
+
+    free(numa->nodes);
+}
+
+// stev: class 'dict_pipe_t' counts the words
+// of the input texts by a pipeline of threads:
+// the reader -- the main thread -- reads the
+// input texts in blocks, cut at whitespaces;
+// the tokenizers split the blocks in words;
+// the counters look up the words in the hash
+// table; the words are passed on from the
+// tokenizers to the counters in batches of
+// (hash, pointer, length) tuples; each counter
+// owns the range of the hash table of which
+// positions are the home positions of the
+// words it gets: thus it is the only one that
+// writes to the counters of its words; the
+// blocks are passed on by 'spsc_t' queues:
+// one from the reader to each tokenizer; the
+// batches too: one from each tokenizer to each
+// counter; the blocks are taken out of a pool
+// of bounded size; a block gets back to the
+// pool when its last batch got counted
+
+// stev: absent '-e', given '-j', the standard
+// input is counted by a pipe of no counters:
+// the tokenizers count the words themselves
+
+#define DICT_PIPE_BLOCK_SIZE MB(1)
+#define DICT_PIPE_BATCH_SIZE 512
+#define DICT_PIPE_QUEUE_SIZE 4
+
+struct dict_block_t
+{
+    char* ptr;
+    size_t size;
+    size_t max;
+    // stev: the number of the batches of
+    // the block not yet counted, plus one
+    // while the block is being tokenized;
+    // accessed atomically
+    unsigned refs;
+};
+
+struct dict_token_t
+{
+    const char* ptr;
+    size_t len;
+    uint32_t hash;
+};
+
+struct dict_batch_t
+{
+    size_t block;
+    size_t n_tokens;
+    struct dict_token_t tokens[
+        DICT_PIPE_BATCH_SIZE];
+};
+
+// stev: the queue of batches from
+// a tokenizer to a counter
+struct dict_link_t
+{
+    struct spsc_t queue;
+    struct dict_batch_t batches[
+        DICT_PIPE_QUEUE_SIZE];
+};
+
+struct dict_pipe_t;
+
+struct dict_tokenizer_t
+{
+    struct dict_pipe_t* pipe;
+    struct spsc_t queue;
+    size_t blocks[DICT_PIPE_QUEUE_SIZE];
+    // stev: the links to each of
+    // the counters of the pipe
+    struct dict_link_t* links;
+    // stev: the batch being filled in
+    // for each of the counters, or NULL
+    struct dict_batch_t** batches;
+    size_t block;
+    struct dict_t dict;
+    pthread_t thread;
+};
+
+struct dict_counter_t
+{
+    struct dict_pipe_t* pipe;
+    // stev: bumped by the tokenizers upon
+    // each batch passed on to the counter
+    unsigned event CACHE_ALIGNED;
+    unsigned wait;
+    size_t index;
+    struct lhash_t hash;
+    pthread_t thread;
+};
+
+struct dict_pipe_t
+{
+    struct dict_t* dict;
+    // stev: bumped upon each block that
+    // gets back to the pool
+    unsigned event CACHE_ALIGNED;
+    unsigned wait;
+    struct dict_block_t* blocks;
+    size_t n_blocks;
+    struct dict_tokenizer_t* tokenizers;
+    size_t n_tokenizers;
+    struct dict_counter_t* counters;
+    size_t n_counters;
+    // stev: the index of the tokenizer to
+    // get the next block
+    size_t next;
+    // stev: the trailing partial word of
+    // the last block read in
+    char* carry;
+    size_t carry_size;
+    size_t carry_max;
+    struct dict_numa_t numa;
+};
+
+void dict_pipe_release_block(
+    struct dict_pipe_t* pipe,
+    size_t block)
+{
+    ASSERT(block < pipe->n_blocks);
+
+    if (__atomic_sub_fetch(
+            &pipe->blocks[block].refs, 1,
+            __ATOMIC_ACQ_REL) == 0)
+        spsc_signal(&pipe->event, &pipe->wait);
+}
+
+void dict_tokenizer_commit(
+    struct dict_tokenizer_t* tok,
+    size_t index)
+{
+    struct dict_pipe_t* pipe = tok->pipe;
+    struct dict_counter_t* c =
+        pipe->counters + index;
+
+    ASSERT(tok->batches[index] != NULL);
+    ASSERT(tok->batches[index]->n_tokens > 0);
+
+    __atomic_add_fetch(
+        &pipe->blocks[tok->block].refs, 1,
+        __ATOMIC_ACQ_REL);
+
+    spsc_prod_commit(&tok->links[index].queue);
+    spsc_signal(&c->event, &c->wait);
+
+    tok->batches[index] = NULL;
+}
+
+void dict_tokenizer_emit(
+    struct dict_tokenizer_t* tok,
+    const char* p, size_t n)
+{
+    struct dict_pipe_t* pipe = tok->pipe;
+    uint32_t h = lhash_hash_key(p, n);
+    size_t z = tok->dict.hash.size;
+    size_t i = pipe->n_counters > 1
+        ? (h % z) * pipe->n_counters / z
+        : 0;
+    struct dict_batch_t* b;
+    unsigned s;
+
+    ASSERT(i < pipe->n_counters);
+
+    if ((b = tok->batches[i]) == NULL) {
+        struct dict_link_t* l = tok->links + i;
+
+        // stev: the counters do not close
+        // the queues they consume from
+        VERIFY(spsc_prod_acquire(&l->queue, &s));
+
+        b = tok->batches[i] = l->batches + s;
+        b->block = tok->block;
+        b->n_tokens = 0;
+    }
+
+    b->tokens[b->n_tokens ++] =
+        (struct dict_token_t) {
+            .ptr  = p,
+            .len  = n,
+            .hash = h
+        };
+
+    if (b->n_tokens == DICT_PIPE_BATCH_SIZE)
+        dict_tokenizer_commit(tok, i);
+}
+
+// stev: count the word [p, p + n) with '-g':
+// either into the shared 'chash_t' or else
+// into the hash table of 'dict', inserting
+// the word when not already there
+void dict_count_any_word(
+    struct dict_t* dict,
+    const char* p, size_t n)
+{
+    struct lhash_node_t* e = NULL;
+
+#ifdef CONFIG_USE_48BIT_PTR
+    // stev: the length of the words in the
+    // hash table cannot exceed UINT16_MAX;
+    // the word is still in the total count
+    if (n > UINT16_MAX) {
+        warning("ignoring input word: its length "
+                "%zu exceeds the maximum allowed %" PRIu16,
+                n, UINT16_MAX);
+        return;
+    }
+#endif
+
+    if (dict->words != NULL) {
+        chash_count(dict->words, &dict->keys,
+            p, n, lhash_hash_key(p, n));
+        return;
+    }
+
+    if (!lhash_insert(&dict->hash, p, n, &e)) {
+        ASSERT(e != NULL);
+        ASSERT_UINT_INC_NO_OVERFLOW(e->val);
+        e->val ++;
+        return;
+    }
+
+    ASSERT(e != NULL);
+    LHASH_NODE_INIT(e, key_pool_copy(
+        &dict->keys, p, n), n);
+    e->val = 1;
+}
+
+void dict_count_word(
+    struct dict_t* dict,
+    const char* p, size_t n)
+{
+    struct lhash_node_t* e = NULL;
+
+    if (dict->tokenizer != NULL) {
+        dict_tokenizer_emit(
+            dict->tokenizer, p, n);
+        return;
+    }
+
+    if (dict->all_words) {
+        dict_count_any_word(dict, p, n);
+        return;
+    }
+
+    if (lhash_lookup(&dict->hash, p, n, &e)) {
+        ASSERT(e != NULL);
+        if (dict->vals != NULL) {
+            unsigned* v = dict->vals +
+                PTR_DIFF(e, dict->hash.table);
+            ASSERT_UINT_INC_NO_OVERFLOW(*v);
+            (*v) ++;
+        }
+        else
+        if (dict->cache != NULL)
+            dict_cache_count(dict, e);
+        else
+        if (dict->atomic_vals)
+            DICT_ATOMIC_ADD(&e->val, 1U);
+        else {
+            ASSERT_UINT_INC_NO_OVERFLOW(
+                e->val);
+            e->val ++;
+        }
+    }
+}
+
+// stev: count the words of the non-ASCII text
+// [p, p + k): first split the text at ASCII
+// whitespaces; then split each of the pieces
+// thus obtained at the Unicode separators
+size_t dict_count_utf8(
+    struct dict_t* dict,
+    const char* p, size_t k)
+{
+    size_t w = 0;
+
+    while (k > 0) {
+        // stev: skip over whitespaces
+        size_t s = memspn(p, k, dict->wsp);
+        ASSERT(s <= k);
+        p += s;
+        k -= s;
+
+        // stev: compute piece length
+        size_t n = memcspn(p, k, dict->wsp);
+        if (n == 0) break;
+
+        const char *b = p, *q = p, *e = p + n;
+        while (q < e) {
+            size_t l = 1;
+            if (UCHAR(*q) < 0x80 ||
+                !utf8_is_separator(utf8_decode(
+                    q, PTR_DIFF(e, q), &l))) {
+                q += l;
+                continue;
+            }
+            if (q > b) {
+                dict_count_word(
+                    dict, b, PTR_DIFF(q, b));
+                w ++;
+            }
+            q += l;
+            b = q;
+        }
+        if (e > b) {
+            dict_count_word(
+                dict, b, PTR_DIFF(e, b));
+            w ++;
+        }
+
+        ASSERT(n <= k);
+        p += n;
+        k -= n;
+    }
+
+    return w;
+}
+
+size_t dict_count_text(
+    struct dict_t* dict,
+    const char* p, size_t k)
+{
+    size_t w = 0;
+
+    // stev: the text that is not pure ASCII
+    // takes the slower UTF-8 aware path
+    if (dict->utf8_text &&
+        !memascii(p, k))
+        return dict_count_utf8(
+            dict, p, k);
+
+    while (k > 0) {
+        // stev: skip over whitespaces
+        size_t s = memspn(p, k, dict->wsp);
+        ASSERT(s <= k);
+        p += s;
+        k -= s;
+
+        // stev: compute word length
+        size_t n = memcspn(p, k, dict->wsp);
+        if (n == 0) break;
+        w ++;
+
+        dict_count_word(dict, p, n);
+
+        ASSERT(n <= k);
+        p += n;
+        k -= n;
+    }
+
+    return w;
+}
+
+// stev: count the words of the selected fields
+// of the text line [p, p + k); the bytes of the
+// fields not selected are skipped over by the
+// means of 'memnchr' -- without being tokenized
+size_t dict_count_fields(
+    struct dict_t* dict,
+    const char* p, size_t k)
+{
+    const struct fields_t* f = dict->fields;
+    const struct field_range_t *r, *e;
+    size_t w = 0, i = 0, o;
+
+    ASSERT(f != NULL);
+
+    if (f->skip_len > 0 &&
+        k >= f->skip_len &&
+        !memcmp(p, f->skip, f->skip_len))
+        return 0;
+
+    if (f->n_ranges == 0)
+        return dict_count_text(dict, p, k);
+
+    for (r = f->ranges,
+         e = r + f->n_ranges;
+         r < e;
+         r ++) {
+        // stev: invariant: 'p' points to the
+        // beginning of the field of index 'i'
+        ASSERT(i <= r->lo);
+
+        if (i < r->lo) {
+            o = memnchr(p, k, f->delim,
+                    r->lo - i);
+            if (o >= k)
+                break;
+            p += o + 1;
+            k -= o + 1;
+            i = r->lo;
+        }
+
+        if (r->hi == SIZE_MAX) {
+            w += dict_count_text(dict, p, k);
+            break;
+        }
+
+        ASSERT(r->hi >= i);
+        o = memnchr(p, k, f->delim,
+                r->hi - i + 1);
+        ASSERT(o <= k);
+        w += dict_count_text(dict, p, o);
+
+        if (o >= k)
+            break;
+        p += o + 1;
+        k -= o + 1;
+        i = r->hi + 1;
+    }
+
+    return w;
+}
+
+#ifdef CONFIG_COLLECT_STATISTICS
+
+void dict_auto_stats_add(
+    struct dict_t* dict,
+    enum file_io_type_t type,
+    struct file_io_stats_t stats)
+{
+    struct file_io_stats_t *p, *e;
+    const enum file_io_type_t* t;
+
+    // stev: all candidate types get printed
+    // out, be they used or not, in accordance
+    // with 'dict_print_stat_names'
+    if (!dict->stats.auto_used) {
+        for (p = dict->stats.auto_io,
+             e = p + ARRAY_SIZE(dict->stats.auto_io),
+             t = file_io_auto_types;
+             p < e;
+             p ++, t ++)
+            file_io_stats_init_type(p, *t);
+        dict->stats.auto_used = true;
+    }
+
+    for (p = dict->stats.auto_io,
+         e = p + ARRAY_SIZE(dict->stats.auto_io),
+         t = file_io_auto_types;
+         p < e;
+         p ++, t ++) {
+        if (*t == type)
+            break;
+    }
+    VERIFY(p < e);
+
+    file_io_stats_add(p, stats);
+    file_io_auto_stats_count(
+        &dict->stats.auto_stats, type);
+}
+
+#endif // CONFIG_COLLECT_STATISTICS
+
+// stev: count the words of the input file
+// 'file_name' by the I/O type 'y'; 'fd' is
+// the file opened already, or else is -1
+void dict_count_io(
+    struct dict_t* dict,
+    enum file_io_type_t y,
+    int fd,
+    const char* file_name)
+{
+    struct mem_mgr_t m;
+    struct file_io_t f;
+    size_t w = 0, k;
+    const char* p;
+
+#ifdef CONFIG_COLLECT_STATISTICS
+    uint64_t c = time_now();
+#endif
+    if (y == file_io_type_auto) {
+        if (fd < 0)
+            fd = file_io_open(
+                file_name, "input");
+        y = file_io_auto_type(
+            &dict->io, fd, file_name, "input",
+            file_io_size(fd, file_name, "input"));
+    }
+    bool t = y == file_io_type_map;
+
+    if (t)
+        mem_mgr_init(&m, true);
+
+    file_io_init(
+        &f, y,
+        t ? &m : NULL,
+        &dict->io, fd,
+        file_name, "input");
+
+    while (file_io_get_line(&f, &p, &k)) {
+        w += dict->fields != NULL
+            ? dict_count_fields(dict, p, k)
+            : dict_count_text(dict, p, k);
+    }
+
+#ifdef CONFIG_COLLECT_STATISTICS
+    if (dict->text_io == file_io_type_auto)
+        dict_auto_stats_add(dict, y,
+            file_io_get_stats(&f));
+    else
+        file_io_stats_add(
+            &dict->stats.count_io,
+            file_io_get_stats(&f));
+#endif
+    file_io_done(&f);
+
+    if (t)
+        mem_mgr_done(&m);
+
+    ASSERT_UINT_ADD_NO_OVERFLOW(
+        dict->n_words, w);
+    dict->n_words += w;
+
+#ifdef CONFIG_COLLECT_STATISTICS
+    TIME_ADD(
+        dict->stats.count_time,
+        time_elapsed(c));
+#endif
+}
+
+void dict_count(
+    struct dict_t* dict,
+    const char* file_name)
+{
+    dict_count_io(dict,
+        dict->text_io, -1,
+        file_name);
+}
+
+// stev: count the words of the chunk [p, p + n)
+// of a memory-mapped input file, line by line,
+// as 'dict_count' does; the chunk boundaries
+// must not split words -- or, with '-f', lines
+void dict_count_chunk(
+    struct dict_t* dict,
+    const char* p, size_t n)
+{
+    const char* e = p + n;
+    size_t w = 0;
+
+#ifdef CONFIG_COLLECT_STATISTICS
+    uint64_t c = time_now();
+#endif
+
+    while (p < e) {
+        const char* q = memchr(
+            p, '\n', PTR_DIFF(e, p));
+        size_t k = q != NULL
+            ? PTR_DIFF(q, p)
+            : PTR_DIFF(e, p);
+
+        w += dict->fields != NULL
+            ? dict_count_fields(dict, p, k)
+            : dict_count_text(dict, p, k);
+
+        p += k + (q != NULL);
+    }
+
+    ASSERT_UINT_ADD_NO_OVERFLOW(
+        dict->n_words, w);
+    dict->n_words += w;
+
+#ifdef CONFIG_COLLECT_STATISTICS
+    TIME_ADD(
+        dict->stats.count_time,
+        time_elapsed(c));
+#endif
+}
+
+// stev: class 'dict_jobs_t' counts the input
+// files on several worker threads; each worker
+// is a copy of the 'dict_t' instance, sharing
+// with it the hash table -- of which words are
+// read-only after 'dict_load' --, but counting
+// the words as 'dict_counters_t' prescribes;
+// once all workers are done, their counters and
+// number of words are added up into the
+// 'dict_t' instance; the outcome doesn't depend
+// on which worker counted which chunk of input:
+// sums are the same in any order
+
+#define DICT_JOBS_MAX 1024
+
+// stev: the unit of work of 'dict_jobs_t':
+// either a whole input file, or, given '-c',
+// a range of an input file larger than the
+// chunk size that got mapped in memory
+struct dict_chunk_t
+{
+    const char* name;
+    // stev: NULL when the chunk is the
+    // whole file 'name'
+    const char* ptr;
+    size_t size;
+};
+
+// stev: class 'dict_deque_t' is the deque of
+// chunks of a worker: the owner pushes and pops
+// chunks at the bottom end, while the other
+// workers steal chunks from the top end; the
+// chunks are in [top, bottom)
+struct dict_deque_t
+{
+    pthread_mutex_t lock;
+    struct dict_chunk_t* chunks;
+    size_t top;
+    size_t bottom;
+    size_t max;
+};
+
+#define DICT_DEQUE_LOCK(f)                        \
+    do {                                          \
+        int __r = pthread_mutex_ ## f(            \
+            &deque->lock);                        \
+        if (__r != 0)                             \
+            syslib_error_sys("pthread", #f, __r); \
+    } while (0)
+
+void dict_deque_init(
+    struct dict_deque_t* deque)
+{
+    memset(deque, 0, sizeof *deque);
+
+    int r = pthread_mutex_init(
+        &deque->lock, NULL);
+    if (r != 0)
+        syslib_error_sys("pthread", "init", r);
+}
+
+void dict_deque_done(
+    struct dict_deque_t* deque)
+{
+    pthread_mutex_destroy(&deque->lock);
+    free(deque->chunks);
+}
+
+void dict_deque_push(
+    struct dict_deque_t* deque,
+    const struct dict_chunk_t* chunk)
+{
+    DICT_DEQUE_LOCK(lock);
+
+    if (deque->bottom >= deque->max &&
+        deque->top > 0) {
+        memmove(deque->chunks,
+            deque->chunks + deque->top,
+            (deque->bottom - deque->top) *
+            sizeof *deque->chunks);
+        deque->bottom -= deque->top;
+        deque->top = 0;
+    }
+    if (deque->bottom >= deque->max) {
+        deque->max = deque->max > 0
+            ? UINT_MUL(deque->max, SZ(2))
+            : 16;
+        deque->chunks = realloc(deque->chunks,
+            UINT_MUL(deque->max,
+                sizeof *deque->chunks));
+        VERIFY(deque->chunks != NULL);
+    }
+    deque->chunks[deque->bottom ++] = *chunk;
+
+    DICT_DEQUE_LOCK(unlock);
+}
+
+// stev: take out a chunk from the bottom end
+// when 'own' is true, else from the top end
+bool dict_deque_pop(
+    struct dict_deque_t* deque,
+    struct dict_chunk_t* chunk,
+    bool own)
+{
+    bool r;
+
+    DICT_DEQUE_LOCK(lock);
+
+    ASSERT(deque->top <= deque->bottom);
+    if ((r = deque->top < deque->bottom))
+        *chunk = own
+            ? deque->chunks[-- deque->bottom]
+            : deque->chunks[deque->top ++];
+
+    DICT_DEQUE_LOCK(unlock);
+
+    return r;
+}
+
+#ifdef CONFIG_COLLECT_STATISTICS
+#define DICT_JOB_STATS_INC(n) \
+    do { job->dict.stats.n ++; } while (0)
+#else
+#define DICT_JOB_STATS_INC(n) \
+    do {} while (0)
+#endif
+
+struct dict_jobs_t;
+
+struct dict_job_t
+{
+    struct dict_jobs_t* jobs;
+    struct dict_deque_t deque;
+    struct mem_mgr_t mem;
+    struct file_map_t* maps;
+    size_t n_maps;
+    size_t max_maps;
+    struct dict_t dict;
+    pthread_t thread;
+};
+
+// stev: the workers are scheduled by work-
+// stealing: each starts with a share of the
+// input files in its own deque; a worker out
+// of chunks steals one from the deque of some
+// other worker; the files larger than the chunk
+// size are subdivided lazily: a worker counting
+// a range of such a file cuts off its head and
+// pushes the rest back into its own deque, for
+// itself or for the idle workers to pick up;
+// the workers out of chunks while there still
+// are chunks being counted sleep on an event
+// counter bumped on each push of a chunk
+struct dict_jobs_t
+{
+    // stev: the number of chunks not yet
+    // counted; accessed atomically
+    size_t pending CACHE_ALIGNED;
+    unsigned event CACHE_ALIGNED;
+    unsigned n_idle;
+    size_t n_jobs;
+    struct dict_job_t* jobs;
+    struct dict_numa_t numa;
+};
+
+void dict_jobs_signal(
+    struct dict_jobs_t* jobs)
+{
+    __atomic_add_fetch(&jobs->event, 1,
+        __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&jobs->n_idle,
+            __ATOMIC_SEQ_CST))
+        futex_wake(&jobs->event);
+}
+
+// stev: the end of the chunk [p, p + n) that
+// is at least 'size' bytes long: the first
+// separator at or after 'p + size' -- a
+// whitespace, or, with '-f', the one past
+// a newline
+size_t dict_jobs_chunk_end(
+    const struct dict_t* dict,
+    const char* p, size_t n,
+    size_t size)
+{
+    if (size >= n)
+        return n;
+
+    if (dict->fields != NULL) {
+        const char* q = memchr(
+            p + size, '\n', n - size);
+        return q != NULL
+            ? PTR_DIFF(q + 1, p)
+            : n;
+    }
+    return size + memcspn(
+        p + size, n - size, dict->wsp);
+}
+
+// stev: map in memory the file of 'chunk' if
+// it is to be split; otherwise, pass on to
+// 'dict_count_io' the I/O type of the file,
+// along with the file itself, if opened
+bool dict_job_map(
+    struct dict_job_t* job,
+    struct dict_chunk_t* chunk,
+    enum file_io_type_t* type,
+    int* fd)
+{
+    const struct dict_t* dict = &job->dict;
+    size_t z = dict->chunk_size;
+    struct file_map_t* f;
+
+    ASSERT(chunk->ptr == NULL);
+
+    *type = dict->text_io;
+    *fd = -1;
+
+    // stev: only the files to be mapped in
+    // memory as a whole are split: mapping
+    // a file read by 'file_window_t' would
+    // break the bound on the memory used
+    if (z == 0 || (
+        *type != file_io_type_auto &&
+        *type != file_io_type_map))
+        return false;
+
+    *fd = file_io_open(chunk->name, "input");
+    size_t n = file_io_size(
+        *fd, chunk->name, "input");
+    if (*type == file_io_type_auto)
+        *type = file_io_auto_type(&dict->io,
+            *fd, chunk->name, "input", n);
+
+    if (*type != file_io_type_map ||
+        n == SIZE_MAX || n <= z)
+        return false;
+
+    if (job->n_maps >= job->max_maps) {
+        job->max_maps = job->max_maps > 0
+            ? UINT_MUL(job->max_maps, SZ(2))
+            : 16;
+        job->maps = realloc(job->maps,
+            UINT_MUL(job->max_maps,
+                sizeof *job->maps));
+        VERIFY(job->maps != NULL);
+    }
+    f = job->maps + job->n_maps ++;
+
+    file_map_init(f,
+        mem_mgr_as_map(&job->mem),
+        *fd, chunk->name, "input",
+        dict->io.drop_behind);
+    *fd = -1;
+
+    chunk->ptr  = f->ptr;
+    chunk->size = f->size;
+
+    return true;
+}
+
+void dict_job_count(
+    struct dict_job_t* job,
+    struct dict_chunk_t* chunk)
+{
+    struct dict_jobs_t* jobs = job->jobs;
+    enum file_io_type_t y;
+    int d;
+
+    if (chunk->ptr == NULL &&
+        !dict_job_map(job, chunk, &y, &d))
+        dict_count_io(&job->dict,
+            y, d, chunk->name);
+    else {
+        size_t n = dict_jobs_chunk_end(
+            &job->dict, chunk->ptr, chunk->size,
+            job->dict.chunk_size);
+        ASSERT(n > 0);
+
+        if (n < chunk->size) {
+            struct dict_chunk_t c = {
+                .name = chunk->name,
+                .ptr  = chunk->ptr + n,
+                .size = chunk->size - n
+            };
+            __atomic_add_fetch(&jobs->pending, 1,
+                __ATOMIC_SEQ_CST);
+            dict_deque_push(&job->deque, &c);
+            dict_jobs_signal(jobs);
+        }
+
+        dict_count_chunk(&job->dict,
+            chunk->ptr, n);
+        DICT_JOB_STATS_INC(chunk_count);
+    }
+
+    // stev: the last chunk counted wakes up
+    // all idle workers, for them to exit
+    if (__atomic_sub_fetch(&jobs->pending, 1,
+            __ATOMIC_SEQ_CST) == 0)
+        dict_jobs_signal(jobs);
+}
+
+bool dict_job_next(
+    struct dict_job_t* job,
+    struct dict_chunk_t* chunk)
+{
+    struct dict_jobs_t* jobs = job->jobs;
+    size_t i, k = PTR_DIFF(job, jobs->jobs);
+
+    while (true) {
+        unsigned e = __atomic_load_n(
+            &jobs->event, __ATOMIC_SEQ_CST);
+
+        if (dict_deque_pop(
+                &job->deque, chunk, true))
+            return true;
+
+        for (i = 1; i < jobs->n_jobs; i ++) {
+            struct dict_job_t* v = jobs->jobs +
+                (k + i) % jobs->n_jobs;
+
+            if (dict_deque_pop(
+                    &v->deque, chunk, false)) {
+                DICT_JOB_STATS_INC(steal_count);
+                return true;
+            }
+        }
+
+        if (!__atomic_load_n(&jobs->pending,
+                __ATOMIC_SEQ_CST))
+            return false;
+
+        // stev: announce the wait prior to
+        // re-checking, for the pushers not
+        // to skip waking this worker up
+        __atomic_add_fetch(&jobs->n_idle, 1,
+            __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&jobs->pending,
+                __ATOMIC_SEQ_CST))
+            futex_wait(&jobs->event, e);
+        __atomic_sub_fetch(&jobs->n_idle, 1,
+            __ATOMIC_SEQ_CST);
+    }
+}
+
+void* dict_job_run(void* arg)
+{
+    struct dict_job_t* job = arg;
+    struct dict_jobs_t* jobs = job->jobs;
+    struct dict_chunk_t c;
+
+    dict_numa_enter(&jobs->numa,
+        PTR_DIFF(job, jobs->jobs),
+        &job->dict, NULL);
+
+    while (dict_job_next(job, &c))
+        dict_job_count(job, &c);
+
+    // stev: the other workers may still be
+    // counting: the flush must be atomic
+    if (job->dict.cache != NULL)
+        dict_cache_flush(job->dict.cache);
+
+    return NULL;
+}
+
+// stev: make 'copy' a copy of 'dict' to be
+// used by a thread of its own; when 'count'
+// is false, the copy only splits the text
+// in words, but does not count them
+void dict_copy_init(
+    struct dict_t* copy,
+    const struct dict_t* dict,
+    bool count)
+{
+    struct dict_t* d = copy;
+
+    *d = *dict;
+
+    // stev: the prefetching is done only
+    // when counting on a single thread
+    d->io.prefetch_size = 0;
+    d->n_words = 0;
+
+    // stev: with '-g', the words are counted
+    // under 'shard' into a private hash table
+    // and otherwise into the shared 'chash_t';
+    // either way, the copies of the words are
+    // kept in a pool of the worker's own
+    if (d->all_words) {
+        ASSERT(count);
+        key_pool_init(&d->keys);
+        if (d->words == NULL)
+            lhash_init(&d->hash, dict->hash.size);
+    }
+    else
+    // stev: the private counters are kept in
+    // whole cache lines of their own, for the
+    // workers not to share any cache line
+    if (count)
+    switch (d->counters) {
+    case dict_counters_shard:
+        d->vals = dict_job_alloc(UINT_MUL(
+            d->hash.size, sizeof *d->vals));
+        break;
+    case dict_counters_hybrid:
+        d->cache = dict_job_alloc(
+            sizeof *d->cache);
+        break;
+    case dict_counters_atomic:
+        d->atomic_vals = true;
+        break;
+    default:
+        UNEXPECT_VAR("%d", d->counters);
+    }
+
+    file_buf_pool_init(&d->pool);
+    d->io.buf_pool = &d->pool;
+
+#ifdef CONFIG_COLLECT_STATISTICS
+    memset(&d->hash.stats, 0,
+        sizeof d->hash.stats);
+    memset(&d->stats, 0,
+        sizeof d->stats);
+    file_io_stats_init(
+        &d->stats.count_io);
+#endif
+}
+
+void dict_copy_done(
+    struct dict_t* copy)
+{
+    if (copy->all_words) {
+        if (copy->words == NULL)
+            lhash_done(&copy->hash);
+        key_pool_done(&copy->keys);
+    }
+
+    file_buf_pool_done(&copy->pool);
+    free(copy->cache);
+    free(copy->vals);
+}
+
+void dict_job_init(
+    struct dict_job_t* job,
+    struct dict_jobs_t* jobs,
+    const struct dict_t* dict)
+{
+    memset(job, 0, sizeof *job);
+
+    job->jobs = jobs;
+
+    dict_deque_init(&job->deque);
+    mem_mgr_init(&job->mem, true);
+
+    dict_copy_init(&job->dict, dict, true);
+}
+
+// stev: the mappings of a worker may hold
+// chunks stolen by the other workers: they
+// are released only after all workers are
+// done
+void dict_job_done(
+    struct dict_job_t* job)
+{
+    size_t i;
+
+    for (i = 0; i < job->n_maps; i ++)
+        file_map_done(job->maps + i);
+    mem_mgr_done(&job->mem);
+    free(job->maps);
+
+    dict_deque_done(&job->deque);
+    dict_copy_done(&job->dict);
+}
+
+#ifdef CONFIG_COLLECT_STATISTICS
+
+void dict_job_stats_add(
+    struct dict_t* dict,
+    const struct dict_t* job)
+{
+    const struct dict_stats_t* s =
+        &job->stats;
+
+    stat_params_add(
+        lhash_stat_params(),
+        &dict->hash.stats,
+        &job->hash.stats);
+
+    if (s->count_io.type !=
+        file_io_stats_type_null)
+        file_io_stats_add(
+            &dict->stats.count_io,
+            s->count_io);
+
+    if (s->auto_used &&
+        !dict->stats.auto_used) {
+        memcpy(dict->stats.auto_io, s->auto_io,
+            sizeof dict->stats.auto_io);
+        dict->stats.auto_stats = s->auto_stats;
+        dict->stats.auto_used = true;
+    }
+    else
+    if (s->auto_used) {
+        size_t i;
+
+        for (i = 0; i < ARRAY_SIZE(s->auto_io); i ++)
+            file_io_stats_add(
+                dict->stats.auto_io + i,
+                s->auto_io[i]);
+        stat_params_add(
+            file_io_auto_stat_params(),
+            &dict->stats.auto_stats,
+            &s->auto_stats);
+    }
+
+    ASSERT_UINT_ADD_NO_OVERFLOW(
+        dict->stats.chunk_count,
+        s->chunk_count);
+    dict->stats.chunk_count +=
+        s->chunk_count;
+
+    ASSERT_UINT_ADD_NO_OVERFLOW(
+        dict->stats.steal_count,
+        s->steal_count);
+    dict->stats.steal_count +=
+        s->steal_count;
+
+    TIME_ADD(
+        dict->stats.count_time,
+        s->count_time);
+}
+
+#endif // CONFIG_COLLECT_STATISTICS
+
+// stev: add the words counted by a worker with
+// '-g' into the hash table of 'dict', taking
+// over the copies of the words too
+void dict_words_merge(
+    struct dict_t* dict,
+    struct dict_t* job)
+{
+    struct lhash_node_t *p, *e, *n;
+
+    // stev: under 'atomic' and 'hybrid' the
+    // words are in the shared 'chash_t'
+    for (p = job->hash.table,
+         e = job->words == NULL
+            ? p + job->hash.size : p;
+         p < e;
+         p ++) {
+        const char* k = LHASH_NODE_KEY(p);
+        size_t l = LHASH_NODE_LEN(p);
+
+        if (k == NULL)
+            continue;
+
+        if (lhash_insert(&dict->hash, k, l, &n))
+            LHASH_NODE_INIT(n, k, l);
+        ASSERT_UINT_ADD_NO_OVERFLOW(
+            n->val, p->val);
+        n->val += p->val;
+    }
+
+    key_pool_move(&dict->keys, &job->keys);
+}
+
+void dict_job_merge(
+    struct dict_t* dict,
+    struct dict_t* job)
+{
+    struct lhash_node_t *p, *e;
+    const unsigned* v;
+
+    if (job->all_words)
+        dict_words_merge(dict, job);
+
+    // stev: the job may have looked up into
+    // a replica of the hash table, of same
+    // layout as the hash table itself
+    ASSERT(job->all_words ||
+        job->hash.size == dict->hash.size);
+
+    // stev: under 'atomic' and 'hybrid' the
+    // hash table's counters are already set
+    for (p = dict->hash.table,
+         e = job->vals != NULL
+            ? p + dict->hash.size : p,
+         v = job->vals;
+         p < e;
+         p ++, v ++) {
+        ASSERT_UINT_ADD_NO_OVERFLOW(
+            p->val, *v);
+        p->val += *v;
+    }
+
+    ASSERT_UINT_ADD_NO_OVERFLOW(
+        dict->n_words, job->n_words);
+    dict->n_words += job->n_words;
+
+#ifdef CONFIG_COLLECT_STATISTICS
+    dict_job_stats_add(dict, job);
+#endif
+}
+
+// stev: with '-g', under 'atomic' and 'hybrid',
+// the workers count the words into one shared
+// 'chash_t' instance
+void dict_words_init(
+    struct dict_t* dict)
 {
-    memset(file, 0, sizeof *file);
+    ASSERT(dict->words == NULL);
 
-    file->mem  = mem;
-    file->name = name;
-    file->ctxt = ctxt;
+    if (!dict->all_words ||
+        dict->counters == dict_counters_shard)
+        return;
 
-    int fd;
-    if (name == NULL)
-        fd = 0;
-    else {
-        fd = open(name, O_RDONLY);
-        if (fd < 0)
-            FILE_MAP_IO_ERROR(open);
-    }
+    dict->words = malloc(sizeof *dict->words);
+    VERIFY(dict->words != NULL);
 
-    struct stat fs;
-    if (fstat(fd, &fs) < 0)
-        FILE_MAP_IO_ERROR(stat);
+    chash_init(dict->words, dict->hash.size);
+}
 
-    if (!S_ISREG(fs.st_mode))
-        FILE_MAP_IO_ERROR_FMT(stat,
-            "not a regular file");
+// stev: move the words counted into the shared
+// 'chash_t' instance to the hash table of 'dict'
+// -- once all workers are done; the copies of
+// the words were already taken over from the
+// workers by 'dict_job_merge'
+void dict_words_done(
+    struct dict_t* dict)
+{
+    struct chash_table_t* t;
+    struct lhash_node_t* n;
+    size_t i;
 
-    off_t size = fs.st_size;
-    char* ptr = mmap(NULL, size,
-        PROT_READ, MAP_PRIVATE,
-        fd, 0);
-    ASSERT(ptr != NULL);
+    if (dict->words == NULL)
+        return;
 
-    if (ptr == MAP_FAILED)
-        FILE_MAP_IO_ERROR(mmap);
+    // stev: the last word counted may have made
+    // its table be grown, with no later count to
+    // move the table over to the next one
+    while ((t = dict->words->table)->next != NULL)
+        chash_move(dict->words, t);
 
-    if (close(fd) < 0)
-        FILE_MAP_IO_ERROR(close);
+    for (i = 0; i < t->size; i ++) {
+        const struct chash_slot_t* s =
+            t->slots + i;
+        const struct chash_key_t* k = s->key;
+        size_t l;
 
-    file->ptr  = ptr;
-    file->size = INT_AS_SIZE(size);
-    file->node = mem_map_append(
-        file->mem, file->ptr, file->size);
-    ASSERT(file->node != NULL);
+        if (k == NULL || k == CHASH_MOVED)
+            continue;
 
-    mem_map_node_set_type(
-        file->node, mem_map_type_sequential);
-}
+        l = k->len;
+        ASSERT(s->val <= UINT_MAX);
+        VERIFY(lhash_insert(&dict->hash,
+            k->ptr, l, &n));
+        LHASH_NODE_INIT(n, k->ptr, l);
+        n->val = s->val;
+    }
 
-void file_map_done(
-    struct file_map_t* file)
-{
-    mem_map_node_set_type(
-        file->node, mem_map_type_random);
+    chash_done(dict->words);
+    free(dict->words);
+    dict->words = NULL;
 }
 
-bool file_map_get_line(
-    struct file_map_t* file,
-    char const** ptr,
-    size_t* len)
+// stev: tell ahead of time whether the input
+// file 'name' is to be split by 'dict_job_map';
+// the compressed files of '-i auto' are taken
+// to be split, for not opening them here
+bool dict_jobs_split(
+    const struct dict_t* dict,
+    const char* name)
 {
-#ifdef CONFIG_COLLECT_STATISTICS
-    uint64_t c = time_now();
-#endif
-
-    size_t sz = file->size;
-    size_t ln = file->line;
+    size_t z = dict->chunk_size;
+    struct stat s;
 
-    // stev: main invariant:
-    ASSERT(ln <= sz);
-    size_t n = sz - ln;
+    if (z == 0 || (
+        dict->text_io != file_io_type_auto &&
+        dict->text_io != file_io_type_map) ||
+        stat(name, &s) < 0 ||
+        !S_ISREG(s.st_mode))
+        return false;
 
-    if (n == 0) {
-#ifdef CONFIG_COLLECT_STATISTICS
-        TIME_ADD(
-            file->stats.getline_time,
-            time_elapsed(c));
-#endif
+    size_t n = INT_AS_SIZE(s.st_size);
+    if (n <= z)
         return false;
+
+    return dict->text_io == file_io_type_map ||
+        (n >= dict->io.auto_map_min &&
+         n <= dict->io.map_window);
+}
+
+void dict_jobs_count(
+    struct dict_t* dict,
+    char const* const* file_names,
+    size_t n_file_names)
+{
+    struct dict_jobs_t j;
+    size_t i;
+    int r;
+
+    ASSERT(dict->n_jobs > 1);
+    ASSERT(n_file_names > 0);
+
+    memset(&j, 0, sizeof j);
+
+    // stev: a single file is worth more
+    // than one worker only when split
+    j.n_jobs = dict->n_jobs < n_file_names
+        ? dict->n_jobs : n_file_names;
+    for (i = 0; j.n_jobs < dict->n_jobs &&
+            i < n_file_names; i ++) {
+        if (dict_jobs_split(
+                dict, file_names[i]))
+            j.n_jobs = dict->n_jobs;
+    }
+    j.pending = n_file_names;
+
+    j.jobs = calloc(j.n_jobs, sizeof *j.jobs);
+    VERIFY(j.jobs != NULL);
+
+    dict_words_init(dict);
+
+    for (i = 0; i < j.n_jobs; i ++)
+        dict_job_init(j.jobs + i, &j, dict);
+
+    dict_numa_init(&j.numa, dict, j.n_jobs);
+
+    // stev: deal the files out to the workers;
+    // each worker pops its own chunks from the
+    // bottom of its deque, thus the files are
+    // pushed in reverse order, for each worker
+    // to count its share of files in order
+    for (i = n_file_names; i > 0; i --) {
+        struct dict_chunk_t c = {
+            .name = file_names[i - 1]
+        };
+        ASSERT(c.name != NULL);
+        dict_deque_push(
+            &j.jobs[(i - 1) % j.n_jobs].deque,
+            &c);
     }
-    // => n > 0
 
-    char* b = file->ptr + ln;
-    char* p = memchr(b, '\n', n);
-    // => p == NULL || b <= p < b + n
+    for (i = 0; i < j.n_jobs; i ++) {
+        struct dict_job_t* b = j.jobs + i;
 
-    size_t d = p != NULL
-        ? PTR_DIFF(p + 1, b)
-        : n;
-    // stev: 0 < d <= n:
-    // (a) p != NULL => b <= p < b + n
-    //              <=> 0 <= p - b < n
-    //              <=> 1 <= d = p + 1 - b < n + 1
-    //              <=> 0 < d <= n
-    // (b) p == NULL => d = n > 0
-    // => in all cases: 0 < d <= n
-    ASSERT(d <= n);
-    ASSERT(d > 0);
+        r = pthread_create(&b->thread, NULL,
+                dict_job_run, b);
+        if (r != 0)
+            syslib_error_sys("pthread", "create", r);
+    }
 
-    *ptr = b;
-    *len = d - (p != NULL);
+    // stev: merging in the order of the jobs
+    // keeps the statistics deterministic too
+    for (i = 0; i < j.n_jobs; i ++) {
+        struct dict_job_t* b = j.jobs + i;
 
-    // stev: main invariant is preserved:
-    // d <= n <=> ln + d <= ln + n
-    //                   == ln + sz - ln
-    //                   == sz
-    //        <=> ln + d <= sz
-    file->line += d;
+        r = pthread_join(b->thread, NULL);
+        if (r != 0)
+            syslib_error_sys("pthread", "join", r);
 
-#ifdef CONFIG_COLLECT_STATISTICS
-    TIME_ADD(
-        file->stats.getline_time,
-        time_elapsed(c));
-#endif
-    return true;
-}
+        dict_job_merge(dict, &b->dict);
+    }
 
-#ifdef CONFIG_COLLECT_STATISTICS
+    dict_numa_done(&j.numa);
+    dict_words_done(dict);
 
-void file_map_stats_init(
-    struct file_map_stats_t* stats,
-    const struct file_map_t* map)
-{
-    memcpy(stats, &map->stats, sizeof *stats);
-}
+    for (i = 0; i < j.n_jobs; i ++)
+        dict_job_done(j.jobs + i);
 
-const struct stat_params_t*
-    file_map_stat_params(void)
-{
-#undef  CASE
-#define CASE(n, t) \
-    STAT_PARAM_DEF(file_map_stats_t, n, t)
-    static const struct stat_param_t params[] = {
-        CASE(getline_time, time),
-    };
-    static const struct stat_params_t stat = {
-        .n_params = ARRAY_SIZE(params),
-        .params = params,
-        .name = "map"
-    };
-    return &stat;
+    free(j.jobs);
 }
 
-void file_map_stats_add(
-    struct file_map_stats_t* stats,
-    const struct file_map_stats_t* stats2)
+// stev: the end of the prefix of [p, p + n)
+// made of whole words -- or, with '-f', whole
+// lines; 0 when there is no such prefix
+size_t dict_pipe_cut(
+    const struct dict_t* dict,
+    const char* p, size_t n)
 {
-    stat_params_add(
-        file_map_stat_params(),
-        stats, stats2);
+    if (dict->fields != NULL) {
+        const char* q = memrchr(p, '\n', n);
+        return q != NULL
+            ? PTR_DIFF(q + 1, p) : 0;
+    }
+    while (n > 0 && !dict->wsp[UCHAR(p[n - 1])])
+        n --;
+    return n;
 }
 
-void file_map_stats_print_names(
-    const char* name,
-    FILE* file)
+void* dict_tokenizer_run(void* arg)
 {
-    stat_params_print_names(
-        file_map_stat_params(),
-        name, file);
+    struct dict_tokenizer_t* tok = arg;
+    struct dict_pipe_t* pipe = tok->pipe;
+    size_t i;
+    unsigned s;
+
+    dict_numa_enter(&pipe->numa,
+        PTR_DIFF(tok, pipe->tokenizers),
+        &tok->dict, NULL);
+
+    while (spsc_cons_acquire(&tok->queue, &s)) {
+        const struct dict_block_t* b;
+
+        tok->block = tok->blocks[s];
+        spsc_cons_release(&tok->queue);
+
+        ASSERT(tok->block < pipe->n_blocks);
+        b = pipe->blocks + tok->block;
+
+        dict_count_chunk(&tok->dict,
+            b->ptr, b->size);
+
+        // stev: the batches do not span
+        // more than one block
+        for (i = 0; i < pipe->n_counters; i ++) {
+            if (tok->batches[i] != NULL)
+                dict_tokenizer_commit(tok, i);
+        }
+
+        dict_pipe_release_block(
+            pipe, tok->block);
+    }
+
+    for (i = 0; i < pipe->n_counters; i ++) {
+        struct dict_counter_t* c =
+            pipe->counters + i;
+
+        spsc_close(&tok->links[i].queue);
+        spsc_signal(&c->event, &c->wait);
+    }
+
+    // stev: the other tokenizers may still be
+    // counting: the flush must be atomic
+    if (tok->dict.cache != NULL)
+        dict_cache_flush(tok->dict.cache);
+
+    return NULL;
 }
 
-void file_map_stats_print(
-    const struct file_map_stats_t* stats,
-    const char* name, FILE* file)
+void dict_counter_count(
+    struct dict_counter_t* cnt,
+    const struct dict_batch_t* batch)
 {
-    stat_params_print(
-        file_map_stat_params(),
-        stats, name, file);
-}
+    const struct dict_token_t *p, *e;
+    struct lhash_node_t* n;
 
-enum file_io_stats_type_t {
-    file_io_stats_type_null,
-    file_io_stats_type_buf,
-    file_io_stats_type_map
-};
+    for (p = batch->tokens,
+         e = p + batch->n_tokens;
+         p < e;
+         p ++) {
+        if (!lhash_lookup_hash(&cnt->hash,
+                p->ptr, p->len, p->hash, &n))
+            continue;
+        ASSERT(n != NULL);
+        ASSERT_UINT_INC_NO_OVERFLOW(n->val);
+        n->val ++;
+    }
 
-struct file_io_stats_t
+    dict_pipe_release_block(
+        cnt->pipe, batch->block);
+}
+
+void* dict_counter_run(void* arg)
 {
-    union {
-        struct {}               null;
-        struct file_buf_stats_t buf;
-        struct file_map_stats_t map;
-    };
-    enum file_io_stats_type_t type;
+    struct dict_counter_t* cnt = arg;
+    struct dict_pipe_t* pipe = cnt->pipe;
+    size_t i, k;
+    unsigned s;
 
-    void (*add)(
-        void*, const void*);
-    void (*print)(
-        const void*,
-        const char*,
-        FILE*);
-};
+    // stev: the counters are placed after
+    // the tokenizers
+    dict_numa_enter(&pipe->numa,
+        pipe->n_tokenizers + cnt->index,
+        NULL, &cnt->hash);
 
-void file_null_stats_add(
-    struct file_io_stats_t* stats UNUSED,
-    const struct file_io_stats_t* stats2 UNUSED)
-{ /* stev: nop */ }
+    while (true) {
+        unsigned e = SPSC_LOAD_SEQ(&cnt->event);
+        bool b = false;
+
+        for (i = 0, k = 0; i < pipe->n_tokenizers; i ++) {
+            struct dict_link_t* l =
+                pipe->tokenizers[i].links +
+                cnt->index;
+
+            // stev: a queue is done when found
+            // closed prior to being emptied
+            if (!SPSC_LOAD_SEQ(&l->queue.closed))
+                k ++;
+
+            while (spsc_cons_try_acquire(
+                        &l->queue, &s)) {
+                dict_counter_count(
+                    cnt, l->batches + s);
+                spsc_cons_release(&l->queue);
+                b = true;
+            }
+        }
 
-void file_null_stats_print(
-    const struct file_io_stats_t* stats UNUSED,
-    const char* name UNUSED,
-    FILE* file UNUSED)
-{ /* stev: nop */ }
+        if (k == 0)
+            break;
+        if (b)
+            continue;
 
-#endif // CONFIG_COLLECT_STATISTICS
+        SPSC_STORE_SEQ(&cnt->wait, 1);
+        if (SPSC_LOAD_SEQ(&cnt->event) == e)
+            futex_wait(&cnt->event, e);
+        SPSC_STORE_SEQ(&cnt->wait, 0);
+    }
 
-enum file_io_type_t {
-    file_io_type_buf,
-    file_io_type_map
-};
+    return NULL;
+}
 
-struct file_io_t
+// stev: take out of the pool a block not in
+// use; wait for one, if there is none
+struct dict_block_t* dict_pipe_get_block(
+    struct dict_pipe_t* pipe)
 {
-    union {
-        struct file_buf_t buf;
-        struct file_map_t map;
-    };
-    enum file_io_type_t type;
-
-    void  *impl;
-    void (*done)(void*);
-    bool (*get_line)(void*,
-        char const**, size_t*);
-};
+    struct dict_block_t *p, *e;
 
-#define FILE_IO_INIT(n, ...)         \
-    do {                             \
-        file->type =                 \
-            file_io_type_ ## n;      \
-        file_ ## n ## _init(         \
-            file->impl = &file->n,   \
-            ## __VA_ARGS__);         \
-        file->done =                 \
-            (void (*)(void*))        \
-            file_ ## n ## _done;     \
-        file->get_line =             \
-            (bool (*)(void*,         \
-                char const**,        \
-                size_t*))            \
-            file_ ## n ## _get_line; \
-    } while (0)
+    while (true) {
+        unsigned v = SPSC_LOAD_SEQ(&pipe->event);
 
-void file_io_init(
-    struct file_io_t* file,
-    struct mem_mgr_t* mem,
-    size_t io_buf_size,
-    const char* name,
-    const char* ctxt)
-{
-    if (mem != NULL &&
-        mem->type == mem_mgr_type_map)
-        FILE_IO_INIT(map,
-            mem_mgr_as_map(mem),
-            name, ctxt);
-    else
-        FILE_IO_INIT(buf,
-            mem != NULL
-            ? mem_mgr_as_buf(mem)
-            : NULL,
-            name, ctxt,
-            io_buf_size);
+        for (p = pipe->blocks,
+             e = p + pipe->n_blocks;
+             p < e;
+             p ++) {
+            if (!__atomic_load_n(&p->refs,
+                    __ATOMIC_ACQUIRE))
+                return p;
+        }
+
+        SPSC_STORE_SEQ(&pipe->wait, 1);
+        if (SPSC_LOAD_SEQ(&pipe->event) == v)
+            futex_wait(&pipe->event, v);
+        SPSC_STORE_SEQ(&pipe->wait, 0);
+    }
 }
 
-void file_io_done(
-    struct file_io_t* file)
+void dict_pipe_put_block(
+    struct dict_pipe_t* pipe,
+    struct dict_block_t* block)
 {
-    file->done(file->impl);
+    struct dict_tokenizer_t* t =
+        pipe->tokenizers + pipe->next;
+    unsigned s;
+
+    if (++ pipe->next == pipe->n_tokenizers)
+        pipe->next = 0;
+
+    // stev: the guard reference, dropped
+    // once the block got tokenized
+    block->refs = 1;
+
+    VERIFY(spsc_prod_acquire(&t->queue, &s));
+    t->blocks[s] = PTR_DIFF(block, pipe->blocks);
+    spsc_prod_commit(&t->queue);
 }
 
-bool file_io_get_line(
-    struct file_io_t* file,
-    char const** ptr,
-    size_t* len)
+#define DICT_PIPE_RESIZE(p, m, n)          \
+    do {                                   \
+        if ((m) >= (n))                    \
+            break;                         \
+        (m) = (n);                         \
+        (p) = realloc(p, m);               \
+        VERIFY((p) != NULL);               \
+    } while (0)
+
+void dict_pipe_read(
+    struct dict_pipe_t* pipe,
+    const char* name)
 {
-    return file->get_line(
-        file->impl, ptr, len);
+    struct dict_block_t* b;
+    int fd;
+
+    if (name == NULL)
+        fd = 0;
+    else {
+        fd = open(name, O_RDONLY);
+        if (fd < 0)
+            IO_ERROR_SYS(open, "input", name);
+    }
+
+    ASSERT(pipe->carry_size == 0);
+
+    while (true) {
+        size_t n = pipe->carry_size;
+        bool eof = false;
+
+        b = dict_pipe_get_block(pipe);
+
+        DICT_PIPE_RESIZE(b->ptr, b->max,
+            UINT_ADD(n, DICT_PIPE_BLOCK_SIZE));
+
+        if (n > 0)
+            memcpy(b->ptr, pipe->carry, n);
+        pipe->carry_size = 0;
+
+        while (true) {
+            ssize_t r;
+            size_t k;
+
+            while (n < b->max) {
+                r = read(fd, b->ptr + n, b->max - n);
+                if (r < 0 && errno == EINTR)
+                    continue;
+                if (r < 0)
+                    IO_ERROR_SYS(read, "input", name);
+                if (r == 0) {
+                    eof = true;
+                    break;
+                }
+                n += INT_AS_SIZE(r);
+            }
+            if (eof)
+                break;
+
+            k = dict_pipe_cut(
+                    pipe->dict, b->ptr, n);
+            if (k > 0) {
+                // stev: carry over the trailing
+                // partial word to the next block
+                DICT_PIPE_RESIZE(pipe->carry,
+                    pipe->carry_max, n - k);
+                memcpy(pipe->carry, b->ptr + k,
+                    n - k);
+                pipe->carry_size = n - k;
+                n = k;
+                break;
+            }
+
+            // stev: a word -- or, with '-f', a
+            // line -- as long as the block: the
+            // block has to grow
+            DICT_PIPE_RESIZE(b->ptr, b->max,
+                UINT_MUL(b->max, SZ(2)));
+        }
+
+        b->size = n;
+        if (n > 0)
+            dict_pipe_put_block(pipe, b);
+        if (eof)
+            break;
+    }
+
+    if (name != NULL &&
+        close(fd) < 0)
+        IO_ERROR_SYS(close, "input", name);
 }
 
+void dict_pipe_init(
+    struct dict_pipe_t* pipe,
+    struct dict_t* dict)
+{
+    size_t i, j;
+    int r;
+
+    memset(pipe, 0, sizeof *pipe);
+
+    pipe->dict = dict;
+
+    // stev: absent '-e', the pipe is made of
+    // the '-j' workers counting by themselves
+    // the words of the blocks of the standard
+    // input, as specified by '-t'
+    if (dict->n_tokenizers > 0) {
+        ASSERT(dict->n_counters > 0);
+        pipe->n_tokenizers = dict->n_tokenizers;
+        pipe->n_counters = dict->n_counters;
+    }
+    else {
+        ASSERT(dict->n_jobs > 1);
+        pipe->n_tokenizers = dict->n_jobs;
+        pipe->n_counters = 0;
+    }
+
+    // stev: the blocks queued to, or being
+    // tokenized by, each of the tokenizers,
+    // plus the one being read in
+    pipe->n_blocks = UINT_ADD(UINT_MUL(
+        pipe->n_tokenizers, SZ(
+            DICT_PIPE_QUEUE_SIZE + 1)), SZ(1));
+    pipe->blocks = calloc(pipe->n_blocks,
+        sizeof *pipe->blocks);
+    VERIFY(pipe->blocks != NULL);
+
+    dict_words_init(dict);
+
+    // stev: the queues and the events are
+    // kept in cache lines of their own
+    pipe->tokenizers = dict_job_alloc(UINT_MUL(
+        pipe->n_tokenizers, sizeof *pipe->tokenizers));
+    if (pipe->n_counters > 0)
+        pipe->counters = dict_job_alloc(UINT_MUL(
+            pipe->n_counters, sizeof *pipe->counters));
+
+    for (i = 0; i < pipe->n_tokenizers; i ++) {
+        struct dict_tokenizer_t* t =
+            pipe->tokenizers + i;
+
+        t->pipe = pipe;
+        spsc_init(&t->queue, DICT_PIPE_QUEUE_SIZE);
+
+        if (pipe->n_counters == 0) {
+            dict_copy_init(&t->dict, dict, true);
+            continue;
+        }
+
+        t->links = dict_job_alloc(UINT_MUL(
+            pipe->n_counters, sizeof *t->links));
+        for (j = 0; j < pipe->n_counters; j ++)
+            spsc_init(&t->links[j].queue,
+                DICT_PIPE_QUEUE_SIZE);
+
+        t->batches = calloc(pipe->n_counters,
+            sizeof *t->batches);
+        VERIFY(t->batches != NULL);
+
+        dict_copy_init(&t->dict, dict, false);
+        t->dict.tokenizer = t;
+    }
+
+    for (i = 0; i < pipe->n_counters; i ++) {
+        struct dict_counter_t* c =
+            pipe->counters + i;
+
+        c->pipe = pipe;
+        c->index = i;
+        c->hash = dict->hash;
 #ifdef CONFIG_COLLECT_STATISTICS
+        memset(&c->hash.stats, 0,
+            sizeof c->hash.stats);
+#endif
+    }
 
-#define FILE_IO_AS_(t)             \
-    ({                             \
-        VERIFY(                    \
-            file->type ==          \
-            file_io_type_ ## t);   \
-        (struct file_ ## t ## _t*) \
-            file->impl;            \
-    })
+    dict_numa_init(&pipe->numa, dict,
+        pipe->n_tokenizers + pipe->n_counters);
 
-struct file_buf_t*
-    file_io_as_buf(const struct file_io_t* file)
-{ return FILE_IO_AS_(buf); }
+    for (i = 0; i < pipe->n_counters; i ++) {
+        struct dict_counter_t* c =
+            pipe->counters + i;
 
-struct file_map_t*
-    file_io_as_map(const struct file_io_t* file)
-{ return FILE_IO_AS_(map); }
+        r = pthread_create(&c->thread, NULL,
+                dict_counter_run, c);
+        if (r != 0)
+            syslib_error_sys("pthread", "create", r);
+    }
 
-#define FILE_IO_STATS_INIT_(n)          \
-    do {                                \
-        stats->type =                   \
-            file_io_stats_type_ ## n;   \
-        STATIC(offsetof(struct          \
-            file_io_stats_t, n) == 0);  \
-        stats->add =                    \
-            (void (*)(void*,            \
-                const void*))           \
-            file_ ## n ## _stats_add;   \
-        stats->print =                  \
-            (void (*)(const void*,      \
-                const char*,            \
-                FILE*))                 \
-            file_ ## n ## _stats_print; \
-    } while (0)
-#define FILE_IO_STATS_INIT(n, ...)      \
-    do {                                \
-        FILE_IO_STATS_INIT_(n);         \
-        file_ ## n ## _stats_init(      \
-            (void*) stats, ##           \
-            __VA_ARGS__);               \
-    } while (0)
+    for (i = 0; i < pipe->n_tokenizers; i ++) {
+        struct dict_tokenizer_t* t =
+            pipe->tokenizers + i;
 
-void file_io_stats_init(
-    struct file_io_stats_t* stats)
-{
-    FILE_IO_STATS_INIT_(null);
+        r = pthread_create(&t->thread, NULL,
+                dict_tokenizer_run, t);
+        if (r != 0)
+            syslib_error_sys("pthread", "create", r);
+    }
 }
 
-void file_io_stats_init_from_file(
-    struct file_io_stats_t* stats,
-    const struct file_io_t* file)
+void dict_pipe_done(
+    struct dict_pipe_t* pipe)
 {
-    switch (file->type) {
+    struct dict_t* dict = pipe->dict;
+    size_t i;
+    int r;
 
-    case file_io_type_buf:
-        FILE_IO_STATS_INIT(
-            buf, file_io_as_buf(file));
-        break;
+    for (i = 0; i < pipe->n_tokenizers; i ++)
+        spsc_close(&pipe->tokenizers[i].queue);
 
-    case file_io_type_map:
-        FILE_IO_STATS_INIT(
-            map, file_io_as_map(file));
-        break;
+    for (i = 0; i < pipe->n_tokenizers; i ++) {
+        struct dict_tokenizer_t* t =
+            pipe->tokenizers + i;
 
-    default:
-        UNEXPECT_VAR("%d", file->type);
+        r = pthread_join(t->thread, NULL);
+        if (r != 0)
+            syslib_error_sys("pthread", "join", r);
+    }
+
+    for (i = 0; i < pipe->n_counters; i ++) {
+        struct dict_counter_t* c =
+            pipe->counters + i;
+
+        r = pthread_join(c->thread, NULL);
+        if (r != 0)
+            syslib_error_sys("pthread", "join", r);
+
+#ifdef CONFIG_COLLECT_STATISTICS
+        stat_params_add(
+            lhash_stat_params(),
+            &dict->hash.stats,
+            &c->hash.stats);
+#endif
+    }
+
+    dict_numa_done(&pipe->numa);
+
+    for (i = 0; i < pipe->n_tokenizers; i ++) {
+        struct dict_tokenizer_t* t =
+            pipe->tokenizers + i;
+
+        dict_job_merge(dict, &t->dict);
+        dict_copy_done(&t->dict);
+
+        free(t->batches);
+        free(t->links);
     }
+
+    dict_words_done(dict);
+
+    for (i = 0; i < pipe->n_blocks; i ++)
+        free(pipe->blocks[i].ptr);
+
+    free(pipe->carry);
+    free(pipe->counters);
+    free(pipe->tokenizers);
+    free(pipe->blocks);
 }
 
-void file_io_stats_add(
-    struct file_io_stats_t* stats,
-    struct file_io_stats_t stats2)
+void dict_pipe_count(
+    struct dict_t* dict,
+    char const* const* file_names,
+    size_t n_file_names)
 {
-    if (stats->type == file_io_stats_type_null)
-        memcpy(stats, &stats2, sizeof *stats);
-    else {
-        VERIFY(stats->type == stats2.type);
-        stats->add(stats, &stats2);
+    struct dict_pipe_t p;
+    size_t i;
+
+    dict_pipe_init(&p, dict);
+
+    if (n_file_names == 0)
+        dict_pipe_read(&p, NULL);
+
+    for (i = 0; i < n_file_names; i ++) {
+        ASSERT(file_names[i] != NULL);
+        dict_pipe_read(&p, file_names[i]);
     }
+
+    dict_pipe_done(&p);
 }
 
-void file_io_stats_print_names(
-    bool mapped, bool empty,
-    const char* name,
-    FILE* file)
+void dict_count_files(
+    struct dict_t* dict,
+    char const* const* file_names,
+    size_t n_file_names)
 {
-    if (empty)
+    struct file_prefetch_t f;
+    size_t i;
+
+    if (dict->n_jobs > 1 && (
+        n_file_names > 1 ||
+        dict->chunk_size > 0)) {
+        dict_jobs_count(dict,
+            file_names, n_file_names);
         return;
-    if (mapped)
-        file_map_stats_print_names(
-            name, file);
-    else
-        file_buf_stats_print_names(
-            name, file);
+    }
+
+    if (dict->io.prefetch_size > 0)
+        file_prefetch_init(&f,
+            file_names, n_file_names,
+            dict->io.prefetch_size);
+
+    for (i = 0; i < n_file_names; i ++) {
+        ASSERT(file_names[i] != NULL);
+
+        if (dict->io.prefetch_size > 0)
+            file_prefetch_advance(&f, i);
+
+        dict_count(dict, file_names[i]);
+    }
+
+    if (dict->io.prefetch_size > 0) {
+#ifdef CONFIG_COLLECT_STATISTICS
+        dict->stats.prefetch = f.stats;
+#endif
+        file_prefetch_done(&f);
+    }
 }
 
-void file_io_stats_print(
-    const struct file_io_stats_t* stats,
-    const char* name, FILE* file)
+void dict_sort(
+    struct dict_t* dict)
 {
-    stats->print(stats, name, file);
+    lhash_sort(&dict->hash);
 }
 
-struct file_io_stats_t file_io_get_stats(
-    const struct file_io_t* file)
+void dict_print(
+    const struct dict_t* dict,
+    struct out_buf_t* out)
 {
-    struct file_io_stats_t s;
-    file_io_stats_init_from_file(&s, file);
-    return s;
+    lhash_print(&dict->hash, out);
+    out_buf_line(out, dict->n_words,
+        "total", 5);
 }
 
-struct dict_stats_t
+// stev: class 'dict_output_t' prints out the
+// words counted on several threads: first, the
+// nodes of the hash table that are to be printed
+// out are compacted into an array, each thread
+// copying those of its range of the hash table;
+// second, when the words are to be sorted, each
+// thread sorts its slice of the array, and then
+// the sorted slices are merged pairwise, in
+// rounds, each merge being split among threads
+// at the positions found by binary search; third,
+// each thread formats its slice of the array in
+// a buffer of its own; the buffers are written
+// out in order at the end
+
+struct dict_output_t;
+
+struct dict_output_job_t
 {
-    struct file_io_stats_t load_io;
-    struct file_io_stats_t count_io;
-    uint64_t load_time;
-    uint64_t count_time;
+    struct dict_output_t* output;
+    // stev: the number of nodes compacted
+    // and their position in the array
+    size_t n_nodes;
+    size_t pos;
+    char* buf;
+    size_t len;
+    pthread_t thread;
 };
 
-#endif // CONFIG_COLLECT_STATISTICS
-
-struct dict_t
+struct dict_output_t
 {
-    size_t io_buf_size;
-    bits_t mapped_dict: 1;
-    bits_t mapped_text: 1;
-    struct mem_mgr_t mem;
-    struct lhash_t hash;
-    size_t n_words;
-#ifdef CONFIG_COLLECT_STATISTICS
-    struct dict_stats_t stats;
-#endif
+    const struct lhash_t* hash;
+    struct lhash_node_t* nodes;
+    struct lhash_node_t* temp;
+    size_t n_nodes;
+    // stev: the bounds of the sorted runs
+    // of 'nodes' of the current merge round
+    size_t* runs;
+    size_t n_runs;
+    struct dict_output_job_t* jobs;
+    size_t n_jobs;
 };
 
-void dict_init(
-    struct dict_t* dict,
-    size_t io_buf_size,
-    size_t hash_tbl_size,
-    bool mapped_dict,
-    bool mapped_text)
+#define DICT_OUTPUT_JOB_INDEX(j) \
+    PTR_DIFF(j, (j)->output->jobs)
+
+// stev: the slice [lo, hi) of 'n' elements
+// of the job 'j' of the 'dict_output_t'
+#define DICT_OUTPUT_JOB_SLICE(j, n, lo, hi)      \
+    do {                                         \
+        struct dict_output_t* __o = (j)->output; \
+        size_t __i = DICT_OUTPUT_JOB_INDEX(j);   \
+        lo = (n) / __o->n_jobs * __i +           \
+             (n) % __o->n_jobs * __i /           \
+             __o->n_jobs;                        \
+        hi = (n) / __o->n_jobs * (__i + 1) +     \
+             (n) % __o->n_jobs * (__i + 1) /     \
+             __o->n_jobs;                        \
+    } while (0)
+
+#define DICT_OUTPUT_NODE_IS_WORD(p) \
+    (LHASH_NODE_KEY(p) != NULL && (p)->val > 0)
+
+void* dict_output_job_count(void* arg)
 {
-    memset(dict, 0, sizeof *dict);
+    struct dict_output_job_t* job = arg;
+    const struct lhash_t* h =
+        job->output->hash;
+    const struct lhash_node_t *p, *e;
+    size_t lo, hi;
 
-    dict->io_buf_size = io_buf_size;
-    dict->mapped_dict = mapped_dict;
-    dict->mapped_text = mapped_text;
+    DICT_OUTPUT_JOB_SLICE(job, h->size, lo, hi);
 
-    mem_mgr_init(&dict->mem, mapped_dict);
-    lhash_init(&dict->hash, hash_tbl_size);
+    for (p = h->table + lo,
+         e = h->table + hi;
+         p < e;
+         p ++) {
+        if (DICT_OUTPUT_NODE_IS_WORD(p))
+            job->n_nodes ++;
+    }
 
-#ifdef CONFIG_COLLECT_STATISTICS
-    file_io_stats_init(
-        &dict->stats.load_io);
-    file_io_stats_init(
-        &dict->stats.count_io);
-#endif
+    return NULL;
 }
 
-void dict_done(struct dict_t* dict)
+void* dict_output_job_compact(void* arg)
 {
-    lhash_done(&dict->hash);
-    mem_mgr_done(&dict->mem);
+    struct dict_output_job_t* job = arg;
+    struct dict_output_t* out = job->output;
+    const struct lhash_t* h = out->hash;
+    const struct lhash_node_t *p, *e;
+    struct lhash_node_t* q =
+        out->nodes + job->pos;
+    size_t lo, hi;
+
+    DICT_OUTPUT_JOB_SLICE(job, h->size, lo, hi);
+
+    for (p = h->table + lo,
+         e = h->table + hi;
+         p < e;
+         p ++) {
+        if (DICT_OUTPUT_NODE_IS_WORD(p))
+            *q ++ = *p;
+    }
+    ASSERT(PTR_DIFF(q, out->nodes) ==
+        job->pos + job->n_nodes);
+
+    return NULL;
 }
 
-void dict_load(
-    struct dict_t* dict,
-    const char* file_name)
+void* dict_output_job_sort(void* arg)
 {
-    struct file_io_t f;
-    size_t l = 0, k;
-    const char* b;
+    struct dict_output_job_t* job = arg;
+    struct dict_output_t* out = job->output;
+    size_t lo, hi;
 
-#ifdef CONFIG_COLLECT_STATISTICS
-    uint64_t c = time_now();
-#endif
-    file_io_init(
-        &f, &dict->mem,
-        dict->io_buf_size,
-        file_name, "dictionary");
+    DICT_OUTPUT_JOB_SLICE(job, out->n_nodes, lo, hi);
 
-    while (file_io_get_line(&f, &b, &k)) {
-        l ++;
+    if (hi > lo)
+        qsort(out->nodes + lo, hi - lo,
+            sizeof *out->nodes,
+            (int (*)(const void*, const void*))
+            lhash_cmp_key);
 
-        if (k == 0 || b[0] == '#')
-            continue;
+    return NULL;
+}
 
-#ifdef CONFIG_USE_48BIT_PTR
-        if (k > UINT16_MAX) {
-            warning("ignoring word on line #%zu: its length "
-                    "%zu exceeds the maximum allowed %" PRIu16,
-                    l, k, UINT16_MAX);
-            continue;
-        }
-#endif
+// stev: the number of elements of 'a' among
+// the first 'd' elements of the merge of the
+// sorted arrays 'a' and 'b'
+size_t dict_output_co_rank(
+    const struct lhash_node_t* a, size_t n,
+    const struct lhash_node_t* b, size_t m,
+    size_t d)
+{
+    size_t lo = d > m ? d - m : 0;
+    size_t hi = d < n ? d : n;
 
-        struct lhash_node_t* e = NULL;
-        if (!lhash_insert(&dict->hash, b, k, &e))
-            warning("duplicated word in line #%zu: '%.*s'",
-                l, UINT_AS_INT(k), b);
-        else {
-            ASSERT(e != NULL);
-            LHASH_NODE_INIT(e, b, k);
-        }
+    while (lo < hi) {
+        size_t i = lo + (hi - lo) / 2;
+
+        ASSERT(d - i > 0 && d - i <= m);
+        if (lhash_cmp_key(a + i, b + d - i - 1) < 0)
+            lo = i + 1;
+        else
+            hi = i;
     }
 
-#ifdef CONFIG_COLLECT_STATISTICS
-    dict->stats.load_io =
-        file_io_get_stats(&f);
-#endif
-    file_io_done(&f);
+    return lo;
+}
+
+void* dict_output_job_merge(void* arg)
+{
+    struct dict_output_job_t* job = arg;
+    struct dict_output_t* out = job->output;
+    size_t k = (out->n_runs + 1) / 2;
+    size_t q = out->n_jobs / k;
+    size_t t = DICT_OUTPUT_JOB_INDEX(job);
+    const struct lhash_node_t *a, *b;
+    struct lhash_node_t* r;
+    size_t i, j, n, m, d, e, x, y;
+
+    ASSERT(q > 0);
+
+    // stev: the job merges the part 't % q'
+    // of the pair of runs 't / q' -- when the
+    // run has no pair, it is only copied over
+    if ((i = t / q) >= k)
+        return NULL;
+    j = t % q;
+
+    a = out->nodes + out->runs[2 * i];
+    n = out->runs[2 * i + 1] -
+        out->runs[2 * i];
+    b = out->nodes + out->runs[2 * i + 1];
+    m = 2 * i + 2 <= out->n_runs
+        ? out->runs[2 * i + 2] -
+          out->runs[2 * i + 1]
+        : 0;
+    r = out->temp + out->runs[2 * i];
+
+    d = (n + m) / q * j +
+        (n + m) % q * j / q;
+    e = (n + m) / q * (j + 1) +
+        (n + m) % q * (j + 1) / q;
+
+    x = dict_output_co_rank(a, n, b, m, d);
+    y = dict_output_co_rank(a, n, b, m, e);
+
+    for (r += d, i = x, j = d - x;
+         i < y || j < e - y;) {
+        if (j >= e - y || (i < y &&
+            lhash_cmp_key(a + i, b + j) < 0))
+            *r ++ = a[i ++];
+        else
+            *r ++ = b[j ++];
+    }
 
-#ifdef CONFIG_COLLECT_STATISTICS
-    TIME_ADD(
-        dict->stats.load_time,
-        time_elapsed(c));
-#endif
+    return NULL;
 }
 
-typedef char ascii_table_t[256];
+void* dict_output_job_format(void* arg)
+{
+    struct dict_output_job_t* job = arg;
+    struct dict_output_t* out = job->output;
+    const struct lhash_node_t *p, *e;
+    size_t lo, hi, n = 0;
+    char* b;
+
+    DICT_OUTPUT_JOB_SLICE(job, out->n_nodes, lo, hi);
+
+    // stev: a line is at most 10 digits,
+    // a TAB, the word and a newline long
+    STATIC(UINT_MAX <= UINT32_MAX);
+    for (p = out->nodes + lo,
+         e = out->nodes + hi;
+         p < e;
+         p ++) {
+        size_t l = LHASH_NODE_LEN(p);
+        n = UINT_ADD(n, UINT_ADD(l, SZ(12)));
+    }
 
-size_t memspn(
-    const char* p, size_t n,
-    const ascii_table_t t)
+    if (n == 0)
+        return NULL;
+
+    b = job->buf = malloc(n);
+    VERIFY(b != NULL);
+
+    for (p = out->nodes + lo;
+         p < e;
+         p ++) {
+        size_t l = LHASH_NODE_LEN(p);
+
+        b += out_buf_format_uint(b, p->val);
+        *b ++ = '\t';
+        memcpy(b, LHASH_NODE_KEY(p), l);
+        b += l;
+        *b ++ = '\n';
+    }
+    job->len = PTR_DIFF(b, job->buf);
+    ASSERT(job->len <= n);
+
+    return NULL;
+}
+
+void dict_output_run(
+    struct dict_output_t* out,
+    void* (*run)(void*))
 {
-    const char* q = p;
-    while (n --) {
-        if (!t[UCHAR(*q)])
-            break;
-        q ++;
+    size_t i;
+    int r;
+
+    for (i = 0; i < out->n_jobs; i ++) {
+        struct dict_output_job_t* j =
+            out->jobs + i;
+
+        r = pthread_create(&j->thread, NULL,
+                run, j);
+        if (r != 0)
+            syslib_error_sys("pthread", "create", r);
+    }
+
+    for (i = 0; i < out->n_jobs; i ++) {
+        r = pthread_join(
+                out->jobs[i].thread, NULL);
+        if (r != 0)
+            syslib_error_sys("pthread", "join", r);
     }
-    return PTR_DIFF(q, p);
 }
 
-size_t memcspn(
-    const char* p, size_t n,
-    const ascii_table_t t)
+void dict_output_sort(
+    struct dict_output_t* out)
 {
-    const char* q = p;
-    while (n --) {
-        if (t[UCHAR(*q)])
-            break;
-        q ++;
+    struct lhash_node_t* t;
+    size_t i, k;
+
+    dict_output_run(out, dict_output_job_sort);
+
+    out->temp = malloc(UINT_MUL(
+        out->n_nodes, sizeof *out->temp));
+    VERIFY(out->temp != NULL);
+
+    out->runs = malloc(UINT_MUL(
+        out->n_jobs + 1, sizeof *out->runs));
+    VERIFY(out->runs != NULL);
+
+    // stev: the initial runs are the
+    // slices sorted by the jobs
+    for (i = 0; i <= out->n_jobs; i ++) {
+        size_t n = out->n_nodes;
+        out->runs[i] =
+            n / out->n_jobs * i +
+            n % out->n_jobs * i /
+            out->n_jobs;
     }
-    return PTR_DIFF(q, p);
+    out->n_runs = out->n_jobs;
+
+    while (out->n_runs > 1) {
+        dict_output_run(out, dict_output_job_merge);
+
+        k = (out->n_runs + 1) / 2;
+        for (i = 1; i < k; i ++)
+            out->runs[i] = out->runs[2 * i];
+        out->runs[k] = out->n_nodes;
+        out->n_runs = k;
+
+        t = out->nodes;
+        out->nodes = out->temp;
+        out->temp = t;
+    }
+
+    free(out->runs);
+    free(out->temp);
 }
 
-void dict_count(
+void dict_output_print(
     struct dict_t* dict,
-    const char* file_name)
+    bool sort, struct out_buf_t* out)
 {
-    static const ascii_table_t wsp = {
-        [' ']  = 1, ['\t'] = 1, ['\f'] = 1,
-        ['\n'] = 1, ['\r'] = 1, ['\v'] = 1,
-        ['\0'] = 1
-    };
+    struct dict_output_t o;
+    struct iovec* v;
+    size_t i, n = 0;
 
-    struct mem_mgr_t m;
-    struct file_io_t f;
-    size_t w = 0, k;
-    const char* p;
+    ASSERT(dict->n_jobs > 1);
 
-#ifdef CONFIG_COLLECT_STATISTICS
-    uint64_t c = time_now();
-#endif
-    if (dict->mapped_text)
-        mem_mgr_init(&m, true);
+    memset(&o, 0, sizeof o);
 
-    file_io_init(
-        &f, dict->mapped_text
-            ? &m : NULL,
-        dict->io_buf_size,
-        file_name, "input");
+    o.hash = &dict->hash;
+    o.n_jobs = dict->n_jobs;
+    o.jobs = calloc(o.n_jobs, sizeof *o.jobs);
+    VERIFY(o.jobs != NULL);
 
-    while (file_io_get_line(&f, &p, &k)) {
-        while (k > 0) {
-            // stev: skip over whitespaces
-            size_t s = memspn(p, k, wsp);
-            ASSERT(s <= k);
-            p += s;
-            k -= s;
-
-            // stev: compute word length
-            size_t n = memcspn(p, k, wsp);
-            if (n == 0) break;
-            w ++;
+    for (i = 0; i < o.n_jobs; i ++)
+        o.jobs[i].output = &o;
 
-            struct lhash_node_t* e = NULL;
-            if (lhash_lookup(&dict->hash, p, n, &e)) {
-                ASSERT(e != NULL);
-                ASSERT_UINT_INC_NO_OVERFLOW(
-                    e->val);
-                e->val ++;
-            }
+    dict_output_run(&o, dict_output_job_count);
 
-            ASSERT(n <= k);
-            p += n;
-            k -= n;
-        }
+    for (i = 0; i < o.n_jobs; i ++) {
+        o.jobs[i].pos = n;
+        n += o.jobs[i].n_nodes;
     }
+    o.n_nodes = n;
 
-#ifdef CONFIG_COLLECT_STATISTICS
-    file_io_stats_add(
-        &dict->stats.count_io,
-        file_io_get_stats(&f));
-#endif
-    file_io_done(&f);
+    if (n > 0) {
+        o.nodes = malloc(UINT_MUL(
+            n, sizeof *o.nodes));
+        VERIFY(o.nodes != NULL);
 
-    if (dict->mapped_text)
-        mem_mgr_done(&m);
+        dict_output_run(&o, dict_output_job_compact);
+        if (sort)
+            dict_output_sort(&o);
+        dict_output_run(&o, dict_output_job_format);
+    }
 
-    ASSERT_UINT_ADD_NO_OVERFLOW(
-        dict->n_words, w);
-    dict->n_words += w;
+    // stev: the buffers of the jobs are
+    // written out as they are, by 'writev'
+    v = malloc(UINT_MUL(o.n_jobs, sizeof *v));
+    VERIFY(v != NULL);
 
-#ifdef CONFIG_COLLECT_STATISTICS
-    TIME_ADD(
-        dict->stats.count_time,
-        time_elapsed(c));
-#endif
-}
+    for (i = 0, n = 0; i < o.n_jobs; i ++) {
+        struct dict_output_job_t* j =
+            o.jobs + i;
 
-void dict_sort(
-    struct dict_t* dict)
-{
-    lhash_sort(&dict->hash);
+        if (j->len == 0)
+            continue;
+
+        v[n].iov_base = j->buf;
+        v[n].iov_len = j->len;
+        n ++;
+    }
+
+    out_buf_flush(out);
+    out_buf_writev(out, v, n);
+    out_buf_line(out, dict->n_words,
+        "total", 5);
+
+    for (i = 0; i < o.n_jobs; i ++)
+        free(o.jobs[i].buf);
+
+    free(v);
+    free(o.nodes);
+    free(o.jobs);
 }
 
-void dict_print(
-    const struct dict_t* dict, FILE* file)
+// stev: print out the words counted, sorted
+// when 'sort' is true, to the file 'fd' named
+// 'name'; with '-j', the output is done on
+// several threads too; 'fd' is written to
+// directly: any stdio buffer of it has to be
+// flushed by the caller beforehand
+void dict_output(
+    struct dict_t* dict,
+    bool sort, int fd,
+    const char* name)
 {
-    lhash_print(&dict->hash, file);
-    fprintf(file, "%zu\ttotal\n",
-        dict->n_words);
+    struct out_buf_t o;
+
+    out_buf_init(&o, fd, name);
+
+    if (dict->n_jobs > 1)
+        dict_output_print(dict, sort, &o);
+    else {
+        if (sort)
+            dict_sort(dict);
+        dict_print(dict, &o);
+    }
+
+    out_buf_done(&o);
 }
 
 #ifdef CONFIG_COLLECT_STATISTICS
@@ -2905,8 +11202,10 @@ const struct stat_params_t*
 #define CASE(n, t) \
     STAT_PARAM_DEF(dict_stats_t, n, t)
     static const struct stat_param_t params[] = {
-        CASE(load_time,  time),
-        CASE(count_time, time),
+        CASE(chunk_count, size),
+        CASE(steal_count, size),
+        CASE(load_time,   time),
+        CASE(count_time,  time),
     };
     static const struct stat_params_t stat = {
         .n_params = ARRAY_SIZE(params),
@@ -2918,18 +11217,40 @@ const struct stat_params_t*
 
 void dict_print_stat_names(
     bool mapped_dict,
-    bool mapped_text,
+    enum file_io_type_t text_io,
+    bool prefetch,
     bool only_load,
     FILE* file)
 {
     lhash_print_stat_names(
         NULL, file);
     file_io_stats_print_names(
-        mapped_dict, false,
-        "load", file);
-    file_io_stats_print_names(
-        mapped_text, only_load,
-        "count", file);
+        mapped_dict
+            ? file_io_type_map
+            : file_io_type_buf,
+        false, "load", file);
+    if (text_io != file_io_type_auto)
+        file_io_stats_print_names(
+            text_io, only_load,
+            "count", file);
+    else
+    if (!only_load) {
+        const enum file_io_type_t *p, *e;
+
+        for (p = file_io_auto_types,
+             e = p + ARRAY_SIZE(file_io_auto_types);
+             p < e;
+             p ++)
+            file_io_stats_print_names(
+                *p, false, "count", file);
+        stat_params_print_names(
+            file_io_auto_stat_params(),
+            "count", file);
+    }
+    if (prefetch && !only_load)
+        stat_params_print_names(
+            file_prefetch_stat_params(),
+            "count", file);
     stat_params_print_names(
         dict_stat_params(),
         NULL, file);
@@ -2945,9 +11266,30 @@ void dict_print_stats(
     file_io_stats_print(
         &dict->stats.load_io,
         "load", file);
-    file_io_stats_print(
-        &dict->stats.count_io,
-        "count", file);
+    if (dict->text_io != file_io_type_auto)
+        file_io_stats_print(
+            &dict->stats.count_io,
+            "count", file);
+    else
+    if (dict->stats.auto_used) {
+        const struct file_io_stats_t *p, *e;
+
+        for (p = dict->stats.auto_io,
+             e = p + ARRAY_SIZE(dict->stats.auto_io);
+             p < e;
+             p ++)
+            file_io_stats_print(
+                p, "count", file);
+        stat_params_print(
+            file_io_auto_stat_params(),
+            &dict->stats.auto_stats,
+            "count", file);
+    }
+    if (dict->io.prefetch_size > 0)
+        stat_params_print(
+            file_prefetch_stat_params(),
+            &dict->stats.prefetch,
+            "count", file);
     stat_params_print(
         dict_stat_params(),
         &dict->stats,
@@ -3011,6 +11353,16 @@ void print_config(FILE* file)
 #else
         PRINT_CONFIG_DEF(PROBE_HASH_FORWARD),
 #endif
+#ifndef CONFIG_USE_ZLIB
+        PRINT_CONFIG_UND(USE_ZLIB),
+#else
+        PRINT_CONFIG_DEF(USE_ZLIB),
+#endif
+#ifndef CONFIG_USE_ZSTD
+        PRINT_CONFIG_UND(USE_ZSTD),
+#else
+        PRINT_CONFIG_DEF(USE_ZSTD),
+#endif
 #ifndef CONFIG_COLLECT_STATISTICS
         PRINT_CONFIG_UND(COLLECT_STATISTICS),
 #else
@@ -3056,11 +11408,22 @@ struct options_t
     char const* dict;
     char const* const* inputs;
     size_t n_inputs;
-    size_t io_buf_size;
+    struct file_io_opts_t io;
     size_t hash_tbl_size;
+    size_t n_jobs;
+    size_t chunk_size;
+    enum dict_counters_t counters;
+    size_t n_tokenizers;
+    size_t n_counters;
+    cpu_set_t cpus;
+    size_t n_cpus;
+    const char* numa_nodes;
+    enum file_io_type_t text_io;
     bits_t dict_use_mmap_io: 1;
-    bits_t text_use_mmap_io: 1;
     bits_t sort_words: 1;
+    bits_t utf8_text: 1;
+    bits_t all_words: 1;
+    struct fields_t fields;
 };
 
 void options_invalid_opt_arg(
@@ -3131,11 +11494,171 @@ void options_parse_su_size_optarg(
     v = options_parse_num(p, &q);
     d = PTR_DIFF(q, p);
 
-    if (errno ||
-        (d == 0) ||
-        (d < n - 1) ||
-        (d == n - 1 && *q != 'k' && *q != 'K' &&
-            *q != 'm' && *q != 'M')) {
+    if (errno ||
+        (d == 0) ||
+        (d < n - 1) ||
+        (d == n - 1 && *q != 'k' && *q != 'K' &&
+            *q != 'm' && *q != 'M')) {
+        if (opt_name == NULL)
+            return;
+        options_invalid_opt_arg(
+            opt_name,
+            opt_arg);
+    }
+
+    switch (*q) {
+    case 'm':
+    case 'M':
+        if (!UINT_MUL_NO_OVERFLOW(v, KB(1))) {
+            if (opt_name == NULL)
+                return;
+            options_illegal_opt_arg(
+                opt_name,
+                opt_arg);
+        }
+        v *= KB(1);
+        // FALLTHROUGH
+
+    case 'k':
+    case 'K':
+        if (!UINT_MUL_NO_OVERFLOW(v, KB(1))) {
+            if (opt_name == NULL)
+                return;
+            options_illegal_opt_arg(
+                opt_name,
+                opt_arg);
+        }
+        v *= KB(1);
+    }
+
+    if ((min > 0 && v < min) ||
+        (max > 0 && v > max)) {
+        if (opt_name == NULL)
+            return;
+        options_illegal_opt_arg(
+            opt_name,
+            opt_arg);
+    }
+
+    *res = v;
+}
+
+#define OPTIONS_PARSE_SU_SIZE_OPTARG(n) \
+    do {                                \
+        if (opt_name != NULL)           \
+            ASSERT(opt_arg != NULL);    \
+        else                            \
+        if (opt_arg == NULL)            \
+            return;                     \
+        options_parse_su_size_optarg(   \
+            opt_name, opt_arg,          \
+            1, 0, &opts->n);            \
+    } while (0)
+
+void options_parse_io_buf_size_optarg(
+    struct options_t* opts,
+    const char* opt_name,
+    const char* opt_arg)
+{
+    if (opt_arg != NULL)
+        opts->io.adapt_buf_size =
+            !strcmp(opt_arg, "auto");
+    if (opts->io.adapt_buf_size)
+        return;
+
+    OPTIONS_PARSE_SU_SIZE_OPTARG(
+        io.io_buf_size);
+}
+
+void options_parse_max_buf_size_optarg(
+    struct options_t* opts,
+    const char* opt_name,
+    const char* opt_arg)
+{
+    OPTIONS_PARSE_SU_SIZE_OPTARG(
+        io.max_buf_size);
+}
+
+void options_parse_prefetch_size_optarg(
+    struct options_t* opts,
+    const char* opt_name,
+    const char* opt_arg)
+{
+    OPTIONS_PARSE_SU_SIZE_OPTARG(
+        io.prefetch_size);
+}
+
+void options_parse_auto_map_min_optarg(
+    struct options_t* opts,
+    const char* opt_name,
+    const char* opt_arg)
+{
+    OPTIONS_PARSE_SU_SIZE_OPTARG(
+        io.auto_map_min);
+}
+
+void options_parse_map_window_optarg(
+    struct options_t* opts,
+    const char* opt_name,
+    const char* opt_arg)
+{
+    OPTIONS_PARSE_SU_SIZE_OPTARG(
+        io.map_window);
+}
+
+void options_parse_hash_tbl_size_optarg(
+    struct options_t* opts,
+    const char* opt_name,
+    const char* opt_arg)
+{
+    OPTIONS_PARSE_SU_SIZE_OPTARG(
+        hash_tbl_size);
+}
+
+void options_parse_jobs_optarg(
+    struct options_t* opts,
+    const char* opt_name,
+    const char* opt_arg)
+{
+    if (opt_name != NULL)
+        ASSERT(opt_arg != NULL);
+    else
+    if (opt_arg == NULL)
+        return;
+
+    options_parse_su_size_optarg(
+        opt_name, opt_arg, 1,
+        DICT_JOBS_MAX,
+        &opts->n_jobs);
+}
+
+void options_parse_chunk_size_optarg(
+    struct options_t* opts,
+    const char* opt_name,
+    const char* opt_arg)
+{
+    OPTIONS_PARSE_SU_SIZE_OPTARG(
+        chunk_size);
+}
+
+void options_parse_pipeline_optarg(
+    struct options_t* opts,
+    const char* opt_name,
+    const char* opt_arg)
+{
+    const char *p, *q;
+    size_t t, c;
+
+    if (opt_name != NULL)
+        ASSERT(opt_arg != NULL);
+    else
+    if (opt_arg == NULL)
+        return;
+
+    t = options_parse_num(opt_arg, &p);
+    if (errno || *p != ',' ||
+        (c = options_parse_num(p + 1, &q),
+         errno) || *q) {
         if (opt_name == NULL)
             return;
         options_invalid_opt_arg(
@@ -3143,33 +11666,8 @@ void options_parse_su_size_optarg(
             opt_arg);
     }
 
-    switch (*q) {
-    case 'm':
-    case 'M':
-        if (!UINT_MUL_NO_OVERFLOW(v, KB(1))) {
-            if (opt_name == NULL)
-                return;
-            options_illegal_opt_arg(
-                opt_name,
-                opt_arg);
-        }
-        v *= KB(1);
-        // FALLTHROUGH
-
-    case 'k':
-    case 'K':
-        if (!UINT_MUL_NO_OVERFLOW(v, KB(1))) {
-            if (opt_name == NULL)
-                return;
-            options_illegal_opt_arg(
-                opt_name,
-                opt_arg);
-        }
-        v *= KB(1);
-    }
-
-    if ((min > 0 && v < min) ||
-        (max > 0 && v > max)) {
+    if (t == 0 || t > DICT_JOBS_MAX ||
+        c == 0 || c > DICT_JOBS_MAX) {
         if (opt_name == NULL)
             return;
         options_illegal_opt_arg(
@@ -3177,37 +11675,88 @@ void options_parse_su_size_optarg(
             opt_arg);
     }
 
-    *res = v;
+    opts->n_tokenizers = t;
+    opts->n_counters = c;
 }
 
-#define OPTIONS_PARSE_SU_SIZE_OPTARG(n) \
-    do {                                \
-        if (opt_name != NULL)           \
-            ASSERT(opt_arg != NULL);    \
-        else                            \
-        if (opt_arg == NULL)            \
-            return;                     \
-        options_parse_su_size_optarg(   \
-            opt_name, opt_arg,          \
-            1, 0, &opts->n);            \
-    } while (0)
-
-void options_parse_io_buf_size_optarg(
+void options_parse_cpus_optarg(
     struct options_t* opts,
     const char* opt_name,
     const char* opt_arg)
 {
-    OPTIONS_PARSE_SU_SIZE_OPTARG(
-        io_buf_size);
+    cpu_set_t c;
+
+    if (opt_name != NULL)
+        ASSERT(opt_arg != NULL);
+    else
+    if (opt_arg == NULL)
+        return;
+
+    if (!cpu_list_parse(opt_arg, &c) ||
+        strchr(opt_arg, '\n')) {
+        if (opt_name == NULL)
+            return;
+        options_invalid_opt_arg(
+            opt_name,
+            opt_arg);
+    }
+
+    opts->cpus = c;
+    opts->n_cpus = CPU_COUNT(&c);
 }
 
-void options_parse_hash_tbl_size_optarg(
+void options_parse_numa_optarg(
     struct options_t* opts,
     const char* opt_name,
     const char* opt_arg)
 {
-    OPTIONS_PARSE_SU_SIZE_OPTARG(
-        hash_tbl_size);
+    const char *p, *q;
+    size_t n = 0;
+
+    if (opt_name != NULL)
+        ASSERT(opt_arg != NULL);
+    else
+    if (opt_arg == NULL)
+        return;
+
+    if (!strcmp(opt_arg, "auto")) {
+        opts->numa_nodes = opt_arg;
+        return;
+    }
+
+    for (p = opt_arg;; p = q + 1) {
+        char b[4096];
+        cpu_set_t c;
+        size_t l;
+
+        q = strchr(p, ':');
+        l = q != NULL
+            ? PTR_DIFF(q, p)
+            : strlen(p);
+
+        if (l >= sizeof b ||
+            (memcpy(b, p, l), b[l] = 0,
+             !cpu_list_parse(b, &c)) ||
+            strchr(b, '\n')) {
+            if (opt_name == NULL)
+                return;
+            options_invalid_opt_arg(
+                opt_name,
+                opt_arg);
+        }
+        if (++ n > DICT_NUMA_NODES_MAX) {
+            if (opt_name == NULL)
+                return;
+            options_illegal_opt_arg(
+                opt_name,
+                opt_arg);
+        }
+
+        if (q == NULL)
+            break;
+    }
+
+    opts->numa_nodes = opt_arg;
 }
 
 void options_parse_use_mmap_io_optarg(
@@ -3263,8 +11812,225 @@ void options_parse_use_mmap_io_optarg(
 
     opts->dict_use_mmap_io =
         (p->value & dict) != 0;
-    opts->text_use_mmap_io =
-        (p->value & text) != 0;
+    opts->text_io =
+        (p->value & text) != 0
+        ? file_io_type_map
+        : file_io_type_buf;
+}
+
+void options_parse_text_io_optarg(
+    struct options_t* opts,
+    const char* opt_name,
+    const char* opt_arg)
+{
+    struct spec_t
+    { const char* name; enum file_io_type_t value; };
+    static const struct spec_t specs[] = {
+#undef  CASE
+#define CASE(n) \
+    { .name = #n, .value = file_io_type_ ## n }
+        CASE(buf),
+        CASE(map),
+        CASE(uring),
+        CASE(ahead),
+        CASE(window),
+        CASE(splice),
+        CASE(decomp),
+        CASE(direct),
+        CASE(auto),
+    };
+    const struct spec_t *p, *e;
+
+    if (opt_name != NULL)
+        ASSERT(opt_arg != NULL);
+    else
+    if (opt_arg == NULL)
+        return;
+
+    for (p = specs,
+         e = p + ARRAY_SIZE(specs);
+         p < e;
+         p ++) {
+        if (!strcmp(p->name, opt_arg))
+            break;
+    }
+
+    if (p >= e) {
+        if (opt_name == NULL)
+            return;
+        options_invalid_opt_arg(
+            opt_name,
+            opt_arg);
+    }
+
+    opts->text_io = p->value;
+}
+
+void options_parse_counters_optarg(
+    struct options_t* opts,
+    const char* opt_name,
+    const char* opt_arg)
+{
+    struct spec_t
+    { const char* name; enum dict_counters_t value; };
+    static const struct spec_t specs[] = {
+#undef  CASE
+#define CASE(n) \
+    { .name = #n, .value = dict_counters_ ## n }
+        CASE(shard),
+        CASE(atomic),
+        CASE(hybrid),
+    };
+    const struct spec_t *p, *e;
+
+    if (opt_name != NULL)
+        ASSERT(opt_arg != NULL);
+    else
+    if (opt_arg == NULL)
+        return;
+
+    for (p = specs,
+         e = p + ARRAY_SIZE(specs);
+         p < e;
+         p ++) {
+        if (!strcmp(p->name, opt_arg))
+            break;
+    }
+
+    if (p >= e) {
+        if (opt_name == NULL)
+            return;
+        options_invalid_opt_arg(
+            opt_name,
+            opt_arg);
+    }
+
+    opts->counters = p->value;
+}
+
+int options_field_range_cmp(
+    const struct field_range_t* a,
+    const struct field_range_t* b)
+{
+    return
+        a->lo < b->lo ? -1 :
+        a->lo > b->lo ? +1 :
+        0;
+}
+
+void options_parse_fields_optarg(
+    struct options_t* opts,
+    const char* opt_name,
+    const char* opt_arg)
+{
+    struct fields_t* f = &opts->fields;
+    struct field_range_t *r, *q, *e;
+    const char *p, *t;
+    size_t n = 0, m = 0;
+
+    ASSERT(opt_arg != NULL);
+
+    free(f->ranges);
+    f->ranges = NULL;
+    f->n_ranges = 0;
+
+    for (p = opt_arg;; p = t + 1) {
+        size_t lo = 1, hi = SIZE_MAX;
+
+        t = p;
+        if (*t != '-') {
+            lo = options_parse_num(t, &t);
+            if (errno || lo == 0)
+                options_invalid_opt_arg(
+                    opt_name, opt_arg);
+            if (*t != '-')
+                hi = lo;
+        }
+        if (*t == '-' &&
+            *++ t != ',' && *t) {
+            hi = options_parse_num(t, &t);
+            if (errno || hi == 0)
+                options_invalid_opt_arg(
+                    opt_name, opt_arg);
+        }
+        // stev: reject the empty range '-'
+        if (p[0] == '-' && t == p + 1)
+            options_invalid_opt_arg(
+                opt_name, opt_arg);
+        if (*t != ',' && *t)
+            options_invalid_opt_arg(
+                opt_name, opt_arg);
+        if (lo > hi)
+            options_illegal_opt_arg(
+                opt_name, opt_arg);
+
+        if (n >= m) {
+            m = m ? UINT_MUL(m, SZ(2)) : SZ(4);
+            r = realloc(f->ranges,
+                    UINT_MUL(m, sizeof *r));
+            VERIFY(r != NULL);
+            f->ranges = r;
+        }
+        r = f->ranges + n ++;
+        // stev: fields are numbered from
+        // 1 on the command line and from
+        // 0 internally
+        r->lo = lo - 1;
+        r->hi = hi != SIZE_MAX
+            ? hi - 1 : SIZE_MAX;
+
+        if (*t == 0)
+            break;
+    }
+
+    qsort(f->ranges, n, sizeof *f->ranges,
+        (int (*)(const void*, const void*))
+        options_field_range_cmp);
+
+    // stev: merge the overlapping or the
+    // adjacent ranges of fields together
+    for (q = r = f->ranges,
+         e = r + n;
+         ++ r < e;) {
+        if (q->hi != SIZE_MAX &&
+            r->lo > q->hi + 1)
+            *++ q = *r;
+        else
+        if (q->hi < r->hi)
+            q->hi = r->hi;
+    }
+    f->n_ranges = PTR_DIFF(q + 1, f->ranges);
+}
+
+void options_parse_delimiter_optarg(
+    struct options_t* opts,
+    const char* opt_name,
+    const char* opt_arg)
+{
+    ASSERT(opt_arg != NULL);
+
+    if (opt_arg[0] == 0 ||
+        opt_arg[1] != 0 ||
+        opt_arg[0] == '\n')
+        options_invalid_opt_arg(
+            opt_name, opt_arg);
+
+    opts->fields.delim = opt_arg[0];
+}
+
+void options_parse_skip_lines_optarg(
+    struct options_t* opts,
+    const char* opt_name,
+    const char* opt_arg)
+{
+    ASSERT(opt_arg != NULL);
+
+    if (opt_arg[0] == 0)
+        options_invalid_opt_arg(
+            opt_name, opt_arg);
+
+    opts->fields.skip = opt_arg;
+    opts->fields.skip_len = strlen(opt_arg);
 }
 
 const struct options_t*
@@ -3275,8 +12041,12 @@ const struct options_t*
         .action        =
             options_action_count_words,
 #endif
-        .io_buf_size   = KB(4),
-        .hash_tbl_size = KB(1)
+        .io.io_buf_size = KB(4),
+        .io.map_window  = MB(256),
+        .io.auto_map_min = KB(64),
+        .hash_tbl_size = KB(1),
+        .n_jobs        = 1,
+        .fields.delim  = '\t'
     };
 
 #define GET_ENV(n) getenv("WORD_COUNT_" #n)
@@ -3287,8 +12057,30 @@ const struct options_t*
         &opts, NULL, GET_ENV(IO_BUF_SIZE));
     options_parse_hash_tbl_size_optarg(
         &opts, NULL, GET_ENV(HASH_TBL_SIZE));
+    options_parse_jobs_optarg(
+        &opts, NULL, GET_ENV(JOBS));
+    options_parse_chunk_size_optarg(
+        &opts, NULL, GET_ENV(CHUNK_SIZE));
+    options_parse_counters_optarg(
+        &opts, NULL, GET_ENV(COUNTERS));
+    options_parse_pipeline_optarg(
+        &opts, NULL, GET_ENV(PIPELINE));
+    options_parse_cpus_optarg(
+        &opts, NULL, GET_ENV(CPUS));
+    options_parse_numa_optarg(
+        &opts, NULL, GET_ENV(NUMA));
+    options_parse_max_buf_size_optarg(
+        &opts, NULL, GET_ENV(MAX_BUF_SIZE));
+    options_parse_prefetch_size_optarg(
+        &opts, NULL, GET_ENV(PREFETCH_SIZE));
+    options_parse_map_window_optarg(
+        &opts, NULL, GET_ENV(MAP_WINDOW));
+    options_parse_auto_map_min_optarg(
+        &opts, NULL, GET_ENV(AUTO_MAP_MIN));
     options_parse_use_mmap_io_optarg(
         &opts, NULL, GET_ENV(USE_MMAP_IO));
+    options_parse_text_io_optarg(
+        &opts, NULL, GET_ENV(TEXT_IO));
 
     enum {
 #ifdef CONFIG_COLLECT_STATISTICS
@@ -3298,10 +12090,27 @@ const struct options_t*
         collect_stats_act = 'S',
 #endif
         // stev: instance options:
+        auto_map_min_opt  = 'a',
         io_buf_size_opt   = 'b',
+        chunk_size_opt    = 'c',
+        delimiter_opt     = 'd',
+        pipeline_opt      = 'e',
+        fields_opt        = 'f',
+        all_words_opt     = 'g',
         hash_tbl_size_opt = 'h',
+        text_io_opt       = 'i',
+        jobs_opt          = 'j',
+        cpus_opt          = 'k',
+        max_buf_size_opt  = 'l',
+        numa_opt          = 'n',
         use_mmap_io_opt   = 'm',
+        prefetch_size_opt = 'p',
+        drop_behind_opt   = 'r',
         sort_words_opt    = 's',
+        counters_opt      = 't',
+        utf8_text_opt     = 'u',
+        map_window_opt    = 'w',
+        skip_lines_opt    = 'x',
 
         // stev: info options:
         help_opt          = '?',
@@ -3318,10 +12127,27 @@ const struct options_t*
         { "count-words",      0,       0, count_words_act },
         { "collect-stats",    0,       0, collect_stats_act },
 #endif
+        { "auto-map-min",     1,       0, auto_map_min_opt },
         { "io-buf-size",      1,       0, io_buf_size_opt },
+        { "delimiter",        1,       0, delimiter_opt },
+        { "fields",           1,       0, fields_opt },
+        { "all-words",        0,       0, all_words_opt },
         { "hash-tbl-size",    1,       0, hash_tbl_size_opt },
+        { "text-io",          1,       0, text_io_opt },
+        { "jobs",             1,       0, jobs_opt },
+        { "chunk-size",       1,       0, chunk_size_opt },
+        { "counters",         1,       0, counters_opt },
+        { "pipeline",         1,       0, pipeline_opt },
+        { "cpus",             1,       0, cpus_opt },
+        { "numa",             1,       0, numa_opt },
+        { "max-buf-size",     1,       0, max_buf_size_opt },
         { "use-mmap-io",      1,       0, use_mmap_io_opt },
+        { "prefetch-size",    1,       0, prefetch_size_opt },
+        { "drop-behind",      0,       0, drop_behind_opt },
         { "sort-words",       0,       0, sort_words_opt },
+        { "utf8-text",        0,       0, utf8_text_opt },
+        { "map-window",       1,       0, map_window_opt },
+        { "skip-lines",       1,       0, skip_lines_opt },
         { "print-config",     0,       0, print_config_opt },
         { "config",           0,       0, print_config_opt },
 #ifdef CONFIG_COLLECT_STATISTICS
@@ -3337,7 +12163,7 @@ const struct options_t*
 #ifdef CONFIG_COLLECT_STATISTICS
         "LCS"
 #endif
-        "b:h:m:s";
+        "a:b:c:d:e:f:gh:i:j:k:l:m:n:p:rst:uw:x:";
 
     struct bits_opts_t
     {
@@ -3397,24 +12223,103 @@ const struct options_t*
             opts.action = options_action_collect_stats;
             break;
 #endif
+        case auto_map_min_opt:
+            options_parse_auto_map_min_optarg(
+                &opts, "auto-map-min",
+                optarg);
+            break;
         case io_buf_size_opt:
             options_parse_io_buf_size_optarg(
                 &opts, "io-buf-size",
                 optarg);
             break;
+        case delimiter_opt:
+            options_parse_delimiter_optarg(
+                &opts, "delimiter",
+                optarg);
+            break;
+        case fields_opt:
+            options_parse_fields_optarg(
+                &opts, "fields",
+                optarg);
+            break;
         case hash_tbl_size_opt:
             options_parse_hash_tbl_size_optarg(
                 &opts, "hash-tbl-size",
                 optarg);
             break;
+        case text_io_opt:
+            options_parse_text_io_optarg(
+                &opts, "text-io",
+                optarg);
+            break;
+        case jobs_opt:
+            options_parse_jobs_optarg(
+                &opts, "jobs",
+                optarg);
+            break;
+        case chunk_size_opt:
+            options_parse_chunk_size_optarg(
+                &opts, "chunk-size",
+                optarg);
+            break;
+        case counters_opt:
+            options_parse_counters_optarg(
+                &opts, "counters",
+                optarg);
+            break;
+        case pipeline_opt:
+            options_parse_pipeline_optarg(
+                &opts, "pipeline",
+                optarg);
+            break;
+        case cpus_opt:
+            options_parse_cpus_optarg(
+                &opts, "cpus",
+                optarg);
+            break;
+        case numa_opt:
+            options_parse_numa_optarg(
+                &opts, "numa",
+                optarg);
+            break;
+        case max_buf_size_opt:
+            options_parse_max_buf_size_optarg(
+                &opts, "max-buf-size",
+                optarg);
+            break;
         case use_mmap_io_opt:
             options_parse_use_mmap_io_optarg(
                 &opts, "use-mmap-io",
                 optarg);
             break;
+        case prefetch_size_opt:
+            options_parse_prefetch_size_optarg(
+                &opts, "prefetch-size",
+                optarg);
+            break;
+        case drop_behind_opt:
+            opts.io.drop_behind = true;
+            break;
         case sort_words_opt:
             opts.sort_words = true;
             break;
+        case utf8_text_opt:
+            opts.utf8_text = true;
+            break;
+        case all_words_opt:
+            opts.all_words = true;
+            break;
+        case map_window_opt:
+            options_parse_map_window_optarg(
+                &opts, "map-window",
+                optarg);
+            break;
+        case skip_lines_opt:
+            options_parse_skip_lines_optarg(
+                &opts, "skip-lines",
+                optarg);
+            break;
         case print_config_opt:
             bits.config = true;
             break;
@@ -3487,7 +12392,8 @@ const struct options_t*
             options_action_count_words)
             dict_print_stat_names(
                 opts.dict_use_mmap_io,
-                opts.text_use_mmap_io,
+                opts.text_io,
+                opts.io.prefetch_size > 0,
                 opts.action ==
                 options_action_load_dict,
                 stdout);
@@ -3495,12 +12401,24 @@ const struct options_t*
     }
 #endif
 
-    if (argc <= 0)
-        error("dictionary file name not given");
-
     char const* const* args =
         PTR_PTR_CAST(argv, char);
 
+    // stev: with '-g' there is no dictionary,
+    // thus nothing to be replicated, and the
+    // words are not passed on to counters
+    if (opts.all_words) {
+        opts.n_tokenizers = 0;
+        opts.n_counters = 0;
+        opts.numa_nodes = NULL;
+        opts.inputs = args;
+        opts.n_inputs = INT_AS_SIZE(argc);
+        return &opts;
+    }
+
+    if (argc <= 0)
+        error("dictionary file name not given");
+
     opts.dict = *args;
     opts.inputs = ++ args;
     opts.n_inputs = -- argc;
@@ -3515,11 +12433,28 @@ int main(int argc, char* argv[])
 
     struct dict_t dict;
     dict_init(&dict,
-        opt->io_buf_size,
+        &opt->io,
         opt->hash_tbl_size,
         opt->dict_use_mmap_io,
-        opt->text_use_mmap_io);
-    dict_load(&dict, opt->dict);
+        opt->text_io,
+        opt->utf8_text,
+        &opt->fields,
+        opt->n_jobs,
+        opt->chunk_size,
+        opt->counters,
+        opt->n_tokenizers,
+        opt->n_counters,
+        opt->n_cpus > 0
+            ? &opt->cpus : NULL,
+        opt->numa_nodes,
+        opt->all_words,
+#ifdef CONFIG_COLLECT_STATISTICS
+        opt->action !=
+            options_action_count_words ||
+#endif
+        opt->sort_words);
+    if (!opt->all_words)
+        dict_load(&dict, opt->dict);
 
 #ifdef CONFIG_COLLECT_STATISTICS
     if (opt->action ==
@@ -3527,32 +12462,34 @@ int main(int argc, char* argv[])
         goto print_stats;
 #endif
 
+    if (opt->n_tokenizers > 0)
+        dict_pipe_count(&dict,
+            opt->inputs,
+            opt->n_inputs);
+    else
+    if (!opt->n_inputs &&
+        opt->n_jobs > 1)
+        dict_pipe_count(&dict, NULL, 0);
+    else
     if (!opt->n_inputs)
         dict_count(&dict, NULL);
-    else {
-        char const* const* p;
-        char const* const* e;
-
-        for (p = opt->inputs,
-             e = p + opt->n_inputs;
-             p < e;
-             p ++) {
-            ASSERT(*p != NULL);
-            dict_count(&dict, *p);
-        }
-    }
+    else
+        dict_count_files(&dict,
+            opt->inputs,
+            opt->n_inputs);
 
 #ifndef CONFIG_COLLECT_STATISTICS
-    if (opt->sort_words)
-        dict_sort(&dict);
-    dict_print(&dict, stdout);
+    dict_output(&dict,
+        opt->sort_words,
+        STDOUT_FILENO,
+        stdout_name);
 #else
     if (opt->action ==
-        options_action_count_words) {
-        if (opt->sort_words)
-            dict_sort(&dict);
-        dict_print(&dict, stdout);
-    }
+        options_action_count_words)
+        dict_output(&dict,
+            opt->sort_words,
+            STDOUT_FILENO,
+            stdout_name);
     else
     print_stats:
         dict_print_stats(&dict, stdout);